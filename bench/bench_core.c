@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "args.h"
+#include "context.h"
+#include "helper.h"
+#include "lexer.h"
+#include "symtable.h"
+
+/* Microbenchmarks for the data structures every phase sits on. Each benchmark
+ * is run for a number of untimed warmup repetitions, then for a number of
+ * timed repetitions. The median and the median absolute deviation of the time
+ * per operation are reported, since both are robust against the occasional
+ * repetition that gets descheduled or hits a page fault storm. */
+
+typedef struct {
+  const char *name;
+  size_t ops; /* operations done by a single call to run */
+  void (*prepare)(void);
+  void (*run)(void);
+  void (*cleanup)(void);
+} Bench;
+
+static double
+now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int
+cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* sorts samples in place */
+static double
+median(double *samples, size_t n) {
+  qsort(samples, n, sizeof(double), cmp_double);
+  if (n % 2 == 0) {
+    return (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  }
+  return samples[n / 2];
+}
+
+/* keeps results observable so the optimizer can't drop the work */
+static volatile uintptr_t sink;
+
+/* simple xorshift generator, so runs are reproducible across machines */
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+
+static uint64_t
+rng_next() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+/* mempool_alloc */
+
+#define POOL_ALLOCS 1000000
+
+static MemPool bench_pool;
+static size_t alloc_sizes[POOL_ALLOCS];
+
+static void
+pool_prepare() {
+  mempool_init(&bench_pool);
+  /* mostly node-sized allocations with the occasional vector backing store */
+  for (size_t i = 0; i < POOL_ALLOCS; i++) {
+    uint64_t r = rng_next() % 100;
+    alloc_sizes[i] = r < 90 ? 16 + (r % 6) * 8 : 256 + (r % 4) * 512;
+  }
+}
+
+static void
+pool_run() {
+  for (size_t i = 0; i < POOL_ALLOCS; i++) {
+    sink = (uintptr_t)mempool_alloc(&bench_pool, alloc_sizes[i]);
+  }
+}
+
+static void
+pool_cleanup() {
+  mempool_deinit(&bench_pool);
+}
+
+/* vector_push, vector_insert, vector_remove */
+
+#define VEC_PUSHES 1000000
+#define VEC_EDITS 2000
+#define VEC_EDIT_BASE 1000
+
+static Vector bench_vec;
+
+static void
+vec_prepare() {
+  mempool_init(&bench_pool);
+  vector_init(&bench_vec, sizeof(uint64_t), &bench_pool);
+}
+
+static void
+vec_push_run() {
+  for (uint64_t i = 0; i < VEC_PUSHES; i++) {
+    vector_push(&bench_vec, &i);
+  }
+  sink = bench_vec.items;
+}
+
+static void
+vec_edit_prepare() {
+  vec_prepare();
+  for (uint64_t i = 0; i < VEC_EDIT_BASE; i++) {
+    vector_push(&bench_vec, &i);
+  }
+}
+
+/* roughly the size of a basic block, edited at random positions */
+static void
+vec_insert_run() {
+  for (uint64_t i = 0; i < VEC_EDITS; i++) {
+    vector_insert(&bench_vec, rng_next() % (bench_vec.items + 1), &i);
+  }
+  sink = bench_vec.items;
+}
+
+static void
+vec_remove_run() {
+  for (size_t i = 0; i < VEC_EDIT_BASE / 2; i++) {
+    vector_remove(&bench_vec, rng_next() % bench_vec.items);
+  }
+  sink = bench_vec.items;
+}
+
+/* scope_insert, scope_find */
+
+#define GLOBAL_NAMES 2000
+#define LOCAL_NAMES 24
+#define LOCAL_SCOPES 2000
+#define NAME_BUF_SZ (1 << 20)
+
+static const char *name_prefixes[] = {
+    "get", "set", "is", "make", "parse", "emit", "count", "next", "tmp", "len",
+};
+static const char *name_stems[] = {
+    "value", "index", "node", "token", "size", "offset", "result", "left",
+    "right", "buf",   "item", "reg",   "block", "scope", "type",   "pos",
+};
+/* single letter names are very common for locals, but not globals */
+static const char *short_names[] = {"i", "j", "k", "n", "x", "y", "a", "b"};
+
+static uint8_t name_buf[NAME_BUF_SZ];
+static size_t name_buf_used;
+static SourcePosition global_names[GLOBAL_NAMES];
+static SourcePosition local_names[LOCAL_SCOPES][LOCAL_NAMES];
+static Scope *global_scope;
+static Scope *local_scopes[LOCAL_SCOPES];
+
+static SourcePosition
+gen_name(bool global) {
+  char temp[64];
+  int len;
+  uint64_t r = rng_next();
+  if (!global && r % 4 == 0) {
+    len = snprintf(temp, sizeof(temp), "%s",
+                   short_names[(r >> 8) % (sizeof(short_names) /
+                                           sizeof(short_names[0]))]);
+  } else {
+    len = snprintf(
+        temp, sizeof(temp), "%s_%s%u",
+        name_prefixes[(r >> 8) %
+                      (sizeof(name_prefixes) / sizeof(name_prefixes[0]))],
+        name_stems[(r >> 16) % (sizeof(name_stems) / sizeof(name_stems[0]))],
+        (unsigned)((r >> 24) % 64));
+  }
+  uint8_t *start = name_buf + name_buf_used;
+  memcpy(start, temp, len);
+  name_buf_used += len;
+  return make_pos(start, len, 1);
+}
+
+static void
+gen_names() {
+  if (name_buf_used != 0) {
+    return;
+  }
+  for (size_t i = 0; i < GLOBAL_NAMES; i++) {
+    global_names[i] = gen_name(true);
+  }
+  for (size_t i = 0; i < LOCAL_SCOPES; i++) {
+    for (size_t j = 0; j < LOCAL_NAMES; j++) {
+      local_names[i][j] = gen_name(false);
+    }
+  }
+}
+
+static void
+scope_insert_prepare() {
+  gen_names();
+  mempool_init(&bench_pool);
+}
+
+static void
+scope_insert_run() {
+  global_scope = scope_init(&bench_pool, NULL);
+  for (size_t i = 0; i < GLOBAL_NAMES; i++) {
+    sink = (uintptr_t)scope_insert(&bench_pool, global_scope, global_names[i],
+                                   make_var_info(0, NULL));
+  }
+  for (size_t i = 0; i < LOCAL_SCOPES; i++) {
+    local_scopes[i] = scope_init(&bench_pool, global_scope);
+    for (size_t j = 0; j < LOCAL_NAMES; j++) {
+      sink = (uintptr_t)scope_insert(&bench_pool, local_scopes[i],
+                                     local_names[i][j], make_var_info(0, NULL));
+    }
+  }
+}
+
+#define SCOPE_LOOKUPS 1000000
+
+static SourcePosition lookups[SCOPE_LOOKUPS];
+static size_t lookup_scopes[SCOPE_LOOKUPS];
+
+static void
+scope_find_prepare() {
+  scope_insert_prepare();
+  scope_insert_run();
+  /* most references are to locals, the rest go up to the global scope (calls)
+   * or miss entirely */
+  for (size_t i = 0; i < SCOPE_LOOKUPS; i++) {
+    uint64_t r = rng_next();
+    size_t scope = (r >> 8) % LOCAL_SCOPES;
+    lookup_scopes[i] = scope;
+    if (r % 100 < 75) {
+      lookups[i] = local_names[scope][(r >> 24) % LOCAL_NAMES];
+    } else if (r % 100 < 97) {
+      lookups[i] = global_names[(r >> 24) % GLOBAL_NAMES];
+    } else {
+      lookups[i] = make_pos((const uint8_t *)"zz_missing", 10, 1);
+    }
+  }
+}
+
+static void
+scope_find_run() {
+  for (size_t i = 0; i < SCOPE_LOOKUPS; i++) {
+    sink = (uintptr_t)scope_find(local_scopes[lookup_scopes[i]], lookups[i]);
+  }
+}
+
+/* lexer_next */
+
+#define LEX_FUNCTIONS 20000
+
+static BoncContext lex_ctx;
+static uint8_t *lex_src;
+static size_t lex_src_sz;
+static size_t lex_tokens;
+
+static void
+gen_source() {
+  if (lex_src != NULL) {
+    return;
+  }
+  size_t alloc = LEX_FUNCTIONS * 256;
+  lex_src = malloc(alloc);
+  for (size_t i = 0; i < LEX_FUNCTIONS; i++) {
+    int len = snprintf(
+        (char *)lex_src + lex_src_sz, alloc - lex_src_sz,
+        "fn_%zu(count i32, offset i32) i32 {\n"
+        "  let value = count * 12i32 + offset\n"
+        "  mut result: i32 = value / (offset - 3i32)\n"
+        "  fn_%zu(result, value)\n"
+        "  return result + count\n"
+        "}\n",
+        i, i / 2);
+    lex_src_sz += len;
+  }
+  /* count once up front, so the timed loop reports per token costs */
+  bonc_context_init(&lex_ctx, lex_src, lex_src_sz, "bench", stderr);
+  while (lexer_next(&lex_ctx.lex).t != TOK_EOF) {
+    lex_tokens++;
+  }
+}
+
+static void
+lex_prepare() {
+  gen_source();
+  lexer_init(&lex_ctx.lex, &lex_ctx, lex_src, lex_src_sz);
+}
+
+static void
+lex_run() {
+  Token tok;
+  while ((tok = lexer_next(&lex_ctx.lex)).t != TOK_EOF) {
+    sink = tok.t;
+  }
+}
+
+static void
+no_cleanup() {
+}
+
+static void
+run_bench(Bench *bench, size_t warmup, size_t reps) {
+  double *samples = malloc(sizeof(double) * reps);
+
+  for (size_t i = 0; i < warmup + reps; i++) {
+    bench->prepare();
+    double start = now_ns();
+    bench->run();
+    double end = now_ns();
+    bench->cleanup();
+    if (i >= warmup) {
+      samples[i - warmup] = (end - start) / (double)bench->ops;
+    }
+  }
+
+  double med = median(samples, reps);
+  for (size_t i = 0; i < reps; i++) {
+    samples[i] = samples[i] > med ? samples[i] - med : med - samples[i];
+  }
+  double mad = median(samples, reps);
+
+  printf("%-16s %12zu %12.2f %10.2f %7.2f%%\n", bench->name, bench->ops, med,
+         mad, med == 0 ? 0.0 : mad / med * 100);
+  free(samples);
+}
+
+struct Option help = {
+    .flag = "h",
+    .description = "prints the help message",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = false,
+};
+struct Option warmup_flag = {
+    .flag = "warmup",
+    .description = "number of untimed repetitions (default 3)",
+    .argument_name = "count",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_INT,
+    .long_flag = true,
+};
+struct Option reps_flag = {
+    .flag = "reps",
+    .description = "number of timed repetitions (default 15)",
+    .argument_name = "count",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_INT,
+    .long_flag = true,
+};
+
+int
+main(int argc, char *argv[]) {
+  struct Option *opts[] = {&help, &warmup_flag, &reps_flag, NULL};
+  char *filters[argc];
+  size_t filter_count;
+
+  parse_args(argc, argv, opts, filters, &filter_count);
+  if (filter_count > 1) {
+    log_err_final("can't specify more than one filter");
+  }
+  char *filter = filter_count == 1 ? filters[0] : NULL;
+
+  if (help.enabled) {
+    printf("%s: microbenchmarks for the core compiler data structures\n",
+           argv[0]);
+    printf("Usage: %s [OPTION]... [FILTER]\n", argv[0]);
+    print_flags(opts);
+    exit(EXIT_SUCCESS);
+  }
+
+  size_t warmup = warmup_flag.enabled ? (size_t)warmup_flag.out.integer : 3;
+  size_t reps = reps_flag.enabled ? (size_t)reps_flag.out.integer : 15;
+  if (reps == 0) {
+    log_err_final("at least one timed repetition is needed");
+  }
+
+  gen_source();
+
+  Bench benches[] = {
+      {"mempool_alloc", POOL_ALLOCS, pool_prepare, pool_run, pool_cleanup},
+      {"vector_push", VEC_PUSHES, vec_prepare, vec_push_run, pool_cleanup},
+      {"vector_insert", VEC_EDITS, vec_edit_prepare, vec_insert_run,
+       pool_cleanup},
+      {"vector_remove", VEC_EDIT_BASE / 2, vec_edit_prepare, vec_remove_run,
+       pool_cleanup},
+      {"scope_insert", GLOBAL_NAMES + LOCAL_SCOPES * LOCAL_NAMES,
+       scope_insert_prepare, scope_insert_run, pool_cleanup},
+      {"scope_find", SCOPE_LOOKUPS, scope_find_prepare, scope_find_run,
+       pool_cleanup},
+      {"lexer_next", lex_tokens, lex_prepare, lex_run, no_cleanup},
+  };
+
+  printf("%zu warmup, %zu timed repetitions, lexer input %zu bytes\n", warmup,
+         reps, lex_src_sz);
+  printf("%-16s %12s %12s %10s %8s\n", "benchmark", "ops", "median ns/op",
+         "mad ns/op", "mad");
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    if (filter != NULL && strstr(benches[i].name, filter) == NULL) {
+      continue;
+    }
+    run_bench(&benches[i], warmup, reps);
+  }
+
+  bonc_context_deinit(&lex_ctx);
+  free(lex_src);
+  return EXIT_SUCCESS;
+}
@@ -28,8 +28,10 @@ struct Option {
   } out;
 };
 
+/* input_files must have room for argc entries, the positional arguments are
+ * stored in order */
 void parse_args(int argc, char *argv[], struct Option *opts[],
-                char **input_file);
+                char **input_files, size_t *input_count);
 void print_flags(struct Option *opts[]);
 
 #endif
@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "context.h"
+#include "emit.h"
 #include "helper.h"
 #include "lexer.h"
 #include "symtable.h"
@@ -74,6 +76,9 @@ typedef struct {
       int mut;
       ScopeEntry *var;
       Type *type;
+      /* the type was inferred from the value rather than written, so that it
+       * is inferred again when the AST is analysed more than once */
+      int inferred;
       Expr *value; /* null if variable is not initialized on declaration */
     } let;
 
@@ -104,13 +109,14 @@ typedef struct {
 } Function;
 
 typedef struct {
-  const uint8_t *src_base;
+  BoncContext *ctx; /* the source and diagnostics this AST belongs to */
   MemPool pool; /* used to allocate structures that belong to this AST */
   Vector fns;   /* Function */
   Scope *global;
 } AST;
 
 void ast_deinit(AST *ast);
-void ast_init(AST *ast, const uint8_t *src_base);
-void ast_dump(FILE *file, AST *ast);
+void ast_init(AST *ast, BoncContext *ctx);
+void ast_dump(Emitter *em, AST *ast);
+void ast_fn_dump(Emitter *em, Function *fn);
 #endif
@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driver.h"
+#include "sha256.h"
+
+#define CACHE_KEY_SZ SHA256_SZ
+
+/* output of an earlier compilation, mapped straight from the cache */
+typedef struct {
+  uint8_t *map;
+  size_t map_sz;
+  const char *output;
+  size_t output_sz;
+} CachedOutput;
+
+/* what an entry holds, so that keys for different kinds never collide */
+typedef enum {
+  CACHE_FILE,     /* the output of a whole file */
+  CACHE_PACK,     /* the output of every function of a file, by file name */
+  CACHE_FUNCTION, /* only used to find a function within a pack */
+} CacheKind;
+
+/* starts a key with everything besides the source that changes any output:
+ * the compiler version, the kind of entry, the dump flags, whether the input
+ * is IR, the platform and the pipeline of passes */
+void cache_key_begin(Sha256 *sha, CacheKind kind, CompileOptions *opts);
+
+/* the key of a whole file, which adds its source to cache_key_begin */
+void cache_key(uint8_t key[CACHE_KEY_SZ], const uint8_t *src, size_t sz,
+               CompileOptions *opts);
+
+/* the paths of entries are at most this long, terminator included, which
+ * leaves room for a cache directory path of up to CACHE_DIR_MAX bytes */
+#define CACHE_PATH_SZ 4096
+#define CACHE_DIR_MAX (CACHE_PATH_SZ - 2 * CACHE_KEY_SZ - 3)
+
+/* returns false on a miss */
+bool cache_load(const char *dir, const uint8_t key[CACHE_KEY_SZ],
+                CachedOutput *out);
+void cache_release(CachedOutput *out);
+
+/* only successful compilations should be stored, since diagnostics mention
+ * the filename, which isn't part of the key. Failing to store an entry only
+ * means a later miss, so it's not reported */
+void cache_store(const char *dir, const uint8_t key[CACHE_KEY_SZ],
+                 const char *output, size_t output_sz);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdbool.h>
+
+#include "emit.h"
+#include "helper.h"
+#include "ssa.h"
+
+/* The control flow graph of a function and its dominators, kept in the
+ * blocks themselves (see SSA_BBlock). Everything is computed without
+ * recursion and in time close to linear in the blocks and edges, so that
+ * functions with hundreds of thousands of blocks are fine. What is computed
+ * goes out of date once the blocks or their terminators change, and has to be
+ * computed again, the old arrays are left in the pool.
+ *
+ * Temporaries are taken from scratch, and given back before returning */
+
+/* fills in the successors, predecessors and reverse postorder of every block.
+ * Edges are kept once, even if both targets of an INST_CBR are the same */
+void cfg_build(SSA_Fn *fn, MemPool *pool, MemPool *scratch);
+/* fills in the immediate dominators and the dominator tree, needs cfg_build.
+ * Uses the iterative algorithm of Cooper, Harvey and Kennedy over the reverse
+ * postorder */
+void cfg_dominators(SSA_Fn *fn, MemPool *pool, MemPool *scratch);
+/* fills in the dominance frontiers, needs cfg_dominators */
+void cfg_frontiers(SSA_Fn *fn, MemPool *pool, MemPool *scratch);
+
+/* whether a dominates b, in constant time. Blocks dominate themselves, and
+ * unreachable blocks neither dominate nor are dominated */
+bool cfg_dominates(SSA_BBlock *a, SSA_BBlock *b);
+
+/* writes the graph, dominators and frontiers of every block */
+void cfg_dump(Emitter *em, SSA_Fn *fn);
+
+#endif
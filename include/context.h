@@ -0,0 +1,59 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include "helper.h"
+#include "lexer.h"
+
+#define CONTEXT_SPARE_POOLS 4
+
+/* All of the state needed to compile one source buffer. The compiler keeps no
+ * global state, so any number of contexts can be live at once (e.g. one per
+ * thread), and a process can compile as many buffers as it likes. */
+typedef struct BoncContext {
+  const uint8_t *src_base;
+  size_t src_sz;
+  const char *filename;
+
+  Lexer lex;
+
+  MemPool pool; /* owns the diagnostics */
+  Vector errs;  /* Diag */
+  /* if set, gives the line a diagnostic at pos is reported at, for sources
+   * whose positions don't count their lines from the start, see document.h */
+  size_t (*diag_line)(void *data, SourcePosition pos);
+  void *diag_line_data;
+  FILE *err_file; /* NULL if diagnostics are only collected */
+  /* where diagnostics jump to once compilation can't go on, must be set
+   * before anything can report a diagnostic */
+  jmp_buf *bailout;
+
+  /* for temporaries that only live through one step of compilation. A step
+   * takes a mempool_mark first and gives everything back with
+   * mempool_release once it's done. Since a context is only used by one
+   * thread at a time, this is that thread's scratch memory, and it stays
+   * warm across steps */
+  MemPool scratch;
+
+  /* pools given back by earlier compilations, kept warm for the next one */
+  MemPool spare_pools[CONTEXT_SPARE_POOLS];
+  size_t nspare_pools;
+} BoncContext;
+
+/* prepares a context to compile src, diagnostics are written to err_file */
+void bonc_context_init(BoncContext *ctx, const uint8_t *src, size_t sz,
+                       const char *filename, FILE *err_file);
+/* prepares a context that has already been used to compile src, keeping the
+ * memory it has warmed up */
+void bonc_context_reuse(BoncContext *ctx, const uint8_t *src, size_t sz,
+                        const char *filename, FILE *err_file);
+void bonc_context_deinit(BoncContext *ctx);
+
+/* initializes pool, reusing one given back to the context if possible */
+void bonc_context_pool_get(BoncContext *ctx, MemPool *pool);
+/* frees everything in pool, and keeps it around for a later pool_get */
+void bonc_context_pool_put(BoncContext *ctx, MemPool *pool);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast.h"
+#include "context.h"
+#include "lexer.h"
+
+/* The text of one top-level function, from its first token up to the next
+ * function's, along with its tokens. The lexer is in the same state at the
+ * start of every chunk, since whether a newline is a token only depends on the
+ * token before it and a function always ends with a '}', so every chunk can be
+ * lexed on its own */
+typedef struct {
+  uint8_t *text;
+  size_t sz;
+  size_t nlines; /* newlines in the text */
+
+  /* ends with TOK_EOF. Lines are counted from the first line of the chunk, so
+   * that the tokens stay valid when the lines before them change */
+  Token *toks;
+  size_t ntoks;
+
+  /* set if the function has errors, and is left empty in the AST */
+  bool broken;
+} DocChunk;
+
+/* A source buffer that is kept parsed as it is edited, for editors and watch
+ * mode. An edit re-lexes and re-parses only the functions it touches and keeps
+ * every other node of the AST. The lines of the positions in a function count
+ * from the start of its chunk, and the context adds the chunk's first line
+ * when it reports a diagnostic, so the functions after an edit are never
+ * touched, even if it adds or removes lines */
+typedef struct {
+  BoncContext *ctx; /* diagnostics are reported to it */
+  AST ast;          /* the function of chunks[i] is ast.fns[i] */
+  /* only the last chunk can be without a function, if the document has no
+   * tokens at all */
+  DocChunk *chunks;
+  size_t nchunks;
+  size_t chunks_alloc;
+  /* the sizes and newlines of the chunks as Fenwick trees, from 1, which give
+   * the offset and first line of a chunk in O(log n). chunks_alloc + 1 of
+   * each */
+  size_t *sz_tree;
+  size_t *lines_tree;
+  size_t sz;
+  size_t nbroken; /* chunks that have errors */
+  /* the chunk being parsed, which isn't one of chunks yet, and its first
+   * line. NULL if there is none */
+  DocChunk *parsing;
+  size_t parsing_line;
+} Document;
+
+/* parses src, which is copied. Returns false if any function has errors,
+ * which are written to the context's error file. The document has to stay
+ * where it is from then on, since the context asks it for the lines of
+ * diagnostics */
+bool document_init(Document *doc, BoncContext *ctx, const uint8_t *src,
+                   size_t sz);
+/* replaces the removed bytes at offset with the inserted ones. Returns false if
+ * any function the edit touched has errors, the rest of the document is still
+ * kept up to date */
+bool document_edit(Document *doc, size_t offset, size_t removed,
+                   const uint8_t *inserted, size_t inserted_sz);
+/* reports the errors of the first function that has any again, since edits
+ * only report them for the functions they touch. Returns false if there was
+ * one */
+bool document_report(Document *doc);
+void document_write(Document *doc, FILE *file);
+void document_deinit(Document *doc);
+
+#endif
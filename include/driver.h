@@ -0,0 +1,122 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "context.h"
+#include "document.h"
+#include "passes.h"
+#include "platforms.h"
+
+#define BONC_VERSION "0.1"
+
+typedef struct {
+  bool dump_ast;
+  bool dump_ir;
+  bool dump_reg;
+  /* the control flow graph and dominators of every function, see cfg.h */
+  bool dump_cfg;
+  Platform *platform;
+  /* directory of the compilation cache, NULL if it isn't used */
+  const char *cache_dir;
+  /* only reanalyse the functions that changed, needs cache_dir */
+  bool incremental;
+  /* lex on a thread of its own while parsing, see token_ring.h */
+  bool lex_thread;
+  /* compile and free one function at a time, see per_function.h */
+  bool per_function;
+  /* if set, the SSA program is also written to it in the format of
+   * ssa_bin.h. Only for compiling a single source */
+  FILE *ssa_bin_out;
+  /* the inputs are SSA IR in the text format of the IR dump rather than Bon,
+   * see ssa_parser.h */
+  bool from_ir;
+  /* run over every program between translating and writing it out */
+  PassPipeline passes;
+  /* the threads the function passes of a single program are spread over */
+  size_t pass_workers;
+} CompileOptions;
+
+typedef enum {
+  PHASE_READ,
+  PHASE_CACHE,
+  PHASE_PARSE,
+  PHASE_NAMES,
+  PHASE_TYPES,
+  PHASE_RETURNS,
+  PHASE_IR,
+  PHASE_OPT,
+  PHASE_DUMP,
+  PHASE_COUNT,
+} CompilePhase;
+
+typedef struct {
+  uint64_t phase_ns[PHASE_COUNT];
+  size_t cache_hits;
+  size_t cache_misses;
+  /* functions reused and recompiled by incremental compilation */
+  size_t fn_cache_hits;
+  size_t fn_cache_misses;
+  PassStats passes[PASS_COUNT];
+} TimeReport;
+
+typedef struct {
+  const char *filename;
+
+  /* filled in by compile_jobs */
+  bool failed;
+  const char *io_error; /* printf format taking the filename, NULL if none */
+  char *output;         /* everything meant for stdout */
+  size_t output_sz;
+  /* set if output points into a mapping of the cache, malloc'd otherwise */
+  uint8_t *output_map;
+  size_t output_map_sz;
+  TimeReport times;
+} CompileJob;
+
+/* runs the whole pipeline over the context's source, writing the requested
+ * dumps to out. Returns false if the source had errors, which have been
+ * written to the context's error file. Never exits the process for errors in
+ * the source. If times isn't NULL, the time spent in each phase is added to
+ * it */
+bool compile_source(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                    TimeReport *times);
+/* compile_source, but over a document that is already parsed, which can be
+ * compiled again after every edit. Fails without going any further if some
+ * function doesn't parse */
+bool compile_document(Document *doc, CompileOptions *opts, FILE *out,
+                      TimeReport *times);
+
+/* compile_source, but for a context whose source is SSA IR in the text
+ * format of the IR dump. Writes out what opts asks of it (except for the AST
+ * dump) to out */
+bool compile_ir(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                TimeReport *times);
+/* loads an SSA program written with ssa_bin_write instead of compiling a
+ * source, and writes out what opts asks of it (except for the AST dump) to
+ * out. Returns false if it couldn't be loaded, which is reported on stderr */
+bool compile_ssa_bin(const char *filename, CompileOptions *opts, FILE *out,
+                     TimeReport *times);
+
+/* compiles every job on up to nworkers threads. Each job is compiled
+ * independently, and its output is kept in the job so that it can be written
+ * out in a deterministic order */
+void compile_jobs(CompileJob *jobs, size_t njobs, CompileOptions *opts,
+                  size_t nworkers);
+/* frees the job's output */
+void compile_job_release(CompileJob *job);
+
+uint64_t time_now_ns();
+/* charges the time since *start to phase and restarts the clock, does nothing
+ * if times is NULL */
+void time_report_phase(TimeReport *times, CompilePhase phase, uint64_t *start);
+void time_report_add(TimeReport *total, TimeReport *report);
+/* adds what the passes of pm cost, does nothing if times is NULL */
+void time_report_passes(TimeReport *times, PassManager *pm);
+void time_report_print(FILE *file, TimeReport *report, uint64_t wall_ns,
+                       bool cache_used);
+
+#endif
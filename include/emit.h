@@ -0,0 +1,68 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "helper.h"
+
+/* bytes buffered before they're handed to the file */
+#define EMIT_CHUNK (1 << 20)
+
+/* Writer for everything the compiler prints as its output, the AST and IR
+ * dumps and anything generated later. Text is built up in one big buffer,
+ * with numbers formatted by hand, and handed to the file in EMIT_CHUNK sized
+ * writes rather than going through printf for every token. Without a file,
+ * the buffer grows to hold the whole output until it is taken */
+typedef struct {
+  FILE *file; /* NULL to keep the output in memory */
+  char *buf;
+  size_t len;
+  size_t alloc;
+} Emitter;
+
+void emitter_init(Emitter *em, FILE *file);
+/* writes out what is buffered, only for emitters with a file */
+void emitter_flush(Emitter *em);
+/* flushes and frees the buffer */
+void emitter_deinit(Emitter *em);
+/* gives the output of an emitter without a file to the caller, who frees it.
+ * The emitter is left empty */
+char *emitter_take(Emitter *em, size_t *sz);
+
+/* makes room for sz more bytes in the buffer */
+void emitter_reserve(Emitter *em, size_t sz);
+
+static inline void
+emit_mem(Emitter *em, const void *data, size_t sz) {
+  if (em->alloc - em->len < sz) {
+    emitter_reserve(em, sz);
+  }
+  memcpy(em->buf + em->len, data, sz);
+  em->len += sz;
+}
+
+static inline void
+emit_char(Emitter *em, char c) {
+  if (em->len == em->alloc) {
+    emitter_reserve(em, 1);
+  }
+  em->buf[em->len++] = c;
+}
+
+static inline void
+emit_str(Emitter *em, const char *str) {
+  emit_mem(em, str, strlen(str));
+}
+
+static inline void
+emit_pos(Emitter *em, SourcePosition pos) {
+  emit_mem(em, pos.start, pos.sz);
+}
+
+void emit_u64(Emitter *em, uint64_t num);
+void emit_i64(Emitter *em, int64_t num);
+
+#endif
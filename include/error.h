@@ -5,12 +5,16 @@
 #include <stdbool.h>
 #include <diags.h>
 
-bool errors_exist();
-void errors_init(MemPool *pool, const uint8_t *base, const char *filename);
+#include "context.h"
 
-/* returns if no errors, otherwise prints them to file and exits with a
- * non-zero error code */
-void errors_output(FILE *file);
-void errors_log(Diag diag);
+bool errors_exist(BoncContext *ctx);
+void errors_init(BoncContext *ctx);
+
+/* returns if no errors, otherwise prints them to the context's error file and
+ * jumps to its bailout */
+void errors_output(BoncContext *ctx);
+void errors_log(BoncContext *ctx, Diag diag);
+/* forgets every diagnostic reported so far */
+void errors_clear(BoncContext *ctx);
 
 #endif
@@ -13,8 +13,6 @@ typedef struct {
 SourcePosition combine_pos(SourcePosition pos1, SourcePosition pos2);
 SourcePosition make_pos(const uint8_t *buf, size_t sz, size_t line);
 
-int64_t next_vn();
-
 void log_err(const char *fmt, ...);
 
 /* exits after printing message */
@@ -26,17 +24,36 @@ void log_err_final(const char *fmt, ...);
 void actual_log_internal_err(const char *fmt, const char *file, size_t line,
                              ...);
 
+/* prints the message along with the source line, callers decide whether to
+ * stop */
 void log_source_err(const char *fmt, const uint8_t *base, SourcePosition, ...);
 
 typedef struct {
   uint8_t *base;
   size_t alloc;
   size_t size;
+  /* everything from here on has never been handed out since it was last
+   * zeroed, so it doesn't have to be zeroed again */
+  size_t dirty;
 } MemPool;
 
 void mempool_init(MemPool *pool);
 void *mempool_alloc(MemPool *pool, size_t amount);
 void mempool_deinit(MemPool *pool);
+/* frees everything allocated in the pool at once, but keeps (up to a limit)
+ * the memory it has already touched so that reusing the pool is cheap. Like
+ * fresh pool memory, the memory handed out afterwards is zeroed, which is
+ * done as it is handed out */
+void mempool_reset(MemPool *pool);
+
+/* a point in a pool's allocations that it can be released back to */
+typedef size_t MemPoolMark;
+
+MemPoolMark mempool_mark(MemPool *pool);
+/* frees everything allocated since mark at once, in constant time, and
+ * anything allocated before it is kept. The memory stays committed, and is
+ * zeroed when it's handed out again like after mempool_reset */
+void mempool_release(MemPool *pool, MemPoolMark mark);
 
 typedef struct {
   MemPool *pool;
@@ -0,0 +1,20 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "context.h"
+#include "driver.h"
+
+/* compile_source, but reusing the output of every function that hasn't
+ * changed since it was last compiled successfully, from opts->cache_dir.
+ *
+ * The whole file is still lexed to split it into functions and to parse their
+ * signatures, but only the bodies of the functions whose own text, or the
+ * signatures of the functions they call, changed are parsed, analysed and
+ * translated. The output is the same as compile_source's */
+bool compile_incremental(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                         TimeReport *times);
+
+#endif
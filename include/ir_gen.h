@@ -3,7 +3,17 @@
 
 #include "ast.h"
 #include "ssa.h"
+#include "ssa_builder.h"
 
 void translate_ast(AST *ast, SSA_Prog *prog);
+/* sets up prog with an SSA_Fn for every function of ast, named after it and
+ * set in its scope entry for the calls to it, without translating any of
+ * them */
+void declare_ssa_fns(AST *ast, SSA_Prog *prog);
+/* every function called by fn must already have its SSA_Fn set in its scope
+ * entry, though it doesn't need to have been translated yet. Variables are
+ * put in SSA form with an SSABuilder, whose bookkeeping goes in scratch */
+void translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool,
+                        MemPool *scratch);
 
 #endif
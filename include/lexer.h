@@ -80,9 +80,48 @@ typedef struct {
   SourcePosition pos;
 } Token;
 
-void lexer_init(const uint8_t *buf, size_t sz);
+struct BoncContext;
+struct InputStream;
+struct TokenRing;
 
-Token lexer_next();
-Token lexer_peek();
+typedef struct {
+  struct BoncContext *ctx; /* diagnostics are reported here */
+  const uint8_t *buf;
+  size_t sz;
+  size_t line;
+
+  size_t end;
+  size_t start;
+
+  int prev;
+  Token peek;
+  int peekf; /* 0 if no token available to peek */
+
+  /* set if more of buf can still arrive, which is waited for once the lexer
+   * gets to the end of what has been read */
+  struct InputStream *stream;
+
+  /* set if the tokens come from a lexer thread, see token_ring.h */
+  struct TokenRing *ring;
+
+  /* set if the tokens are replayed instead of lexed */
+  const Token *toks;
+  size_t ntoks;
+  size_t tok_idx;
+  size_t line_base; /* added to the line of every replayed token */
+} Lexer;
+
+void lexer_init(Lexer *lex, struct BoncContext *ctx, const uint8_t *buf,
+                size_t sz);
+/* lexes the input as it is read from stream */
+void lexer_init_stream(Lexer *lex, struct BoncContext *ctx,
+                       struct InputStream *stream);
+/* hands out toks, which have already been lexed, instead of lexing. The last
+ * token must be TOK_EOF, which is then repeated */
+void lexer_init_tokens(Lexer *lex, struct BoncContext *ctx, const Token *toks,
+                       size_t ntoks, size_t line_base);
+
+Token lexer_next(Lexer *lex);
+Token lexer_peek(Lexer *lex);
 
 #endif
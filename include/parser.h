@@ -1,9 +1,32 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stdbool.h>
+
 #include "ast.h"
 
-/* lexer must be initialized previous to calling this function */
-AST parse_ast();
+/* lexer and ast must be initialized previous to calling this function */
+void parse_ast(AST *ast);
+
+/* parses a function's name, parameters and return type, leaving the lexer at
+ * the start of its body */
+void parse_fn_header(AST *ast, Function *function);
+void parse_fn(AST *ast, Function *function);
+void parse_block(Block *block, AST *ast);
+
+/* where a function's text is, for compiling its body later on its own */
+typedef struct {
+  const uint8_t *start; /* the function's name */
+  size_t sig_sz;        /* bytes from the name up to the body */
+  size_t total_sz;      /* bytes from the name up to the closing '}' */
+  Lexer body;           /* the lexer as it was at the start of the body */
+  Vector names;         /* SourcePosition, every name used in the body */
+} FnExtent;
+
+/* parses the signature of every function in the file into ast->fns, and
+ * skips over their bodies without building any of them, adding an FnExtent
+ * for each to extents. The names of the bodies are only collected, in pool,
+ * if names is set */
+void parse_fn_headers(AST *ast, Vector *extents, MemPool *pool, bool names);
 
 #endif
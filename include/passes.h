@@ -0,0 +1,139 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "helper.h"
+#include "ssa.h"
+
+/* The optimizer is a pipeline of passes over an SSA_Prog, run between
+ * translating it and writing it out. Every pass is registered in pass_tbl
+ * under its PassId, and a pipeline is a list of them: either the one of an
+ * optimization level or one given by name with --passes.
+ *
+ * A function pass only reads and changes the function it is given, so passes
+ * over different functions can run at the same time, on the workers of the
+ * pass manager. A module pass gets the whole program, and runs on its own
+ * once the function passes before it are done with every function */
+
+typedef enum {
+  PASS_VERIFY,
+  PASS_COMPACT_REGS,
+  PASS_SCCP,
+  PASS_GVN,
+  PASS_COPY_PROP,
+  PASS_DCE,
+  PASS_INSTCOMBINE,
+  PASS_COUNT, /* the number of passes, not a pass */
+} PassId;
+
+/* the memory a pass works with. What it adds to the program has to come from
+ * pool, which belongs to the worker running it. scratch is given back after
+ * every pass */
+typedef struct {
+  MemPool *pool;
+  MemPool *scratch;
+} PassContext;
+
+typedef struct {
+  const char *name;
+  const char *description;
+  /* run_fn for a function pass and run_prog for a module pass. A module pass
+   * can have run_fn as well, for what it can do with a single function when
+   * the rest of the program isn't there */
+  void (*run_fn)(SSA_Fn *fn, PassContext *pc);
+  void (*run_prog)(SSA_Prog *prog, PassContext *pc);
+} Pass;
+
+extern const Pass pass_tbl[];
+
+#define PASS_PIPELINE_MAX 64
+
+typedef struct {
+  uint8_t passes[PASS_PIPELINE_MAX]; /* PassId, in the order they run */
+  size_t npasses;
+} PassPipeline;
+
+/* the pipeline of -O0, -O1, -O2 or -Os by what comes after the O. Returns
+ * false if there is no such level */
+bool pass_pipeline_level(PassPipeline *pl, const char *level);
+/* a pipeline from a comma separated list of pass names. Returns NULL, or
+ * what is wrong with the list as a printf format taking the list */
+const char *pass_pipeline_parse(PassPipeline *pl, const char *list);
+
+/* what running a pass cost, summed over every function it ran on */
+typedef struct {
+  size_t runs;
+  uint64_t ns;
+  size_t added;   /* instructions */
+  size_t removed;
+} PassStats;
+
+typedef struct {
+  const PassPipeline *pipeline;
+  size_t nworkers;
+  /* a pool and a scratch pool for every worker, made by pass_manager_run */
+  MemPool *pools;
+  MemPool *scratch;
+  size_t npools;
+  PassStats stats[PASS_COUNT];
+} PassManager;
+
+/* function passes are spread over up to nworkers threads */
+void pass_manager_init(PassManager *pm, const PassPipeline *pipeline,
+                       size_t nworkers);
+/* runs the pipeline over prog. Functions passes that follow each other are
+ * all run on a function before the worker moves on to the next one */
+void pass_manager_run(PassManager *pm, SSA_Prog *prog);
+/* runs the pipeline over a single function on the calling thread, for when
+ * the rest of the program isn't there. What the passes add comes from pool.
+ * Module passes only run their run_fn, and are left out if they have none */
+void pass_manager_run_fn(PassManager *pm, SSA_Fn *fn, MemPool *pool);
+/* frees the memory the passes added to the program, so it can only be called
+ * once the program is no longer used */
+void pass_manager_deinit(PassManager *pm);
+
+/* checks that a function is well formed: that its instructions and blocks
+ * are in range, that every register is set once, before each of its reads on
+ * every path to it, that phis have an argument for each predecessor and that
+ * sizes match. Returns NULL, or what is wrong with it. Leaves the CFG out of
+ * date */
+const char *ssa_fn_verify(SSA_Fn *fn, MemPool *scratch);
+/* checks every function of a program that was loaded instead of translated,
+ * since the passes count on it being well formed, and that every call passes
+ * an argument of the right size for each parameter of its callee. Returns
+ * false after reporting what is wrong as an error in filename */
+bool ssa_prog_verify(SSA_Prog *prog, MemPool *scratch, const char *filename);
+/* reports an internal error if the program isn't well formed, as
+ * ssa_prog_verify checks it. Meant to be run after passes that are being
+ * worked on */
+void pass_verify(SSA_Prog *prog, PassContext *pc);
+/* pass_verify without the calls, for a single function */
+void pass_verify_fn(SSA_Fn *fn, PassContext *pc);
+void pass_compact_regs(SSA_Fn *fn, PassContext *pc);
+/* folds the instructions whose operands are constants, along with the phis
+ * and copies of them, turns branches on constants into jumps, and removes the
+ * blocks that can't be reached then. Builds the use chains if the function
+ * hasn't got them, and leaves the CFG out of date */
+void pass_sccp(SSA_Fn *fn, PassContext *pc);
+/* removes the instructions that compute a value already computed by one that
+ * dominates them, with the operands of commutative ones in either order.
+ * Builds the use chains if the function hasn't got them */
+void pass_gvn(SSA_Fn *fn, PassContext *pc);
+/* makes the users of every copy read what it copies instead, and removes
+ * it. Builds the use chains if the function hasn't got them */
+void pass_copy_prop(SSA_Fn *fn, PassContext *pc);
+/* removes the instructions whose results are never needed by a ret, a call
+ * or a branch, even through other instructions, and what follows a ret in
+ * its block. Builds the use chains if the function hasn't got them */
+void pass_dce(SSA_Fn *fn, PassContext *pc);
+/* simplifies instructions by what sets their operands: x + 0, x * 1, x * 0,
+ * x - x, x / 1 and the like, chains of adds or multiplications by constants,
+ * and multiplications and divisions by constants, which are done with shifts
+ * and multiplications instead. Leaves what it no longer uses to dce. Builds
+ * the use chains if the function hasn't got them */
+void pass_instcombine(SSA_Fn *fn, PassContext *pc);
+
+#endif
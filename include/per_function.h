@@ -0,0 +1,21 @@
+#ifndef PER_FUNCTION_H
+#define PER_FUNCTION_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "context.h"
+#include "driver.h"
+
+/* compile_source, but taking each function through the whole pipeline on its
+ * own and freeing it before the next one, so that memory use depends on the
+ * largest function rather than the whole file.
+ *
+ * A first pass only parses the signatures, so that every function can still
+ * call the ones after it. The output is the same as compile_source's, except
+ * that errors are looked for a function at a time, so when a file has several
+ * the one reported can be a different one */
+bool compile_per_function(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                          TimeReport *times);
+
+#endif
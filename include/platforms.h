@@ -37,6 +37,9 @@ typedef struct Platform {
 /* Null terminated array of available platforms */
 extern Platform *platforms[];
 
+/* Null if there is no platform with that name */
+Platform *platform_find(const char *name);
+
 extern Platform platform_x86_64_sysv;
 extern Platform platform_riscv_64;
 
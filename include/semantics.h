@@ -8,4 +8,13 @@ void resolve_names(AST *ast);
 void resolve_types(AST *ast);
 void check_returns(AST *ast);
 
+/* the same passes, split so that they can be run over only some of the
+ * functions. declare_fns and then declare_fn_types must have been run over the
+ * whole AST first, since every function can see the others' signatures */
+void declare_fns(AST *ast);
+void declare_fn_types(AST *ast);
+void resolve_fn_names(AST *ast, Function *fn);
+void resolve_fn_types(AST *ast, Function *fn);
+void check_fn_returns(AST *ast, Function *fn);
+
 #endif
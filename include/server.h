@@ -0,0 +1,13 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+
+/* Listens on a Unix domain socket at socket_path and compiles the requests
+ * sent to it (see internals/server.md for the protocol) on nworkers threads,
+ * until the process is interrupted. Every worker keeps its compiler context
+ * and pools warm between requests, and the results for files that haven't
+ * changed are reused. Only returns if the server can't be started. */
+void server_run(const char *socket_path, size_t nworkers);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SZ 32
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t total; /* bytes hashed so far */
+  uint8_t block[64];
+  size_t block_sz;
+} Sha256;
+
+void sha256_init(Sha256 *sha);
+void sha256_update(Sha256 *sha, const void *data, size_t sz);
+void sha256_final(Sha256 *sha, uint8_t out[SHA256_SZ]);
+
+#endif
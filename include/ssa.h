@@ -1,12 +1,15 @@
 #ifndef SSA_H
 #define SSA_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
+#include "emit.h"
 #include "helper.h"
 
-typedef uint64_t RegId;
+/* registers are numbered from 1 in each function, 0 stands for none */
+typedef uint32_t RegId;
 
 typedef enum {
   SZ_NONE,
@@ -27,34 +30,104 @@ typedef enum {
   INST_RET,
   INST_IMM,
   INST_CALLFN,
+  INST_BR,  /* jumps to its first target */
+  INST_CBR, /* jumps to its first target if its operand isn't 0, and to its
+             * second otherwise */
+  INST_PHI, /* the argument of the predecessor that was come from, phis are
+             * at the start of their block */
+  /* shifts by their second operand, which has to be less than the size in
+   * bits. Kinds are only ever added at the end, as binary SSA has them */
+  INST_SHL,
+  INST_LSHR, /* fills in 0s */
+  INST_ASHR, /* fills in the sign */
+  /* the upper half of the product twice the size */
+  INST_UMULHI,
+  INST_IMULHI,
+  INST_COUNT, /* the number of kinds, not an instruction */
 } InstKind;
 
 /* Store the number of *register* arguments an instruction takes */
 extern const uint8_t inst_arity_tbl[];
 extern const uint8_t inst_returns_tbl[];
+/* the number of blocks an instruction can jump to */
+extern const uint8_t inst_targets_tbl[];
 extern const char *inst_name_tbl[];
+/* the sizes as they're written in the IR, by SizeKind */
+extern const char *sz_name_tbl[];
 
 typedef struct SSA_Fn SSA_Fn;
 
 typedef struct {
-  InstKind t;
-  SizeKind sz;
+  struct BBlock *block; /* a predecessor of the phi's block */
+  RegId reg;
+} SSA_PhiArg;
+
+/* a call's callee, and where its arguments are in the function's args */
+typedef struct {
+  struct SSA_Fn *fn;
+  uint32_t args;
+  uint32_t nargs;
+} SSA_Call;
+
+/* the kind, size, result and operands take 16 bytes whatever the kind. With
+ * the links of its block's list and its place in the use chains a node is 40
+ * bytes on 64-bit targets. What doesn't fit is kept in side tables of the
+ * function, which the instruction indexes, and is reached with the inst_*
+ * functions below */
+typedef struct SSA_Inst {
+  uint8_t t;  /* InstKind */
+  uint8_t sz; /* SizeKind */
   RegId result;
 
   union {
     RegId operands[2];
+    uint32_t imm;  /* in the function's imms */
+    uint32_t call; /* in calls */
+    struct {
+      uint32_t args; /* the first in phi_args */
+      uint32_t nargs;
+    } phi;
     struct {
-      struct SSA_Fn *fn;
-      Vector args; /* RegId */
-    } callfn;
-    uint64_t imm;
+      RegId cond;       /* operands[0] of INST_CBR */
+      uint32_t targets; /* the first in targets */
+    } br;
   } data;
+
+  struct SSA_Inst *prev;
+  struct SSA_Inst *next;
+  /* while the function has use chains, the first of the entries of its
+   * operands in the function's use_pos */
+  uint32_t uses;
 } SSA_Inst;
 
+/* A block ends in INST_BR, INST_CBR or INST_RET. A block without one of them
+ * at the end goes on to the next block, and the last one returns */
 typedef struct BBlock {
-  Vector insts; /* Inst */
+  /* the instructions are a list of their own, so that they stay where they
+   * are while others are added and removed around them */
+  SSA_Inst *first;
+  SSA_Inst *last;
+  size_t ninsts;
   /* Null if last block in function */
   struct BBlock *next;
+  size_t id; /* position in the function, set by ssa_number_blocks */
+
+  /* the rest is only valid after the CFG has been built, see cfg.h */
+  struct BBlock *succs[2];
+  uint8_t nsuccs;
+  struct BBlock **preds;
+  size_t npreds;
+  size_t rpo; /* index in the function's rpo, SIZE_MAX if unreachable */
+
+  struct BBlock *idom; /* NULL for the entry and unreachable blocks */
+  struct BBlock **dom_children;
+  size_t ndom_children;
+  /* preorder and postorder of the block in the dominator tree */
+  size_t dom_pre;
+  size_t dom_post;
+
+  struct BBlock **frontier;
+  size_t nfrontier;
 } SSA_BBlock;
 
 typedef struct {
@@ -62,11 +135,53 @@ typedef struct {
   /* more stuff */
 } SSA_Reg;
 
+/* an operand of an instruction, see inst_operand for what slot means */
+typedef struct {
+  SSA_BBlock *block;
+  SSA_Inst *inst;
+  size_t slot;
+} SSA_Use;
+
+/* where a register is set and every place it is read */
+typedef struct {
+  /* NULL for parameters and registers never set */
+  SSA_BBlock *def_block;
+  SSA_Inst *def;
+  SSA_Use *uses;
+  uint32_t nuses;
+  uint32_t uses_alloc;
+} SSA_DefUse;
+
 struct SSA_Fn {
   SSA_BBlock *entry;
+  /* the reachable blocks in reverse postorder, set by cfg_build */
+  SSA_BBlock **rpo;
+  size_t nrpo;
   Vector params; /* RegId */
   Vector regs;   /* SSA_Reg */
   SourcePosition name;
+  MemPool *pool; /* of the instructions and blocks */
+  /* instructions ever added to or removed from the blocks, for the
+   * statistics of the passes */
+  size_t ninserted;
+  size_t nremoved;
+
+  /* the side tables of the instructions. Changing an instruction leaves what
+   * it used to point to behind */
+  Vector imms;     /* uint64_t */
+  Vector calls;    /* SSA_Call */
+  Vector args;     /* RegId, of the calls */
+  Vector phi_args; /* SSA_PhiArg */
+  Vector targets;  /* SSA_BBlock *, of the branches */
+
+  /* SSA_DefUse by register - 1, set up by ssa_fn_build_uses. Until then it is
+   * empty and the instructions can be written to directly, afterwards they
+   * have to be changed through the functions below to keep it up to date */
+  Vector defuse;
+  /* for every operand of the instructions in the chains, where its use is in
+   * the uses of its register, so that it's taken out in constant time */
+  Vector use_pos; /* uint32_t */
+  bool has_uses;
 };
 
 typedef struct {
@@ -74,19 +189,92 @@ typedef struct {
   Vector fns; /* SSA_Function */
 } SSA_Prog;
 
+/* sets up a function without any blocks or registers */
+void ssa_fn_init(SSA_Fn *fn, MemPool *pool);
+/* makes what the function allocates from then on, for new instructions,
+ * registers and the like, come from pool. What it already has stays where it
+ * is */
+void ssa_fn_set_pool(SSA_Fn *fn, MemPool *pool);
 SSA_BBlock *bblock_init(MemPool *pool);
-SSA_Inst *bblock_append(SSA_BBlock *block);
 
-void bblock_insert_inst(SSA_BBlock *block, size_t idx, SSA_Inst *inst);
-void bblock_remove_inst(SSA_BBlock *block, size_t idx);
-/* Replaces all of the operands that contain a specific register in a range of
- * instructions. This *does not* replace any results that contain the register
- */
-void bblock_replace_reg(SSA_BBlock *block, RegId find, RegId replace,
-                        size_t start, size_t end);
+/* The instructions of a block are walked with
+ *
+ *   for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next)
+ *
+ * Adding and removing instructions takes constant time, and so does keeping
+ * the use chains of each of their operands up to date. The other instructions
+ * stay where they are. A walk may remove the instruction it is at, which
+ * keeps its next, and whatever is added after it is walked over too. */
+
+/* adds a copy of inst to the end of block, and returns it */
+SSA_Inst *bblock_append(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst);
+/* adds a copy of inst in front of before, or at the end if before is NULL */
+SSA_Inst *bblock_insert_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *before,
+                             SSA_Inst *inst);
+/* takes inst out of block. Its memory isn't reused */
+void bblock_remove_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst);
+/* Replaces all of the operands that contain a specific register from start up
+ * to end, or the end of the block if end is NULL. This *does not* replace any
+ * results that contain the register */
+void bblock_replace_reg(SSA_Fn *fn, SSA_BBlock *block, RegId find,
+                        RegId replace, SSA_Inst *start, SSA_Inst *end);
+
+/* the number of registers an instruction reads, and where the slot'th of them
+ * is kept: operands[slot], or the slot'th argument of INST_CALLFN and
+ * INST_PHI */
+size_t inst_operand_count(SSA_Fn *fn, SSA_Inst *inst);
+RegId *inst_operand(SSA_Fn *fn, SSA_Inst *inst, size_t slot);
+
+uint64_t inst_imm(SSA_Fn *fn, SSA_Inst *inst);
+SSA_Call *inst_call(SSA_Fn *fn, SSA_Inst *inst);
+RegId *inst_call_args(SSA_Fn *fn, SSA_Inst *inst);
+SSA_PhiArg *inst_phi_args(SSA_Fn *fn, SSA_Inst *inst);
+/* inst_targets_tbl[inst->t] of them */
+SSA_BBlock **inst_targets(SSA_Fn *fn, SSA_Inst *inst);
+/* these add what an instruction of their kind points to to the side tables,
+ * the instruction's kind has to be set first */
+void inst_set_imm(SSA_Fn *fn, SSA_Inst *inst, uint64_t imm);
+void inst_set_call(SSA_Fn *fn, SSA_Inst *inst, SSA_Fn *callee,
+                   const RegId *args, size_t nargs);
+void inst_set_phi(SSA_Fn *fn, SSA_Inst *inst, const SSA_PhiArg *args,
+                  size_t nargs);
+void inst_set_targets(SSA_Fn *fn, SSA_Inst *inst, SSA_BBlock *const *targets);
+
+/* finds the definition and the uses of every register, in pool. From then on
+ * they're kept up to date by the functions that change the function */
+void ssa_fn_build_uses(SSA_Fn *fn, MemPool *pool);
+/* the chains of a register, only while the function has use chains */
+SSA_DefUse *ssa_reg_defuse(SSA_Fn *fn, RegId reg);
+/* the instruction that sets reg, NULL for parameters and registers that are
+ * never set */
+SSA_Inst *ssa_reg_def(SSA_Fn *fn, RegId reg);
+/* makes every instruction that reads find read replace instead, in time
+ * proportional to the uses of find. Needs use chains */
+void ssa_replace_all_uses(SSA_Fn *fn, RegId find, RegId replace);
 
 RegId ssa_new_reg(SSA_Fn *fn, int sz);
+/* numbers the registers again densely, in the order they first appear in the
+ * parameters and instructions, and drops the ones that don't appear at all.
+ * Use chains are rebuilt if the function has them */
+void ssa_fn_compact_regs(SSA_Fn *fn, MemPool *scratch);
+/* sets the id of every block to its position, and returns how many there
+ * are */
+size_t ssa_number_blocks(SSA_Fn *fn);
+/* whether the instruction ends its block */
+int inst_is_terminator(SSA_Inst *inst);
+/* the bits a value of size sz has, none for SZ_NONE */
+uint64_t sz_mask(SizeKind sz);
+/* computes the arithmetic instruction t of size sz over the constants a and
+ * b, wrapping around as the machine does. Returns false if t isn't
+ * arithmetic, or its result isn't defined, as for a division by 0 or of the
+ * smallest signed value by -1, which trap rather than give a value */
+bool inst_fold(InstKind t, SizeKind sz, uint64_t a, uint64_t b,
+               uint64_t *result);
 
-void ssa_prog_dump(FILE *file, SSA_Prog *prog, int reg_dump);
+/* programs built by translate_ast should give their pool back to the context
+ * instead */
+void ssa_prog_deinit(SSA_Prog *prog);
+void ssa_prog_dump(Emitter *em, SSA_Prog *prog, int reg_dump);
+void function_dump(Emitter *em, SSA_Fn *fn, int reg_dump);
 
 #endif
@@ -0,0 +1,45 @@
+#ifndef SSA_BIN_H
+#define SSA_BIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emit.h"
+#include "ssa.h"
+
+#define SSA_BIN_MAGIC "BONCSSA"
+#define SSA_BIN_MAGIC_SZ 7
+/* bumped whenever the layout or the set of instruction kinds changes, files
+ * of other versions aren't loaded */
+#define SSA_BIN_VERSION 4
+
+/* Binary form of an SSA program, to keep lowered IR around between builds and
+ * to feed it to the optimizer without going through the front end again.
+ * Every number is unsigned LEB128 unless noted otherwise:
+ *
+ *   magic "BONCSSA", version byte
+ *   function count, then every function's name as a length and its bytes
+ *   then for every function:
+ *     register count, then a SizeKind byte per register
+ *     parameter count, then the parameters' registers
+ *     argument count, then the argument registers of all of the function's
+ *       callfns in order, which the callfns take their arguments from
+ *     block count, then every block as an instruction count and instructions
+ *
+ * An instruction is its InstKind byte and (result << 3 | SizeKind), followed
+ * by its imm for INST_IMM, by the callee's index and argument count for
+ * INST_CALLFN, by its argument count and every argument as a block index and
+ * a register for INST_PHI, and by its operands and then the indices of the
+ * blocks it jumps to for everything else.
+ *
+ * Loading sizes every vector up front from the counts, and decodes a
+ * function's argument table once for the argument lists of all its calls to
+ * share. Names are left in the data, so it has to stay mapped for as long as
+ * the program is used. */
+void ssa_bin_write(Emitter *em, SSA_Prog *prog);
+/* builds prog from data, in a pool of its own to be freed with
+ * ssa_prog_deinit. Returns NULL on success, and otherwise what is wrong with
+ * the data, in which case prog is left uninitialized */
+const char *ssa_bin_load(SSA_Prog *prog, const uint8_t *data, size_t sz);
+
+#endif
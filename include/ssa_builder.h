@@ -0,0 +1,96 @@
+#ifndef SSA_BUILDER_H
+#define SSA_BUILDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "helper.h"
+#include "ssa.h"
+
+/* Builds a function in SSA form straight from variables, with the algorithm
+ * of Braun et al., "Simple and Efficient Construction of Static Single
+ * Assignment Form". Every definition of a variable writes a fresh register,
+ * and reading a variable finds the definition that reaches the block, adding
+ * phis where definitions from several predecessors meet. Phis that turn out
+ * to only have one value besides themselves are removed as soon as that is
+ * known, and everything that used them uses the value instead.
+ *
+ * A block's predecessors have to be added before it is sealed, and it can
+ * only be sealed once all of them are known. Reads in unsealed blocks leave
+ * phis to be completed when the block is sealed, so a loop header can be
+ * filled before the edge back to it has been made. Reading a variable that
+ * was never written gives a 0 set at the start of the entry.
+ *
+ * Nothing recurses, so functions with long chains of blocks are fine. The
+ * bookkeeping lives in scratch until ssa_builder_finish */
+
+typedef struct SSABuildPhi SSABuildPhi;
+
+typedef struct {
+  Vector preds;      /* SSA_BBlock *, in the order their edges were added */
+  Vector incomplete; /* SSABuildPhi *, left for when the block is sealed */
+  Vector phis;       /* SSABuildPhi *, every phi ever made for the block */
+  bool sealed;
+  size_t walk; /* the last read that went through the block */
+} SSABuildBlock;
+
+/* a definition of a variable in a block */
+typedef struct {
+  size_t block; /* id + 1, 0 for an empty slot */
+  size_t var;
+  RegId value;
+} SSABuildDef;
+
+typedef struct {
+  SSA_Fn *fn;
+  MemPool *pool;
+  MemPool *scratch;
+  MemPoolMark mark;
+  SSA_BBlock *last;
+  size_t walks;
+
+  Vector blocks; /* SSABuildBlock, by id */
+  Vector vars;   /* SizeKind, by variable */
+
+  /* open addressing, nbuckets is a power of two */
+  SSABuildDef *defs;
+  size_t nbuckets;
+  size_t ndefs;
+
+  /* by register, the phi that sets it and the value it was replaced with */
+  Vector reg_phis;  /* SSABuildPhi * */
+  Vector forwards; /* RegId, 0 if not replaced */
+  /* phis that still need arguments or have to be checked again */
+  Vector pending; /* SSABuildPhi * */
+  Vector trivial; /* SSABuildPhi * */
+  bool replaced;
+  /* by size, the register of the 0 read for variables never written, 0 until
+   * there is one */
+  RegId undefined[SZ_64 + 1];
+} SSABuilder;
+
+/* starts fn with its entry block, which has no predecessors and is sealed.
+ * fn's registers and parameters are set up empty */
+void ssa_builder_init(SSABuilder *b, SSA_Fn *fn, MemPool *pool,
+                      MemPool *scratch);
+/* a new, unsealed block after the last one */
+SSA_BBlock *ssa_builder_add_block(SSABuilder *b);
+void ssa_builder_add_pred(SSABuilder *b, SSA_BBlock *block, SSA_BBlock *pred);
+/* no more predecessors will be added to block */
+void ssa_builder_seal(SSABuilder *b, SSA_BBlock *block);
+
+/* variables are numbered from 0 in the order they're made */
+size_t ssa_builder_new_var(SSABuilder *b, SizeKind sz);
+void ssa_builder_write(SSABuilder *b, size_t var, SSA_BBlock *block,
+                       RegId value);
+/* the value of var at the end of what has been added to block so far. It may
+ * be a phi that is replaced later, which ssa_builder_finish takes care of */
+RegId ssa_builder_read(SSABuilder *b, size_t var, SSA_BBlock *block);
+
+/* every block has to be sealed. Puts the phis that are left at the start of
+ * their blocks, points every use of a removed phi at its value, and gives
+ * back the scratch memory. If phis were removed, the registers are numbered
+ * again with ssa_fn_compact_regs */
+void ssa_builder_finish(SSABuilder *b);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef SSA_PARSER_H
+#define SSA_PARSER_H
+
+#include "context.h"
+#include "ssa.h"
+
+/* Builds prog from the context's source, which holds IR in the text format
+ * that ssa_prog_dump writes (see internals/ssa.md), so passes can be run on
+ * IR without a Bon front end to produce it. The "IR_DUMP:" line in front of a
+ * dump and the register tables of --dump-reg are accepted too.
+ *
+ * Blocks after the entry are started by their label, "@1:", and numbered in
+ * order. Without a register table, registers get the size of the instruction
+ * that sets them. Instructions without a result don't have a size in the
+ * text, and are read back with SZ_NONE.
+ *
+ * prog's pool is taken from the context, and the names of the functions
+ * point into the source. Errors are reported to the context, and jump to its
+ * bailout */
+void parse_ssa(BoncContext *ctx, SSA_Prog *prog);
+
+#endif
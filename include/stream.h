@@ -0,0 +1,30 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Source read from a pipe or anything else that can't be mapped, as it
+ * arrives. It is read into one range of address space that is reserved up
+ * front and never moves, so the lexer can start on the first chunk while the
+ * rest is still being written, and tokens and positions into what has already
+ * been read stay valid. */
+typedef struct InputStream {
+  int fd;
+  uint8_t *base;
+  size_t sz; /* bytes read so far */
+  bool done;
+  const char *error; /* printf format taking the filename, NULL if none */
+} InputStream;
+
+void input_stream_init(InputStream *stream, int fd);
+/* waits for the next chunk of input. Returns false once there is none left,
+ * either at the end of the input or on an error */
+bool input_stream_fill(InputStream *stream);
+/* reads everything up to the end of the input */
+void input_stream_read_all(InputStream *stream);
+/* frees what was read, the file descriptor is left open */
+void input_stream_deinit(InputStream *stream);
+
+#endif
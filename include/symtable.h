@@ -18,6 +18,7 @@ VarInfo make_var_info(int mut, struct Type *type);
 
 typedef struct ScopeEntry {
   SourcePosition pos;
+  size_t hash;
   struct ScopeEntry *next;
   VarInfo inf;
 } ScopeEntry;
@@ -25,7 +26,8 @@ typedef struct ScopeEntry {
 typedef struct Scope {
   struct Scope *up;
 
-  size_t nbuckets;
+  size_t nbuckets; /* always a power of two */
+  size_t nentries;
   ScopeEntry **buckets;
 } Scope;
 
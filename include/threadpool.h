@@ -0,0 +1,19 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+/* Called once for every job index in [0, njobs). Jobs are handed out to
+ * workers in increasing order, but may finish in any order. */
+typedef void (*ThreadpoolJob)(void *data, size_t job);
+
+/* number of workers to use when none is requested, based on the online cores
+ */
+size_t threadpool_default_workers();
+
+/* runs every job and returns once they have all finished. With a single
+ * worker, or a single job, the jobs are run on the calling thread. */
+void threadpool_run(size_t njobs, size_t nworkers, ThreadpoolJob fn,
+                    void *data);
+
+#endif
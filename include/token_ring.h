@@ -0,0 +1,66 @@
+#ifndef TOKEN_RING_H
+#define TOKEN_RING_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "context.h"
+#include "lexer.h"
+
+#define TOKEN_RING_SZ 1024 /* a power of two */
+#define CACHE_LINE_SZ 64
+
+/* where the lexer thread was before the token it stopped at */
+typedef struct {
+  size_t start;
+  size_t end;
+  size_t line;
+  size_t sz;
+  int prev;
+} LexState;
+
+/* Lexes a context's source on its own thread, while the parser takes the
+ * tokens from a single producer, single consumer ring on the thread it's
+ * running on. Once the ring is started, the context's lexer hands out the
+ * tokens from it, so peeking and everything else is unchanged.
+ *
+ * The lexer thread has its own context, since it can't report diagnostics
+ * for the parser. It stops at the first token that doesn't lex, and the
+ * context's lexer then lexes that token itself, so errors are reported just
+ * like without the ring. */
+typedef struct TokenRing {
+  Token toks[TOKEN_RING_SZ];
+
+  /* written by the lexer thread, and only read by the parser */
+  size_t head; /* tokens produced */
+  bool failed; /* the last token is where lexing failed, not the end */
+  uint8_t head_pad[CACHE_LINE_SZ];
+
+  /* written by the parser, and only read by the lexer thread */
+  size_t tail;      /* tokens consumed */
+  bool cancel;      /* stops the lexer thread */
+  size_t seen_head; /* the last head the parser loaded */
+  uint8_t tail_pad[CACHE_LINE_SZ];
+
+  /* only touched by the lexer thread until it's done */
+  Lexer lex;
+  LexState resume;
+  size_t seen_tail; /* the last tail the lexer thread loaded */
+  BoncContext lex_ctx;
+
+  Lexer *consumer; /* the context's lexer */
+  pthread_t thread;
+} TokenRing;
+
+/* starts lexing the rest of the context's source on a new thread */
+TokenRing *token_ring_start(BoncContext *ctx);
+/* hands out the next token. Returns false once the ring is done and the
+ * consumer should lex on its own again, which happens when the lexer thread
+ * failed, tok is then not set */
+bool token_ring_next(TokenRing *ring, Token *tok);
+/* stops the lexer thread, even if the tokens haven't all been taken, and
+ * frees the ring */
+void token_ring_stop(TokenRing *ring);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "driver.h"
+
+/* Compiles the files, then keeps watching them with inotify and compiles the
+ * ones that are written to again, on up to nworkers threads, until the process
+ * is interrupted. The output of every round is written to stdout like a normal
+ * compilation of the files that changed.
+ *
+ * Every file is kept parsed between rounds as a Document, so a change only
+ * re-parses the functions it touches, and the compiler contexts and their
+ * pools stay warm. Never returns. */
+void watch_run(char **filenames, size_t nfiles, CompileOptions *opts,
+               size_t nworkers, bool time_report);
+
+#endif
@@ -23,7 +23,7 @@ if sys.argv[1] == "h":
     prototype_dec = ""
 
     for idx, (k, v) in enumerate(diags.items()):
-        arg_list = ["SourcePosition range"]
+        arg_list = ["struct BoncContext *ctx", "SourcePosition range"]
         ender = ",\n"
         if idx == len(diags) - 1:
             ender = "\n"
@@ -66,7 +66,7 @@ if sys.argv[1] == "h":
 
     header_f = open(sys.argv[3], "w")
     header_f.write(
-        '#ifndef DIAGS_H\n#define DIAGS_H\n#include <stdio.h>\n#include "helper.h"\n#include "type.h"\n'
+        '#ifndef DIAGS_H\n#define DIAGS_H\n#include <stdio.h>\n#include "helper.h"\n#include "type.h"\nstruct BoncContext;\n'
     )
     header_f.write(enum_dec)
     header_f.write(union_dec)
@@ -83,7 +83,7 @@ elif sys.argv[1] == "c":
 
     for idx, (k, v) in enumerate(diags.items()):
         case_block = "case DIAG_" + k.strip().upper() + ":\n"
-        arg_list = ["SourcePosition range"]
+        arg_list = ["struct BoncContext *ctx", "SourcePosition range"]
         type_cnt = 1
         pos_cnt = 1
         char_cnt = 1
@@ -191,7 +191,7 @@ elif sys.argv[1] == "c":
                     + ";\n"
                 )
                 int_cnt += 1
-        fun_def += "errors_log(ret);\n}\n"
+        fun_def += "errors_log(ctx, ret);\n}\n"
         source_f.write(fun_def)
     dump_fn += "}\n}\n"
     source_f.write(dump_fn)
@@ -46,8 +46,10 @@ fill_flag_argument(const char *value, struct Option *opt) {
   return argument_used;
 }
 
-static void
-long_flag_parse(const char *flag, struct Option *opts[]) {
+/* a required argument can either be given as '--flag=value' or as the next
+ * argument, returns the number of arguments used */
+static int
+long_flag_parse(const char *flag, char *next_argv, struct Option *opts[]) {
   char *value;
   size_t flag_length;
 
@@ -60,18 +62,23 @@ long_flag_parse(const char *flag, struct Option *opts[]) {
 
   for (size_t i = 0; opts[i] != NULL; i++) {
     if (opts[i]->long_flag && !strncmp(flag, opts[i]->flag, flag_length)) {
+      if (value == NULL && opts[i]->required_arg == ARG_REQUIRED) {
+        return fill_flag_argument(next_argv, opts[i]) + 1;
+      }
       fill_flag_argument(value, opts[i]);
-      return;
+      return 1;
     }
   }
   log_err_final("unrecognized option '--%s'", flag);
+  return 0; // unreachable, just to stop a warning
 }
 
 static int
 short_flag_parse(const char *flag, char *next_argv, struct Option *opts[]) {
   for (size_t i = 0; opts[i] != NULL; i++) {
     if (!opts[i]->long_flag && !strcmp(flag, opts[i]->flag)) {
-      char *value = next_argv;
+      /* the next argument is only the value if the option takes one */
+      char *value = opts[i]->required_arg == ARG_NONE ? NULL : next_argv;
       return fill_flag_argument(value, opts[i]) + 1;
     }
   }
@@ -80,24 +87,24 @@ short_flag_parse(const char *flag, char *next_argv, struct Option *opts[]) {
 }
 
 void
-parse_args(int argc, char *argv[], struct Option *opts[], char **input_file) {
+parse_args(int argc, char *argv[], struct Option *opts[], char **input_files,
+           size_t *input_count) {
+  *input_count = 0;
   for (int i = 1; i < argc;) {
-    if (!strcmp(argv[i], "-") || strlen(argv[i]) == 0) {
+    if (strlen(argv[i]) == 0) {
       log_err_final("invalid argument '%s'", argv[i]);
     }
-    if (argv[i][0] == '-') {
+    /* a lone '-' is a positional argument, usually meaning stdin */
+    if (argv[i][0] == '-' && argv[i][1] != '\0') {
       if (argv[i][1] == '-') {
-        long_flag_parse(&argv[i][2], opts);
-        i++;
+        i += long_flag_parse(&argv[i][2], argc - i != 1 ? argv[i + 1] : NULL,
+                             opts);
       } else {
         i += short_flag_parse(&argv[i][1], argc - i != 1 ? argv[i + 1] : NULL,
                               opts);
       }
     } else {
-      if (*input_file != NULL) {
-        log_err_final("can't specify more than one input file");
-      }
-      *input_file = argv[i];
+      input_files[(*input_count)++] = argv[i];
       i++;
     }
   }
@@ -16,21 +16,21 @@ Type void_const = {.t = TYPE_VOID};
 
 void
 ast_deinit(AST *ast) {
-  mempool_deinit(&ast->pool);
+  bonc_context_pool_put(ast->ctx, &ast->pool);
 }
 
 void
-ast_init(AST *ast, const uint8_t *src) {
-  ast->src_base = src;
-  mempool_init(&ast->pool);
+ast_init(AST *ast, BoncContext *ctx) {
+  ast->ctx = ctx;
+  bonc_context_pool_get(ctx, &ast->pool);
   ast->global = scope_init(&ast->pool, NULL);
   vector_init(&ast->fns, sizeof(Function), &ast->pool);
 }
 
 static void
-print_indent(FILE *file, int indent) {
+print_indent(Emitter *em, int indent) {
   for (; indent > 0; indent--) {
-    fprintf(file, "    ");
+    emit_mem(em, "    ", 4);
   }
 }
 
@@ -67,35 +67,41 @@ static const char *type_to_str[] = {
     "Type_I16", "Type_I32", "Type_I64", "Type_Bool", "Type_Void"};
 
 static void
-type_dump(FILE *file, Type *type, int indent) {
-  print_indent(file, indent);
-  printf("%s\n", type_to_str[type->t]);
+type_dump(Emitter *em, Type *type, int indent) {
+  print_indent(em, indent);
+  emit_str(em, type_to_str[type->t]);
+  emit_char(em, '\n');
 }
 
 static void
-expr_dump(FILE *file, Expr *expr, int indent) {
-  print_indent(file, indent);
+expr_dump(Emitter *em, Expr *expr, int indent) {
+  print_indent(em, indent);
   switch (expr->t) {
     case EXPR_INT:
-      fprintf(file, "Expr_Int: %.*s\n", (int)expr->pos.sz,
-              (char *)expr->pos.start);
+      emit_str(em, "Expr_Int: ");
+      emit_pos(em, expr->pos);
+      emit_char(em, '\n');
       break;
     case EXPR_VAR:
-      fprintf(file, "Expr_Var: %.*s\n", (int)expr->pos.sz,
-              (char *)expr->pos.start);
+      emit_str(em, "Expr_Var: ");
+      emit_pos(em, expr->pos);
+      emit_char(em, '\n');
       break;
     case EXPR_BINOP:
-      fprintf(file, "Expr_Binop: %s\n", str_of_binop(expr->data.binop.op));
-      expr_dump(file, expr->data.binop.left, indent + 1);
-      expr_dump(file, expr->data.binop.right, indent + 1);
+      emit_str(em, "Expr_Binop: ");
+      emit_str(em, str_of_binop(expr->data.binop.op));
+      emit_char(em, '\n');
+      expr_dump(em, expr->data.binop.left, indent + 1);
+      expr_dump(em, expr->data.binop.right, indent + 1);
       break;
     case EXPR_FUNCALL:
       {
-        fprintf(file, "Expr_Funcall: %.*s\n", (int)expr->data.funcall.name.sz,
-                (char *)expr->data.funcall.name.start);
+        emit_str(em, "Expr_Funcall: ");
+        emit_pos(em, expr->data.funcall.name);
+        emit_char(em, '\n');
         for (size_t i = 0; i < expr->data.funcall.args.items; i++) {
           Expr *temp_expr = *((Expr **)vector_idx(&expr->data.funcall.args, i));
-          expr_dump(file, temp_expr, indent + 1);
+          expr_dump(em, temp_expr, indent + 1);
         }
         break;
       }
@@ -103,43 +109,44 @@ expr_dump(FILE *file, Expr *expr, int indent) {
 }
 
 static void
-stmt_dump(FILE *file, Stmt *stmt, int indent) {
-  print_indent(file, indent);
+stmt_dump(Emitter *em, Stmt *stmt, int indent) {
+  print_indent(em, indent);
   switch (stmt->t) {
     case STMT_LET:
-      fprintf(file, "Stmt_Let: %.*s\n", (int)stmt->data.let.name.sz,
-              (char *)stmt->data.let.name.start);
-      type_dump(file, stmt->data.let.type, indent + 1);
+      emit_str(em, "Stmt_Let: ");
+      emit_pos(em, stmt->data.let.name);
+      emit_char(em, '\n');
+      type_dump(em, stmt->data.let.type, indent + 1);
       if (stmt->data.let.value) {
-        expr_dump(file, stmt->data.let.value, indent + 1);
+        expr_dump(em, stmt->data.let.value, indent + 1);
       }
       break;
     case STMT_RETURN:
-      fprintf(file, "Stmt_Return:\n");
+      emit_str(em, "Stmt_Return:\n");
       if (stmt->data.expr) {
-        expr_dump(file, stmt->data.expr, indent + 1);
+        expr_dump(em, stmt->data.expr, indent + 1);
       }
       break;
     case STMT_EXPR:
-      fprintf(file, "Stmt_Expr:\n");
-      expr_dump(file, stmt->data.expr, indent + 1);
+      emit_str(em, "Stmt_Expr:\n");
+      expr_dump(em, stmt->data.expr, indent + 1);
       break;
   }
 }
 
-static void
-fn_dump(FILE *file, Function *fn) {
-  fprintf(file, "Fn: ");
-  type_dump(file, fn->ret_type, 0);
+void
+ast_fn_dump(Emitter *em, Function *fn) {
+  emit_str(em, "Fn: ");
+  type_dump(em, fn->ret_type, 0);
   for (size_t i = 0; i < fn->body.stmts.items; i++) {
-    stmt_dump(file, vector_idx(&fn->body.stmts, i), 1);
+    stmt_dump(em, vector_idx(&fn->body.stmts, i), 1);
   }
 }
 
 void
-ast_dump(FILE *file, AST *ast) {
+ast_dump(Emitter *em, AST *ast) {
   for (size_t i = 0; i < ast->fns.items; i++) {
-    fn_dump(file, vector_idx(&ast->fns, i));
+    ast_fn_dump(em, vector_idx(&ast->fns, i));
   }
 }
 
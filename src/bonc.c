@@ -1,28 +1,23 @@
-#include <fcntl.h>
 #include <getopt.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/types.h>
 
-#include "error.h"
 #include "args.h"
+#include "cache.h"
+#include "driver.h"
 #include "helper.h"
-#include "ir_gen.h"
-#include "lexer.h"
-#include "parser.h"
-#include "semantics.h"
-#include "ssa.h"
 #include "platforms.h"
+#include "server.h"
+#include "threadpool.h"
+#include "watch.h"
 
 void
 print_help(const char *program_name, const char *program_description,
            struct Option *opts[]) {
   printf("%s: %s\n", program_name, program_description);
-  printf("Usage: %s [OPTION]... [FILE]\n", program_name);
+  printf("Usage: %s [OPTION]... [FILE]...\n", program_name);
   print_flags(opts);
 }
 
@@ -61,6 +56,13 @@ struct Option reg_dump_flag = {
     .type = OPT_BOOLEAN,
     .long_flag = true,
 };
+struct Option cfg_dump_flag = {
+    .flag = "dump-cfg",
+    .description = "dumps the control flow graph and dominators to stdout",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
 struct Option platform_flag = {
     .flag = "platform",
     .description = "selects the platform to compile for",
@@ -76,15 +78,200 @@ struct Option list_platforms = {
     .type = OPT_BOOLEAN,
     .long_flag = true,
 };
+struct Option server_flag = {
+    .flag = "server",
+    .description = "stays resident and compiles requests sent to the socket",
+    .argument_name = "socket",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_STRING,
+    .long_flag = true,
+};
+struct Option jobs_flag = {
+    .flag = "j",
+    .description = "number of files to compile in parallel",
+    .argument_name = "jobs",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_INT,
+    .long_flag = false,
+};
+struct Option cache_dir_flag = {
+    .flag = "cache-dir",
+    .description = "reuses earlier output for unchanged sources, kept in "
+                   "this directory (default: $BONC_CACHE_DIR)",
+    .argument_name = "dir",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_STRING,
+    .long_flag = true,
+};
+struct Option incremental_flag = {
+    .flag = "incremental",
+    .description = "only recompiles the functions that changed, needs a cache "
+                   "directory",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+struct Option lex_thread_flag = {
+    .flag = "lex-thread",
+    .description = "lexes on a thread of its own while parsing",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+struct Option per_function_flag = {
+    .flag = "per-function",
+    .description = "compiles one function at a time, keeping only the "
+                   "signatures of the others in memory",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+struct Option watch_flag = {
+    .flag = "watch",
+    .description = "stays resident and compiles the files again whenever "
+                   "they are written to",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+struct Option emit_ssa_bin_flag = {
+    .flag = "emit-ssa-bin",
+    .description = "also writes the SSA program to this file in binary",
+    .argument_name = "file",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_STRING,
+    .long_flag = true,
+};
+struct Option load_ssa_bin_flag = {
+    .flag = "load-ssa-bin",
+    .description = "loads an SSA program written with --emit-ssa-bin instead "
+                   "of compiling a source",
+    .argument_name = "file",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_STRING,
+    .long_flag = true,
+};
+struct Option from_ir_flag = {
+    .flag = "from-ir",
+    .description = "reads the input files as SSA IR in the format of "
+                   "--dump-ir instead of Bon",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+struct Option o0_flag = {
+    .flag = "O0",
+    .description = "doesn't optimize the IR (the default)",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = false,
+};
+struct Option o1_flag = {
+    .flag = "O1",
+    .description = "runs the cheap optimizations over the IR",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = false,
+};
+struct Option o2_flag = {
+    .flag = "O2",
+    .description = "runs all the optimizations over the IR",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = false,
+};
+struct Option os_flag = {
+    .flag = "Os",
+    .description = "runs the optimizations that make the IR smaller",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = false,
+};
+struct Option passes_flag = {
+    .flag = "passes",
+    .description = "runs these comma separated passes over the IR instead "
+                   "of the ones of an optimization level",
+    .argument_name = "list",
+    .required_arg = ARG_REQUIRED,
+    .type = OPT_STRING,
+    .long_flag = true,
+};
+struct Option time_report_flag = {
+    .flag = "time-report",
+    .description = "prints the time spent in each phase to stderr",
+    .required_arg = ARG_NONE,
+    .type = OPT_BOOLEAN,
+    .long_flag = true,
+};
+
+/* the pipeline asked for with -O or --passes, -O0 if there is none */
+static void
+select_passes(PassPipeline *pl) {
+  struct Option *levels[] = {&o0_flag, &o1_flag, &o2_flag, &os_flag};
+  struct Option *level = NULL;
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    if (levels[i]->enabled) {
+      if (level != NULL) {
+        log_err_final("'-%s' and '-%s' can't be combined", level->flag,
+                      levels[i]->flag);
+      }
+      level = levels[i];
+    }
+  }
+  if (level != NULL && passes_flag.enabled) {
+    log_err_final("'-%s' and '--passes' can't be combined", level->flag);
+  }
+
+  if (passes_flag.enabled) {
+    const char *error = pass_pipeline_parse(pl, passes_flag.out.string);
+    if (error != NULL) {
+      log_err(error, passes_flag.out.string);
+      fprintf(stderr, "available passes:\n");
+      for (size_t i = 0; i < PASS_COUNT; i++) {
+        fprintf(stderr, " - %-16s %s\n", pass_tbl[i].name,
+                pass_tbl[i].description);
+      }
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    pass_pipeline_level(pl, level == NULL ? "0" : &level->flag[1]);
+  }
+}
+
+/* finishes the file of --emit-ssa-bin, if there is one. It is removed if
+ * compiling failed or it couldn't be written, to not leave half a program
+ * behind. Returns false in either case */
+static bool
+close_ssa_bin(CompileOptions *opts, const char *filename, bool ok) {
+  if (opts->ssa_bin_out == NULL) {
+    return ok;
+  }
+  if (fclose(opts->ssa_bin_out) != 0 && ok) {
+    log_err("unable to write '%s'", filename);
+    ok = false;
+  }
+  if (!ok) {
+    remove(filename);
+  }
+  return ok;
+}
 
 int
 main(int argc, char *argv[]) {
   struct Option *opts[] = {
-      &help,          &version,       &ast_dump_flag,  &ir_dump_flag,
-      &reg_dump_flag, &platform_flag, &list_platforms, NULL};
-  char *in_filename = NULL;
+      &help,           &version,          &ast_dump_flag,
+      &ir_dump_flag,   &reg_dump_flag,    &cfg_dump_flag,
+      &platform_flag,  &list_platforms,   &server_flag,
+      &jobs_flag,      &cache_dir_flag,   &incremental_flag,
+      &time_report_flag, &watch_flag,     &lex_thread_flag,
+      &per_function_flag, &emit_ssa_bin_flag, &load_ssa_bin_flag,
+      &from_ir_flag,   &o0_flag,          &o1_flag,
+      &o2_flag,        &os_flag,          &passes_flag,
+      NULL};
+  char *in_filenames[argc];
+  size_t in_count;
 
-  parse_args(argc, argv, opts, &in_filename);
+  parse_args(argc, argv, opts, in_filenames, &in_count);
 
   if (!ir_dump_flag.enabled && reg_dump_flag.enabled) {
     log_err_final("cannot print registers without printing the IR");
@@ -95,7 +282,7 @@ main(int argc, char *argv[]) {
     exit(EXIT_SUCCESS);
   }
   if (version.enabled) {
-    printf("bonc : v0.1\n");
+    printf("bonc : v%s\n", BONC_VERSION);
     exit(EXIT_SUCCESS);
   }
 
@@ -108,67 +295,182 @@ main(int argc, char *argv[]) {
     exit(EXIT_SUCCESS);
   }
 
-  Platform *platform __attribute__((unused)) = &platform_x86_64_sysv;
-  if (platform_flag.out.string != NULL) {
-    for (size_t i = 0; platforms[i] != NULL; i++) {
-      if (strcmp(platforms[i]->name, platform_flag.out.string) == 0) {
-        platform = platforms[i];
-        break;
-      }
-    }
+  Platform *platform = &platform_x86_64_sysv;
+  if (platform_flag.out.string != NULL &&
+      platform_find(platform_flag.out.string) != NULL) {
+    platform = platform_find(platform_flag.out.string);
   }
 
-  if (!in_filename) {
-    log_err_final("no input file specified");
+  size_t nworkers = threadpool_default_workers();
+  if (jobs_flag.enabled) {
+    if (jobs_flag.out.integer < 1) {
+      log_err_final("'-j' needs at least one job");
+    }
+    nworkers = jobs_flag.out.integer;
   }
 
-  int in_fd = open(in_filename, O_RDONLY);
-  if (in_fd == -1) {
-    log_err_final("unable to open '%s'", in_filename);
+  if (server_flag.enabled) {
+    if (in_count != 0) {
+      log_err_final("the server takes its input files from requests");
+    }
+    server_run(server_flag.out.string, nworkers);
+    exit(EXIT_FAILURE);
   }
 
-  struct stat _in_stat;
-  if (fstat(in_fd, &_in_stat) == -1) {
-    log_err_final("unable to get stats on '%s'", in_filename);
+  if (in_count == 0 && !load_ssa_bin_flag.enabled) {
+    log_err_final("no input file specified");
   }
-  size_t in_size = _in_stat.st_size;
-
-  const uint8_t *in_file =
-      mmap(NULL, in_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
-  if (in_file == MAP_FAILED) {
-    log_err_final("unable to get contents of '%s'", in_filename);
+  if (load_ssa_bin_flag.enabled) {
+    if (in_count != 0) {
+      log_err_final("'--load-ssa-bin' takes no input files");
+    }
+    if (ast_dump_flag.enabled) {
+      log_err_final("a binary SSA program has no AST to dump");
+    }
   }
-
-  MemPool pool;
-  mempool_init(&pool);
-  errors_init(&pool, in_file, in_filename);
-
-  lexer_init(in_file, in_size);
-
-  AST ast = parse_ast(in_file);
-
-  errors_output(stdout);
-
-  resolve_names(&ast);
-  resolve_types(&ast);
-  check_returns(&ast);
-
-  if (ast_dump_flag.enabled) {
-    printf("AST_DUMP:\n");
-    ast_dump(stdout, &ast);
-    printf("\n");
+  bool reads_stdin = false;
+  for (size_t i = 0; i < in_count; i++) {
+    if (strcmp(in_filenames[i], "-") == 0) {
+      if (reads_stdin) {
+        log_err_final("stdin ('-') can only be read once");
+      }
+      reads_stdin = true;
+    }
   }
 
-  SSA_Prog ssa_prog;
-  translate_ast(&ast, &ssa_prog);
+  CompileOptions compile_opts = {
+      .dump_ast = ast_dump_flag.enabled,
+      .dump_ir = ir_dump_flag.enabled,
+      .dump_reg = reg_dump_flag.enabled,
+      .dump_cfg = cfg_dump_flag.enabled,
+      .platform = platform,
+      .cache_dir = cache_dir_flag.enabled ? cache_dir_flag.out.string
+                                          : getenv("BONC_CACHE_DIR"),
+  };
+  if (compile_opts.cache_dir != NULL && compile_opts.cache_dir[0] == '\0') {
+    compile_opts.cache_dir = NULL;
+  }
+  if (compile_opts.cache_dir != NULL &&
+      strlen(compile_opts.cache_dir) > CACHE_DIR_MAX) {
+    log_err_final("cache directory '%s' is longer than %d bytes",
+                  compile_opts.cache_dir, CACHE_DIR_MAX);
+  }
+  compile_opts.incremental = incremental_flag.enabled;
+  compile_opts.lex_thread = lex_thread_flag.enabled;
+  compile_opts.per_function = per_function_flag.enabled;
+  compile_opts.from_ir = from_ir_flag.enabled;
+  select_passes(&compile_opts.passes);
+  /* several files already keep the workers busy, one each */
+  compile_opts.pass_workers =
+      in_count <= 1 || load_ssa_bin_flag.enabled ? nworkers : 1;
+  if (compile_opts.from_ir &&
+      (ast_dump_flag.enabled || compile_opts.incremental ||
+       compile_opts.per_function || compile_opts.lex_thread ||
+       watch_flag.enabled)) {
+    log_err_final("'--from-ir' starts from the IR, and can't be combined "
+                  "with '--dump-ast', '--incremental', '--per-function', "
+                  "'--lex-thread' or '--watch'");
+  }
+  if (compile_opts.dump_cfg &&
+      (compile_opts.incremental || compile_opts.per_function)) {
+    log_err_final("'--dump-cfg' can't be combined with '--incremental' or "
+                  "'--per-function'");
+  }
+  if (compile_opts.per_function &&
+      (compile_opts.incremental || compile_opts.lex_thread)) {
+    log_err_final("'--per-function' can't be combined with '--incremental' "
+                  "or '--lex-thread'");
+  }
+  if (compile_opts.incremental && compile_opts.cache_dir == NULL) {
+    log_err_final("'--incremental' needs a cache directory");
+  }
+  if (load_ssa_bin_flag.enabled &&
+      (compile_opts.incremental || compile_opts.per_function ||
+       watch_flag.enabled)) {
+    log_err_final("'--load-ssa-bin' skips the front end, and can't be "
+                  "combined with '--incremental', '--per-function' or "
+                  "'--watch'");
+  }
+  if (emit_ssa_bin_flag.enabled) {
+    if (in_count > 1) {
+      log_err_final("'--emit-ssa-bin' only takes a single input file");
+    }
+    if (compile_opts.incremental || compile_opts.per_function ||
+        watch_flag.enabled) {
+      log_err_final("'--emit-ssa-bin' needs the whole SSA program, and can't "
+                    "be combined with '--incremental', '--per-function' or "
+                    "'--watch'");
+    }
+    /* cached output comes without a program to write */
+    compile_opts.cache_dir = NULL;
+    compile_opts.ssa_bin_out = fopen(emit_ssa_bin_flag.out.string, "wb");
+    if (compile_opts.ssa_bin_out == NULL) {
+      log_err_final("unable to open '%s'", emit_ssa_bin_flag.out.string);
+    }
+  }
+  if (load_ssa_bin_flag.enabled) {
+    TimeReport times = {0};
+    uint64_t start = time_now_ns();
+    bool ok = compile_ssa_bin(load_ssa_bin_flag.out.string, &compile_opts,
+                              stdout, &times);
+    uint64_t wall = time_now_ns() - start;
+    ok = close_ssa_bin(&compile_opts, emit_ssa_bin_flag.out.string, ok);
+    if (time_report_flag.enabled) {
+      fflush(stdout);
+      time_report_print(stderr, &times, wall, false);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (watch_flag.enabled) {
+    if (reads_stdin) {
+      log_err_final("cannot watch stdin ('-')");
+    }
+    if (compile_opts.incremental) {
+      log_err_final("'--watch' keeps the files parsed itself, and can't be "
+                    "combined with '--incremental'");
+    }
+    /* every round only compiles what changed, so the cache isn't used */
+    compile_opts.cache_dir = NULL;
+    watch_run(in_filenames, in_count, &compile_opts, nworkers,
+              time_report_flag.enabled);
+  }
 
-  if (ir_dump_flag.enabled) {
-    printf("IR_DUMP:\n");
-    ssa_prog_dump(stdout, &ssa_prog, reg_dump_flag.enabled);
+  CompileJob *jobs = malloc(sizeof(CompileJob) * in_count);
+  for (size_t i = 0; i < in_count; i++) {
+    jobs[i].filename = in_filenames[i];
   }
 
-  ast_deinit(&ast);
+  uint64_t start = time_now_ns();
+  compile_jobs(jobs, in_count, &compile_opts, nworkers);
+  uint64_t wall = time_now_ns() - start;
 
-  munmap((uint8_t *)in_file, in_size);
-  return EXIT_SUCCESS;
+  /* output is written in the order the files were given, no matter which
+   * finished first */
+  int status = EXIT_SUCCESS;
+  for (size_t i = 0; i < in_count; i++) {
+    if (jobs[i].io_error != NULL) {
+      fflush(stdout);
+      log_err(jobs[i].io_error, jobs[i].filename);
+    } else {
+      fwrite(jobs[i].output, 1, jobs[i].output_sz, stdout);
+      compile_job_release(&jobs[i]);
+    }
+    if (jobs[i].failed) {
+      status = EXIT_FAILURE;
+    }
+  }
+  if (!close_ssa_bin(&compile_opts, emit_ssa_bin_flag.out.string,
+                     status == EXIT_SUCCESS)) {
+    status = EXIT_FAILURE;
+  }
+  if (time_report_flag.enabled) {
+    TimeReport total = {0};
+    for (size_t i = 0; i < in_count; i++) {
+      time_report_add(&total, &jobs[i].times);
+    }
+    fflush(stdout);
+    time_report_print(stderr, &total, wall, compile_opts.cache_dir != NULL);
+  }
+  free(jobs);
+  return status;
 }
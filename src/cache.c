@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include "cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* bump whenever the entry layout or the meaning of a key changes */
+#define CACHE_FORMAT_VERSION 1
+#define CACHE_MAGIC "BONCACHE"
+#define CACHE_HEADER_SZ 12 /* magic, then the format version as a u32 */
+
+/* dir/ab/cdef..., so that no single directory gets too large. Returns false
+ * if the path doesn't fit in path_sz */
+static bool
+entry_path(char *path, size_t path_sz, const char *dir,
+           const uint8_t key[CACHE_KEY_SZ], bool just_dir) {
+  char hex[2 * CACHE_KEY_SZ + 1];
+  for (int i = 0; i < CACHE_KEY_SZ; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", key[i]);
+  }
+  int len = just_dir ? snprintf(path, path_sz, "%s/%.2s", dir, hex)
+                     : snprintf(path, path_sz, "%s/%.2s/%s", dir, hex, hex + 2);
+  return len >= 0 && (size_t)len < path_sz;
+}
+
+void
+cache_key_begin(Sha256 *sha, CacheKind kind, CompileOptions *opts) {
+  sha256_init(sha);
+  uint8_t header[] = {CACHE_FORMAT_VERSION, kind,
+                      opts->dump_ast,       opts->dump_ir,
+                      opts->dump_reg,       opts->dump_cfg,
+                      opts->from_ir};
+  sha256_update(sha, BONC_VERSION, sizeof(BONC_VERSION));
+  sha256_update(sha, header, sizeof(header));
+  sha256_update(sha, opts->platform->name, strlen(opts->platform->name) + 1);
+  uint8_t npasses = opts->passes.npasses;
+  sha256_update(sha, &npasses, 1);
+  sha256_update(sha, opts->passes.passes, npasses);
+}
+
+void
+cache_key(uint8_t key[CACHE_KEY_SZ], const uint8_t *src, size_t sz,
+          CompileOptions *opts) {
+  Sha256 sha;
+  cache_key_begin(&sha, CACHE_FILE, opts);
+  sha256_update(&sha, src, sz);
+  sha256_final(&sha, key);
+}
+
+bool
+cache_load(const char *dir, const uint8_t key[CACHE_KEY_SZ],
+           CachedOutput *out) {
+  char path[CACHE_PATH_SZ];
+  if (!entry_path(path, sizeof(path), dir, key, false)) {
+    return false;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < CACHE_HEADER_SZ) {
+    close(fd);
+    return false;
+  }
+  out->map_sz = st.st_size;
+  out->map = mmap(NULL, out->map_sz, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (out->map == MAP_FAILED) {
+    return false;
+  }
+
+  uint32_t version = out->map[8] | out->map[9] << 8 | out->map[10] << 16 |
+                     (uint32_t)out->map[11] << 24;
+  if (memcmp(out->map, CACHE_MAGIC, 8) != 0 ||
+      version != CACHE_FORMAT_VERSION) {
+    munmap(out->map, out->map_sz);
+    return false;
+  }
+  out->output = (const char *)out->map + CACHE_HEADER_SZ;
+  out->output_sz = out->map_sz - CACHE_HEADER_SZ;
+  return true;
+}
+
+void
+cache_release(CachedOutput *out) {
+  munmap(out->map, out->map_sz);
+}
+
+void
+cache_store(const char *dir, const uint8_t key[CACHE_KEY_SZ],
+            const char *output, size_t output_sz) {
+  char dir_path[CACHE_PATH_SZ];
+  char path[CACHE_PATH_SZ];
+  char temp_path[CACHE_PATH_SZ];
+
+  /* a truncated path would name another file. The driver doesn't take cache
+   * directories too long for them */
+  if (!entry_path(dir_path, sizeof(dir_path), dir, key, true) ||
+      !entry_path(path, sizeof(path), dir, key, false)) {
+    return;
+  }
+  int len = snprintf(temp_path, sizeof(temp_path), "%s/tmp.XXXXXX", dir_path);
+  if (len < 0 || (size_t)len >= sizeof(temp_path)) {
+    return;
+  }
+  mkdir(dir, 0777);
+  mkdir(dir_path, 0777);
+
+  /* written to the side and renamed into place, so that concurrent readers
+   * only ever see complete entries */
+  int fd = mkstemp(temp_path);
+  if (fd == -1) {
+    return;
+  }
+  uint8_t header[CACHE_HEADER_SZ] = CACHE_MAGIC;
+  for (int i = 0; i < 4; i++) {
+    header[8 + i] = (uint32_t)CACHE_FORMAT_VERSION >> (i * 8);
+  }
+  FILE *file = fdopen(fd, "wb");
+  bool ok = fwrite(header, 1, CACHE_HEADER_SZ, file) == CACHE_HEADER_SZ &&
+            fwrite(output, 1, output_sz, file) == output_sz;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(temp_path, path) == -1) {
+    unlink(temp_path);
+  }
+}
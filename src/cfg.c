@@ -0,0 +1,281 @@
+#include "cfg.h"
+
+#include <stdint.h>
+
+static void
+set_succs(SSA_Fn *fn, SSA_BBlock *block) {
+  block->nsuccs = 0;
+  SSA_Inst *last = block->last;
+  if (last == NULL || !inst_is_terminator(last)) {
+    if (block->next != NULL) {
+      block->succs[block->nsuccs++] = block->next;
+    }
+    return;
+  }
+  for (uint8_t i = 0; i < inst_targets_tbl[last->t]; i++) {
+    SSA_BBlock *target = inst_targets(fn, last)[i];
+    if (block->nsuccs == 0 || block->succs[0] != target) {
+      block->succs[block->nsuccs++] = target;
+    }
+  }
+}
+
+void
+cfg_build(SSA_Fn *fn, MemPool *pool, MemPool *scratch) {
+  size_t nblocks = ssa_number_blocks(fn);
+  size_t nedges = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    set_succs(fn, block);
+    block->npreds = 0;
+    block->rpo = SIZE_MAX;
+  }
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (uint8_t i = 0; i < block->nsuccs; i++) {
+      block->succs[i]->npreds++;
+    }
+    nedges += block->nsuccs;
+  }
+
+  /* all of the predecessors are in one array, each block gets a slice */
+  SSA_BBlock **preds = mempool_alloc(pool, nedges * sizeof(SSA_BBlock *));
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    block->preds = preds;
+    preds += block->npreds;
+    block->npreds = 0;
+  }
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (uint8_t i = 0; i < block->nsuccs; i++) {
+      SSA_BBlock *succ = block->succs[i];
+      succ->preds[succ->npreds++] = block;
+    }
+  }
+
+  /* depth first search with an explicit stack, holding every block on the
+   * path along with the successor to visit next. rpo is 0 for the blocks that
+   * have been seen until it's set for real */
+  MemPoolMark mark = mempool_mark(scratch);
+  SSA_BBlock **stack = mempool_alloc(scratch, nblocks * sizeof(SSA_BBlock *));
+  uint8_t *next_succ = mempool_alloc(scratch, nblocks);
+  SSA_BBlock **postorder =
+      mempool_alloc(scratch, nblocks * sizeof(SSA_BBlock *));
+  size_t depth = 0;
+  size_t npost = 0;
+  stack[depth] = fn->entry;
+  next_succ[depth++] = 0;
+  fn->entry->rpo = 0;
+  while (depth != 0) {
+    SSA_BBlock *block = stack[depth - 1];
+    if (next_succ[depth - 1] == block->nsuccs) {
+      postorder[npost++] = block;
+      depth--;
+      continue;
+    }
+    SSA_BBlock *succ = block->succs[next_succ[depth - 1]++];
+    if (succ->rpo == SIZE_MAX) {
+      succ->rpo = 0;
+      stack[depth] = succ;
+      next_succ[depth++] = 0;
+    }
+  }
+
+  fn->nrpo = npost;
+  fn->rpo = mempool_alloc(pool, npost * sizeof(SSA_BBlock *));
+  for (size_t i = 0; i < npost; i++) {
+    fn->rpo[i] = postorder[npost - i - 1];
+    fn->rpo[i]->rpo = i;
+  }
+  mempool_release(scratch, mark);
+}
+
+/* the closest common dominator of two blocks, by their rpo. Dominators come
+ * before the blocks they dominate in reverse postorder, so the later of the
+ * two is moved up the tree until they meet */
+static size_t
+intersect(size_t *doms, size_t a, size_t b) {
+  while (a != b) {
+    while (a > b) {
+      a = doms[a];
+    }
+    while (b > a) {
+      b = doms[b];
+    }
+  }
+  return a;
+}
+
+/* numbers the dominator tree in preorder and postorder, for cfg_dominates */
+static void
+number_dom_tree(SSA_Fn *fn, MemPool *scratch) {
+  SSA_BBlock **stack = mempool_alloc(scratch, fn->nrpo * sizeof(SSA_BBlock *));
+  size_t *next_child = mempool_alloc(scratch, fn->nrpo * sizeof(size_t));
+  size_t depth = 0;
+  size_t pre = 0;
+  size_t post = 0;
+  stack[depth] = fn->entry;
+  next_child[depth++] = 0;
+  fn->entry->dom_pre = pre++;
+  while (depth != 0) {
+    SSA_BBlock *block = stack[depth - 1];
+    if (next_child[depth - 1] == block->ndom_children) {
+      block->dom_post = post++;
+      depth--;
+      continue;
+    }
+    SSA_BBlock *child = block->dom_children[next_child[depth - 1]++];
+    child->dom_pre = pre++;
+    stack[depth] = child;
+    next_child[depth++] = 0;
+  }
+}
+
+void
+cfg_dominators(SSA_Fn *fn, MemPool *pool, MemPool *scratch) {
+  size_t n = fn->nrpo;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    block->idom = NULL;
+    block->ndom_children = 0;
+  }
+
+  /* the immediate dominator of every block by rpo, SIZE_MAX until known */
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t *doms = mempool_alloc(scratch, n * sizeof(size_t));
+  doms[0] = 0;
+  for (size_t i = 1; i < n; i++) {
+    doms[i] = SIZE_MAX;
+  }
+  /* a block's parent in the depth first search comes before it, so every
+   * block has a processed predecessor to start from */
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 1; i < n; i++) {
+      SSA_BBlock *block = fn->rpo[i];
+      size_t idom = SIZE_MAX;
+      for (size_t j = 0; j < block->npreds; j++) {
+        size_t pred = block->preds[j]->rpo;
+        if (pred == SIZE_MAX || doms[pred] == SIZE_MAX) {
+          continue;
+        }
+        idom = idom == SIZE_MAX ? pred : intersect(doms, pred, idom);
+      }
+      if (doms[i] != idom) {
+        doms[i] = idom;
+        changed = true;
+      }
+    }
+  }
+
+  for (size_t i = 1; i < n; i++) {
+    fn->rpo[i]->idom = fn->rpo[doms[i]];
+    fn->rpo[i]->idom->ndom_children++;
+  }
+  SSA_BBlock **children =
+      mempool_alloc(pool, (n == 0 ? 0 : n - 1) * sizeof(SSA_BBlock *));
+  for (size_t i = 0; i < n; i++) {
+    fn->rpo[i]->dom_children = children;
+    children += fn->rpo[i]->ndom_children;
+    fn->rpo[i]->ndom_children = 0;
+  }
+  for (size_t i = 1; i < n; i++) {
+    SSA_BBlock *idom = fn->rpo[i]->idom;
+    idom->dom_children[idom->ndom_children++] = fn->rpo[i];
+  }
+
+  number_dom_tree(fn, scratch);
+  mempool_release(scratch, mark);
+}
+
+/* walks up from the predecessors of every join to its immediate dominator,
+ * adding the join to the frontier of every block on the way. seen holds the
+ * last join added to each block, which also stops a walk that has already
+ * been made. Only counts the frontiers if fill isn't set */
+static void
+walk_frontiers(SSA_Fn *fn, size_t *seen, bool fill) {
+  for (size_t i = 0; i < fn->nrpo; i++) {
+    seen[i] = SIZE_MAX;
+  }
+  for (size_t i = 0; i < fn->nrpo; i++) {
+    SSA_BBlock *join = fn->rpo[i];
+    if (join->npreds < 2) {
+      continue;
+    }
+    for (size_t j = 0; j < join->npreds; j++) {
+      SSA_BBlock *runner = join->preds[j];
+      if (runner->rpo == SIZE_MAX) {
+        continue;
+      }
+      while (runner != join->idom && seen[runner->rpo] != i) {
+        seen[runner->rpo] = i;
+        if (fill) {
+          runner->frontier[runner->nfrontier] = join;
+        }
+        runner->nfrontier++;
+        runner = runner->idom;
+      }
+    }
+  }
+}
+
+void
+cfg_frontiers(SSA_Fn *fn, MemPool *pool, MemPool *scratch) {
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    block->nfrontier = 0;
+  }
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t *seen = mempool_alloc(scratch, fn->nrpo * sizeof(size_t));
+
+  walk_frontiers(fn, seen, false);
+  size_t total = 0;
+  for (size_t i = 0; i < fn->nrpo; i++) {
+    total += fn->rpo[i]->nfrontier;
+  }
+  SSA_BBlock **frontiers = mempool_alloc(pool, total * sizeof(SSA_BBlock *));
+  for (size_t i = 0; i < fn->nrpo; i++) {
+    fn->rpo[i]->frontier = frontiers;
+    frontiers += fn->rpo[i]->nfrontier;
+    fn->rpo[i]->nfrontier = 0;
+  }
+  walk_frontiers(fn, seen, true);
+  mempool_release(scratch, mark);
+}
+
+bool
+cfg_dominates(SSA_BBlock *a, SSA_BBlock *b) {
+  return a->rpo != SIZE_MAX && b->rpo != SIZE_MAX &&
+         a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+static void
+dump_blocks(Emitter *em, const char *label, SSA_BBlock **blocks, size_t n) {
+  emit_str(em, label);
+  for (size_t i = 0; i < n; i++) {
+    emit_str(em, " @");
+    emit_u64(em, blocks[i]->id);
+  }
+}
+
+void
+cfg_dump(Emitter *em, SSA_Fn *fn) {
+  emit_str(em, "fn ");
+  emit_pos(em, fn->name);
+  emit_char(em, '\n');
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    emit_char(em, '@');
+    emit_u64(em, block->id);
+    dump_blocks(em, " | preds", block->preds, block->npreds);
+    dump_blocks(em, " | succs", block->succs, block->nsuccs);
+    if (block->rpo == SIZE_MAX) {
+      emit_str(em, " | unreachable\n");
+      continue;
+    }
+    emit_str(em, " | idom ");
+    if (block->idom == NULL) {
+      emit_char(em, '-');
+    } else {
+      emit_char(em, '@');
+      emit_u64(em, block->idom->id);
+    }
+    dump_blocks(em, " | frontier", block->frontier, block->nfrontier);
+    emit_char(em, '\n');
+  }
+  emit_char(em, '\n');
+}
@@ -0,0 +1,63 @@
+#include "context.h"
+
+#include "error.h"
+
+static void
+context_set_source(BoncContext *ctx, const uint8_t *src, size_t sz,
+                   const char *filename, FILE *err_file) {
+  ctx->src_base = src;
+  ctx->src_sz = sz;
+  ctx->filename = filename;
+  ctx->err_file = err_file;
+  ctx->bailout = NULL;
+  ctx->diag_line = NULL;
+
+  errors_init(ctx);
+  lexer_init(&ctx->lex, ctx, src, sz);
+}
+
+void
+bonc_context_init(BoncContext *ctx, const uint8_t *src, size_t sz,
+                  const char *filename, FILE *err_file) {
+  ctx->nspare_pools = 0;
+  mempool_init(&ctx->pool);
+  mempool_init(&ctx->scratch);
+  context_set_source(ctx, src, sz, filename, err_file);
+}
+
+void
+bonc_context_reuse(BoncContext *ctx, const uint8_t *src, size_t sz,
+                   const char *filename, FILE *err_file) {
+  mempool_reset(&ctx->pool);
+  mempool_reset(&ctx->scratch);
+  context_set_source(ctx, src, sz, filename, err_file);
+}
+
+void
+bonc_context_deinit(BoncContext *ctx) {
+  for (size_t i = 0; i < ctx->nspare_pools; i++) {
+    mempool_deinit(&ctx->spare_pools[i]);
+  }
+  mempool_deinit(&ctx->pool);
+  mempool_deinit(&ctx->scratch);
+}
+
+void
+bonc_context_pool_get(BoncContext *ctx, MemPool *pool) {
+  if (ctx->nspare_pools == 0) {
+    mempool_init(pool);
+    return;
+  }
+  *pool = ctx->spare_pools[--ctx->nspare_pools];
+}
+
+void
+bonc_context_pool_put(BoncContext *ctx, MemPool *pool) {
+  if (ctx->nspare_pools == CONTEXT_SPARE_POOLS) {
+    mempool_deinit(pool);
+    return;
+  }
+  mempool_reset(pool);
+  ctx->spare_pools[ctx->nspare_pools++] = *pool;
+  pool->base = NULL;
+}
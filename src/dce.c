@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "passes.h"
+
+/* whether a division can trap, unless its divisor is known not to be 0, or
+ * -1 for a signed one. Register 0 isn't set by anything, so nothing is known
+ * about it */
+static bool
+may_trap(SSA_Fn *fn, SSA_Inst *inst) {
+  if (inst->t != INST_IDIV && inst->t != INST_UDIV) {
+    return false;
+  }
+  if (inst->data.operands[1] == 0) {
+    return true;
+  }
+  SSA_Inst *divisor = ssa_reg_def(fn, inst->data.operands[1]);
+  if (divisor == NULL || divisor->t != INST_IMM) {
+    return true;
+  }
+  uint64_t value = inst_imm(fn, divisor) & sz_mask(inst->sz);
+  return value == 0 || (inst->t == INST_IDIV && value == sz_mask(inst->sz));
+}
+
+/* whether the instruction has to stay whatever uses its result. Until there
+ * is anything to tell which functions are pure, every call is kept, and
+ * branches are kept since they decide which blocks run. So is a division
+ * that may trap, as it would when the program runs */
+static bool
+is_root(SSA_Fn *fn, SSA_Inst *inst) {
+  return inst->t == INST_RET || inst->t == INST_CALLFN ||
+         inst->t == INST_BR || inst->t == INST_CBR || may_trap(fn, inst);
+}
+
+/* marks the operands of a live instruction as live */
+static void
+mark_operands(SSA_Fn *fn, SSA_Inst *inst, uint8_t *live, RegId *stack,
+              size_t *depth) {
+  for (size_t i = 0; i < inst_operand_count(fn, inst); i++) {
+    RegId reg = *inst_operand(fn, inst, i);
+    if (!live[reg]) {
+      live[reg] = 1;
+      stack[(*depth)++] = reg;
+    }
+  }
+}
+
+/* what follows a ret in its block is never run. It is only taken out of the
+ * blocks that end in a ret, so that the edges of the block stay the same */
+static void
+remove_after_ret(SSA_Fn *fn, SSA_BBlock *block) {
+  if (block->last == NULL || block->last->t != INST_RET) {
+    return;
+  }
+  SSA_Inst *inst = block->first;
+  while (inst->t != INST_RET) {
+    inst = inst->next;
+  }
+  for (inst = inst->next; inst != NULL; inst = inst->next) {
+    bblock_remove_inst(fn, block, inst);
+  }
+}
+
+void
+pass_dce(SSA_Fn *fn, PassContext *pc) {
+  if (!fn->has_uses) {
+    ssa_fn_build_uses(fn, pc->pool);
+  }
+  size_t nregs = fn->regs.items;
+  uint8_t *live = mempool_alloc(pc->scratch, nregs + 1);
+  memset(live, 0, nregs + 1);
+  /* 0 stands for no register, which is never looked for */
+  live[0] = 1;
+  /* every register is pushed once at most */
+  RegId *stack = mempool_alloc(pc->scratch, (nregs + 1) * sizeof(RegId));
+  size_t depth = 0;
+
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    remove_after_ret(fn, block);
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      if (is_root(fn, inst)) {
+        /* its operands are marked right away, so it isn't pushed */
+        live[inst->result] = 1;
+        mark_operands(fn, inst, live, stack, &depth);
+      }
+    }
+  }
+  /* register 0 is live from the start, so it is never pushed */
+  while (depth != 0) {
+    SSA_Inst *def = ssa_reg_def(fn, stack[--depth]);
+    if (def != NULL) {
+      mark_operands(fn, def, live, stack, &depth);
+    }
+  }
+
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      /* the roots with results are live, and the divisors of divisions
+       * may be gone by now */
+      if (inst->result != 0 ? !live[inst->result] : !is_root(fn, inst)) {
+        bblock_remove_inst(fn, block, inst);
+      }
+    }
+  }
+}
+
+void
+pass_copy_prop(SSA_Fn *fn, PassContext *pc) {
+  if (!fn->has_uses) {
+    ssa_fn_build_uses(fn, pc->pool);
+  }
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      RegId from = inst->data.operands[0];
+      /* a copy of itself is only found in code that is never run */
+      if (inst->t != INST_COPY || inst->result == 0 || from == 0 ||
+          from == inst->result) {
+        continue;
+      }
+      ssa_replace_all_uses(fn, inst->result, from);
+      bblock_remove_inst(fn, block, inst);
+    }
+  }
+}
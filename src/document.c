@@ -0,0 +1,466 @@
+#include "document.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "parser.h"
+
+/* the part of an edited region that becomes one chunk */
+typedef struct {
+  size_t start; /* byte offsets in the region */
+  size_t end;
+  size_t first_tok;
+  size_t ntoks; /* not counting TOK_EOF */
+  bool has_fn;
+} Group;
+
+static size_t
+count_lines(const uint8_t *text, size_t sz) {
+  size_t lines = 0;
+  const uint8_t *end = text + sz;
+  while ((text = memchr(text, '\n', end - text)) != NULL) {
+    lines++;
+    text++;
+  }
+  return lines;
+}
+
+/* adds delta to the i'th of n chunks, negative deltas wrap around, which
+ * still adds up */
+static void
+tree_add(size_t *tree, size_t n, size_t i, size_t delta) {
+  for (i++; i <= n; i += i & -i) {
+    tree[i] += delta;
+  }
+}
+
+/* the sum over the first n chunks */
+static size_t
+tree_sum(const size_t *tree, size_t n) {
+  size_t sum = 0;
+  for (; n != 0; n -= n & -n) {
+    sum += tree[n];
+  }
+  return sum;
+}
+
+/* builds both trees again in linear time, for when chunks were added or
+ * removed */
+static void
+trees_build(Document *doc) {
+  size_t n = doc->nchunks;
+  for (size_t i = 1; i <= n; i++) {
+    doc->sz_tree[i] = doc->chunks[i - 1].sz;
+    doc->lines_tree[i] = doc->chunks[i - 1].nlines;
+  }
+  for (size_t i = 1; i <= n; i++) {
+    size_t parent = i + (i & -i);
+    if (parent <= n) {
+      doc->sz_tree[parent] += doc->sz_tree[i];
+      doc->lines_tree[parent] += doc->lines_tree[i];
+    }
+  }
+}
+
+static size_t
+chunk_offset(Document *doc, size_t i) {
+  return tree_sum(doc->sz_tree, i);
+}
+
+static size_t
+chunk_first_line(Document *doc, size_t i) {
+  return tree_sum(doc->lines_tree, i) + 1;
+}
+
+/* the chunk holding the byte at offset, or the last one past the end. Walks
+ * down the tree to the most chunks that end at or before offset */
+static size_t
+chunk_at(Document *doc, size_t offset) {
+  size_t n = doc->nchunks;
+  size_t step = 1;
+  while (step <= n / 2) {
+    step *= 2;
+  }
+  size_t before = 0;
+  for (; step != 0; step /= 2) {
+    if (before + step <= n && doc->sz_tree[before + step] <= offset) {
+      before += step;
+      offset -= doc->sz_tree[before];
+    }
+  }
+  return before < n ? before : n - 1;
+}
+
+static bool
+in_chunk(DocChunk *chunk, SourcePosition pos) {
+  uintptr_t at = (uintptr_t)pos.start;
+  uintptr_t start = (uintptr_t)chunk->text;
+  return at >= start && at <= start + chunk->sz;
+}
+
+/* positions in a chunk count their lines from its first line. Those in a
+ * region being lexed already count from the start of the document. Only
+ * called for diagnostics, so finding the chunk can take a while */
+static size_t
+diag_line(void *data, SourcePosition pos) {
+  Document *doc = data;
+  if (doc->parsing != NULL && in_chunk(doc->parsing, pos)) {
+    return doc->parsing_line + pos.line - 1;
+  }
+  for (size_t i = 0; i < doc->nchunks; i++) {
+    if (in_chunk(&doc->chunks[i], pos)) {
+      return chunk_first_line(doc, i) + pos.line - 1;
+    }
+  }
+  return pos.line;
+}
+
+/* lexes text as if it started a chunk, returns false on errors */
+static bool
+lex_region(Document *doc, const uint8_t *text, size_t sz, size_t first_line,
+           Token **toks, size_t *ntoks) {
+  BoncContext *ctx = doc->ctx;
+  jmp_buf *prev_bailout = ctx->bailout;
+  jmp_buf bailout;
+  Lexer lex;
+
+  *ntoks = 0;
+  *toks = malloc(sizeof(Token) * 64);
+  errors_clear(ctx);
+  if (setjmp(bailout)) {
+    ctx->bailout = prev_bailout;
+    return false;
+  }
+  ctx->bailout = &bailout;
+
+  lexer_init(&lex, ctx, text, sz);
+  lex.line = first_line;
+  lex.prev = TOK_RCURLY;
+  size_t alloc = 64;
+  do {
+    if (*ntoks == alloc) {
+      alloc *= 2;
+      *toks = realloc(*toks, sizeof(Token) * alloc);
+    }
+    (*toks)[*ntoks] = lexer_next(&lex);
+  } while ((*toks)[(*ntoks)++].t != TOK_EOF);
+
+  ctx->bailout = prev_bailout;
+  return true;
+}
+
+/* splits the tokens after each '}', the whitespace after a function belongs to
+ * it. Returns the number of groups, or 0 if the region needs to be extended
+ * first */
+static size_t
+group_region(Token *toks, size_t ntoks, const uint8_t *text, size_t sz,
+             Group *groups, bool is_last) {
+  size_t ngroups = 0;
+  size_t first_tok = 0;
+  size_t start = 0;
+  for (size_t i = 0; i + 1 < ntoks; i++) {
+    if (toks[i].t != TOK_RCURLY) {
+      continue;
+    }
+    size_t end = toks[i + 1].pos.start - text;
+    groups[ngroups++] = (Group){start, end, first_tok, i + 1 - first_tok, true};
+    first_tok = i + 1;
+    start = end;
+  }
+
+  /* tokens after the last '}' are an unfinished function */
+  if (first_tok + 1 < ntoks) {
+    if (!is_last) {
+      return 0;
+    }
+    groups[ngroups++] =
+        (Group){start, sz, first_tok, ntoks - 1 - first_tok, true};
+  } else if (ngroups != 0) {
+    groups[ngroups - 1].end = sz;
+  }
+  return ngroups;
+}
+
+static DocChunk
+make_chunk(const uint8_t *region, Token *toks, Group *group, size_t first_line,
+           size_t lines_before) {
+  DocChunk chunk;
+  chunk.sz = group->end - group->start;
+  chunk.text = malloc(chunk.sz + 1);
+  memcpy(chunk.text, region + group->start, chunk.sz);
+  chunk.nlines = count_lines(chunk.text, chunk.sz);
+  chunk.broken = false;
+
+  chunk.ntoks = group->ntoks + 1;
+  chunk.toks = malloc(sizeof(Token) * chunk.ntoks);
+  for (size_t i = 0; i < group->ntoks; i++) {
+    Token tok = toks[group->first_tok + i];
+    tok.pos.start = chunk.text + (tok.pos.start - region - group->start);
+    tok.pos.line -= first_line - 1 + lines_before;
+    chunk.toks[i] = tok;
+  }
+  chunk.toks[group->ntoks] = (Token){
+      .t = TOK_EOF,
+      .pos = make_pos(chunk.text + chunk.sz, 0, chunk.nlines + 1),
+  };
+  return chunk;
+}
+
+/* the function keeps the lines of the tokens, which count from the chunk's
+ * first line */
+static bool
+parse_chunk(Document *doc, DocChunk *chunk, size_t first_line, Function *fn) {
+  BoncContext *ctx = doc->ctx;
+  jmp_buf *prev_bailout = ctx->bailout;
+  jmp_buf bailout;
+
+  errors_clear(ctx);
+  lexer_init_tokens(&ctx->lex, ctx, chunk->toks, chunk->ntoks, 0);
+  memset(fn, 0, sizeof(Function));
+  doc->parsing = chunk;
+  doc->parsing_line = first_line;
+  if (setjmp(bailout)) {
+    ctx->bailout = prev_bailout;
+    doc->parsing = NULL;
+    memset(fn, 0, sizeof(Function));
+    return false;
+  }
+  ctx->bailout = &bailout;
+  parse_fn(&doc->ast, fn);
+  ctx->bailout = prev_bailout;
+  doc->parsing = NULL;
+  return true;
+}
+
+static void
+chunk_free(DocChunk *chunk) {
+  free(chunk->text);
+  free(chunk->toks);
+}
+
+/* replaces the chunks in [first, last] and their functions */
+static void
+splice_chunks(Document *doc, size_t first, size_t last, DocChunk *chunks,
+              Function *fns, size_t nchunks, size_t nfns) {
+  size_t old_nchunks = last - first + 1;
+  size_t old_nfns = 0;
+  for (size_t i = first; i <= last; i++) {
+    old_nfns += i < doc->ast.fns.items;
+    doc->nbroken -= doc->chunks[i].broken;
+    /* with as many chunks as before, only the ones replaced change */
+    if (nchunks == old_nchunks) {
+      DocChunk *chunk = &chunks[i - first];
+      tree_add(doc->sz_tree, doc->nchunks, i, chunk->sz - doc->chunks[i].sz);
+      tree_add(doc->lines_tree, doc->nchunks, i,
+               chunk->nlines - doc->chunks[i].nlines);
+    }
+    chunk_free(&doc->chunks[i]);
+  }
+
+  size_t new_total = doc->nchunks - old_nchunks + nchunks;
+  if (new_total > doc->chunks_alloc) {
+    doc->chunks_alloc = new_total * 2;
+    doc->chunks = realloc(doc->chunks, sizeof(DocChunk) * doc->chunks_alloc);
+    doc->sz_tree =
+        realloc(doc->sz_tree, sizeof(size_t) * (doc->chunks_alloc + 1));
+    doc->lines_tree =
+        realloc(doc->lines_tree, sizeof(size_t) * (doc->chunks_alloc + 1));
+  }
+  memmove(&doc->chunks[first + nchunks], &doc->chunks[last + 1],
+          sizeof(DocChunk) * (doc->nchunks - last - 1));
+  memcpy(&doc->chunks[first], chunks, sizeof(DocChunk) * nchunks);
+  doc->nchunks = new_total;
+  if (nchunks != old_nchunks) {
+    trees_build(doc);
+  }
+  for (size_t i = 0; i < nchunks; i++) {
+    doc->nbroken += chunks[i].broken;
+  }
+
+  Vector *ast_fns = &doc->ast.fns;
+  size_t same = old_nfns < nfns ? old_nfns : nfns;
+  for (size_t i = 0; i < same; i++) {
+    *(Function *)vector_idx(ast_fns, first + i) = fns[i];
+  }
+  for (size_t i = same; i < nfns; i++) {
+    vector_insert(ast_fns, first + i, &fns[i]);
+  }
+  for (size_t i = same; i < old_nfns; i++) {
+    vector_remove(ast_fns, first + same);
+  }
+}
+
+bool
+document_edit(Document *doc, size_t offset, size_t removed,
+              const uint8_t *inserted, size_t inserted_sz) {
+  if (offset > doc->sz || removed > doc->sz - offset) {
+    log_internal_err("edit out of bounds of the document", NULL);
+  }
+
+  /* the bytes on both sides of the edit are included, since the edit can
+   * join tokens with them */
+  size_t first = chunk_at(doc, offset == 0 ? 0 : offset - 1);
+  size_t last = chunk_at(doc, offset + removed);
+
+  uint8_t *region;
+  size_t region_sz;
+  Token *toks;
+  size_t ntoks;
+  Group *groups;
+  size_t ngroups;
+  bool lexed;
+  size_t region_offset;
+  size_t region_first_line;
+  while (1) {
+    region_offset = chunk_offset(doc, first);
+    region_first_line = chunk_first_line(doc, first);
+    size_t old_sz = chunk_offset(doc, last + 1) - region_offset;
+    size_t local = offset - region_offset;
+
+    region_sz = old_sz - removed + inserted_sz;
+    region = malloc((old_sz > region_sz ? old_sz : region_sz) + 1);
+    uint8_t *iter = region;
+    for (size_t i = first; i <= last; i++) {
+      memcpy(iter, doc->chunks[i].text, doc->chunks[i].sz);
+      iter += doc->chunks[i].sz;
+    }
+    memmove(region + local + inserted_sz, region + local + removed,
+            old_sz - local - removed);
+    memcpy(region + local, inserted, inserted_sz);
+
+    lexed = lex_region(doc, region, region_sz, region_first_line, &toks,
+                       &ntoks);
+    if (!lexed) {
+      break;
+    }
+    bool is_last = last + 1 == doc->nchunks;
+    groups = malloc(sizeof(Group) * ntoks);
+    ngroups = group_region(toks, ntoks, region, region_sz, groups, is_last);
+    if (ngroups != 0) {
+      break;
+    }
+    if (is_last && first == 0) {
+      /* nothing but whitespace is left in the document */
+      groups[0] = (Group){0, region_sz, 0, 0, false};
+      ngroups = 1;
+      break;
+    }
+    free(groups);
+    free(toks);
+    free(region);
+
+    /* the region is unfinished, or just whitespace, which belongs to the
+     * functions around it */
+    if (!is_last) {
+      last++;
+    } else {
+      first--;
+    }
+  }
+
+  bool ok = true;
+  DocChunk *chunks;
+  Function *fns;
+  size_t nfns = 0;
+  if (!lexed) {
+    /* kept as one broken function until it's edited again */
+    Group whole = {0, region_sz, 0, 0, true};
+    ngroups = 1;
+    chunks = malloc(sizeof(DocChunk));
+    fns = calloc(1, sizeof(Function));
+    chunks[0] = make_chunk(region, NULL, &whole, region_first_line, 0);
+    chunks[0].broken = true;
+    nfns = 1;
+    ok = false;
+  } else {
+    chunks = malloc(sizeof(DocChunk) * ngroups);
+    fns = malloc(sizeof(Function) * ngroups);
+    size_t lines_before = 0;
+    size_t counted = 0;
+    for (size_t i = 0; i < ngroups; i++) {
+      lines_before += count_lines(region + counted, groups[i].start - counted);
+      counted = groups[i].start;
+      chunks[i] = make_chunk(region, toks, &groups[i], region_first_line,
+                             lines_before);
+      if (groups[i].has_fn) {
+        chunks[i].broken =
+            !parse_chunk(doc, &chunks[i], region_first_line + lines_before,
+                         &fns[nfns++]);
+        ok &= !chunks[i].broken;
+      }
+    }
+    free(groups);
+  }
+  free(toks);
+  free(region);
+
+  splice_chunks(doc, first, last, chunks, fns, ngroups, nfns);
+  free(chunks);
+  free(fns);
+  doc->sz += inserted_sz - removed;
+  return ok;
+}
+
+bool
+document_init(Document *doc, BoncContext *ctx, const uint8_t *src,
+              size_t sz) {
+  doc->ctx = ctx;
+  ast_init(&doc->ast, ctx);
+  doc->chunks_alloc = 16;
+  doc->chunks = malloc(sizeof(DocChunk) * doc->chunks_alloc);
+  doc->sz_tree = malloc(sizeof(size_t) * (doc->chunks_alloc + 1));
+  doc->lines_tree = malloc(sizeof(size_t) * (doc->chunks_alloc + 1));
+  doc->nchunks = 1;
+  doc->sz = 0;
+  doc->nbroken = 0;
+  doc->parsing = NULL;
+  ctx->diag_line = diag_line;
+  ctx->diag_line_data = doc;
+
+  Group empty = {0, 0, 0, 0, false};
+  doc->chunks[0] = make_chunk((const uint8_t *)"", NULL, &empty, 1, 0);
+  trees_build(doc);
+  return document_edit(doc, 0, 0, src, sz);
+}
+
+bool
+document_report(Document *doc) {
+  for (size_t i = 0; i < doc->nchunks; i++) {
+    DocChunk *chunk = &doc->chunks[i];
+    if (!chunk->broken) {
+      continue;
+    }
+    Token *toks;
+    size_t ntoks;
+    /* a chunk that lexes is broken because it doesn't parse. Its text is
+     * lexed as it is in the chunk, so the lines count from its first */
+    if (lex_region(doc, chunk->text, chunk->sz, 1, &toks, &ntoks)) {
+      Function fn;
+      parse_chunk(doc, chunk, chunk_first_line(doc, i), &fn);
+    }
+    free(toks);
+    return false;
+  }
+  return true;
+}
+
+void
+document_write(Document *doc, FILE *file) {
+  for (size_t i = 0; i < doc->nchunks; i++) {
+    fwrite(doc->chunks[i].text, 1, doc->chunks[i].sz, file);
+  }
+}
+
+void
+document_deinit(Document *doc) {
+  for (size_t i = 0; i < doc->nchunks; i++) {
+    chunk_free(&doc->chunks[i]);
+  }
+  free(doc->chunks);
+  free(doc->sz_tree);
+  free(doc->lines_tree);
+  doc->ctx->diag_line = NULL;
+  ast_deinit(&doc->ast);
+}
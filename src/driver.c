@@ -0,0 +1,519 @@
+#define _GNU_SOURCE
+#include "driver.h"
+
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "cfg.h"
+#include "error.h"
+#include "incremental.h"
+#include "ir_gen.h"
+#include "parser.h"
+#include "per_function.h"
+#include "semantics.h"
+#include "ssa.h"
+#include "ssa_bin.h"
+#include "ssa_parser.h"
+#include "stream.h"
+#include "threadpool.h"
+#include "token_ring.h"
+
+static const char *phase_name_tbl[] = {
+    [PHASE_READ] = "read",       [PHASE_CACHE] = "cache",
+    [PHASE_PARSE] = "parse",     [PHASE_NAMES] = "resolve names",
+    [PHASE_TYPES] = "resolve types", [PHASE_RETURNS] = "check returns",
+    [PHASE_IR] = "translate ir", [PHASE_OPT] = "optimize",
+    [PHASE_DUMP] = "dump",
+};
+
+typedef struct {
+  CompileJob *jobs;
+  CompileOptions *opts;
+} JobList;
+
+/* the source of a job. Regular files are mapped, anything else is streamed */
+typedef struct {
+  const uint8_t *src;
+  size_t sz;
+  bool mapped;
+  InputStream stream;
+} JobInput;
+
+uint64_t
+time_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+time_report_phase(TimeReport *times, CompilePhase phase, uint64_t *start) {
+  if (times == NULL) {
+    return;
+  }
+  uint64_t end = time_now_ns();
+  times->phase_ns[phase] += end - *start;
+  *start = end;
+}
+
+/* optimizes a translated program and writes out everything requested of it,
+ * charging both to their phases */
+static void
+output_prog(CompileOptions *opts, SSA_Prog *prog, MemPool *scratch,
+            FILE *out, TimeReport *times, uint64_t *start) {
+  /* the pools of the pass manager hold what the passes added to the program,
+   * so they are only freed once it has been written out */
+  PassManager pm;
+  pass_manager_init(&pm, &opts->passes, opts->pass_workers);
+  if (opts->passes.npasses != 0) {
+    pass_manager_run(&pm, prog);
+    time_report_passes(times, &pm);
+    time_report_phase(times, PHASE_OPT, start);
+  }
+
+  if (opts->dump_ir) {
+    Emitter em;
+    emitter_init(&em, out);
+    emit_str(&em, "IR_DUMP:\n");
+    ssa_prog_dump(&em, prog, opts->dump_reg);
+    emitter_deinit(&em);
+  }
+  if (opts->dump_cfg) {
+    Emitter em;
+    emitter_init(&em, out);
+    emit_str(&em, "CFG_DUMP:\n");
+    for (size_t i = 0; i < prog->fns.items; i++) {
+      SSA_Fn *fn = vector_idx(&prog->fns, i);
+      cfg_build(fn, &prog->pool, scratch);
+      cfg_dominators(fn, &prog->pool, scratch);
+      cfg_frontiers(fn, &prog->pool, scratch);
+      cfg_dump(&em, fn);
+    }
+    emitter_deinit(&em);
+  }
+  if (opts->ssa_bin_out != NULL) {
+    Emitter em;
+    emitter_init(&em, opts->ssa_bin_out);
+    ssa_bin_write(&em, prog);
+    emitter_deinit(&em);
+  }
+  time_report_phase(times, PHASE_DUMP, start);
+  pass_manager_deinit(&pm);
+}
+
+/* the parts of compile_source that can bail out, the AST and SSA program are
+ * owned by the caller so that they are released either way. The AST is only
+ * parsed if parse is set, otherwise it must already be */
+static bool
+run_pipeline(BoncContext *ctx, CompileOptions *opts, FILE *out, AST *ast,
+             SSA_Prog *prog, bool parse, TimeReport *times) {
+  jmp_buf bailout;
+  if (setjmp(bailout)) {
+    ctx->bailout = NULL;
+    return false;
+  }
+  ctx->bailout = &bailout;
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+
+  if (parse) {
+    parse_ast(ast);
+
+    errors_output(ctx);
+    time_report_phase(times, PHASE_PARSE, &start);
+  }
+
+  resolve_names(ast);
+  time_report_phase(times, PHASE_NAMES, &start);
+  resolve_types(ast);
+  time_report_phase(times, PHASE_TYPES, &start);
+  check_returns(ast);
+  time_report_phase(times, PHASE_RETURNS, &start);
+
+  if (opts->dump_ast) {
+    Emitter em;
+    emitter_init(&em, out);
+    emit_str(&em, "AST_DUMP:\n");
+    ast_dump(&em, ast);
+    emit_char(&em, '\n');
+    emitter_deinit(&em);
+  }
+  time_report_phase(times, PHASE_DUMP, &start);
+
+  translate_ast(ast, prog);
+  time_report_phase(times, PHASE_IR, &start);
+
+  output_prog(opts, prog, &ctx->scratch, out, times, &start);
+  ctx->bailout = NULL;
+  return true;
+}
+
+bool
+compile_source(BoncContext *ctx, CompileOptions *opts, FILE *out,
+               TimeReport *times) {
+  AST ast;
+  SSA_Prog prog;
+  prog.pool.base = NULL;
+  ast_init(&ast, ctx);
+  TokenRing *ring = opts->lex_thread ? token_ring_start(ctx) : NULL;
+
+  bool ok = run_pipeline(ctx, opts, out, &ast, &prog, true, times);
+
+  if (ring != NULL) {
+    token_ring_stop(ring);
+  }
+  if (prog.pool.base != NULL) {
+    bonc_context_pool_put(ctx, &prog.pool);
+  }
+  ast_deinit(&ast);
+  return ok;
+}
+
+/* the parts of compile_ir that can bail out, the program is owned by the
+ * caller */
+static bool
+run_ir_pipeline(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                SSA_Prog *prog, TimeReport *times) {
+  jmp_buf bailout;
+  if (setjmp(bailout)) {
+    ctx->bailout = NULL;
+    return false;
+  }
+  ctx->bailout = &bailout;
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+
+  parse_ssa(ctx, prog);
+  time_report_phase(times, PHASE_PARSE, &start);
+  /* hand written IR can be anything the reader takes, which the passes
+   * don't, so it's checked first and counted as part of optimizing */
+  if (opts->passes.npasses != 0 &&
+      !ssa_prog_verify(prog, &ctx->scratch, ctx->filename)) {
+    ctx->bailout = NULL;
+    return false;
+  }
+  output_prog(opts, prog, &ctx->scratch, out, times, &start);
+  ctx->bailout = NULL;
+  return true;
+}
+
+bool
+compile_ir(BoncContext *ctx, CompileOptions *opts, FILE *out,
+           TimeReport *times) {
+  SSA_Prog prog;
+  prog.pool.base = NULL;
+  bool ok = run_ir_pipeline(ctx, opts, out, &prog, times);
+  if (prog.pool.base != NULL) {
+    bonc_context_pool_put(ctx, &prog.pool);
+  }
+  return ok;
+}
+
+bool
+compile_document(Document *doc, CompileOptions *opts, FILE *out,
+                 TimeReport *times) {
+  BoncContext *ctx = doc->ctx;
+  if (!document_report(doc)) {
+    return false;
+  }
+  SSA_Prog prog;
+  prog.pool.base = NULL;
+
+  errors_clear(ctx);
+  bool ok = run_pipeline(ctx, opts, out, &doc->ast, &prog, false, times);
+
+  if (prog.pool.base != NULL) {
+    bonc_context_pool_put(ctx, &prog.pool);
+  }
+  return ok;
+}
+
+bool
+compile_ssa_bin(const char *filename, CompileOptions *opts, FILE *out,
+                TimeReport *times) {
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    log_err("unable to open '%s'", filename);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    log_err("unable to get stats on '%s'", filename);
+    close(fd);
+    return false;
+  }
+  /* names are left in the mapping, so it's kept until the program is done */
+  size_t sz = st.st_size;
+  uint8_t *data = NULL;
+  if (sz != 0) {
+    data = mmap(NULL, sz, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    log_err("unable to get contents of '%s'", filename);
+    return false;
+  }
+  time_report_phase(times, PHASE_READ, &start);
+
+  SSA_Prog prog;
+  const char *error = ssa_bin_load(&prog, data, sz);
+  time_report_phase(times, PHASE_IR, &start);
+  bool ok = error == NULL;
+  if (ok) {
+    MemPool scratch;
+    mempool_init(&scratch);
+    /* a file can hold whatever it was written with, which the passes might
+     * not take, so it's checked as for IR read from text */
+    ok = opts->passes.npasses == 0 ||
+         ssa_prog_verify(&prog, &scratch, filename);
+    if (ok) {
+      output_prog(opts, &prog, &scratch, out, times, &start);
+    }
+    mempool_deinit(&scratch);
+    ssa_prog_deinit(&prog);
+  } else {
+    log_err("'%s': %s", filename, error);
+  }
+  if (data != NULL) {
+    munmap(data, sz);
+  }
+  return ok;
+}
+
+static void
+job_input_close(JobInput *input) {
+  if (input->mapped) {
+    munmap((uint8_t *)input->src, input->sz);
+  } else {
+    close(input->stream.fd);
+    input_stream_deinit(&input->stream);
+  }
+}
+
+/* opens the input of a job, "-" being stdin. Unless whole is set, a streamed
+ * input is read by the lexer as it goes. Returns the error, NULL if there is
+ * none, in which case the input has to be closed */
+static const char *
+job_input_open(JobInput *input, const char *filename, bool whole) {
+  int fd = strcmp(filename, "-") == 0 ? dup(STDIN_FILENO)
+                                      : open(filename, O_RDONLY);
+  if (fd == -1) {
+    return "unable to open '%s'";
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return "unable to get stats on '%s'";
+  }
+
+  input->mapped = S_ISREG(st.st_mode) && st.st_size != 0;
+  if (!input->mapped) {
+    input_stream_init(&input->stream, fd);
+    if (whole) {
+      input_stream_read_all(&input->stream);
+    }
+    input->src = input->stream.base;
+    input->sz = input->stream.sz;
+    const char *error = input->stream.error;
+    if (error != NULL) {
+      job_input_close(input);
+    }
+    return error;
+  }
+
+  input->sz = st.st_size;
+  /* the whole file is read front to back, so it is faulted in up front */
+  input->src =
+      mmap(NULL, input->sz, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (input->src == MAP_FAILED) {
+    return "unable to get contents of '%s'";
+  }
+  madvise((uint8_t *)input->src, input->sz, MADV_SEQUENTIAL);
+  return NULL;
+}
+
+static void
+compile_job(void *data, size_t idx) {
+  JobList *list = data;
+  CompileJob *job = &list->jobs[idx];
+  /* incremental compilation keeps its own entries, which would only be
+   * duplicated by one for the whole file */
+  const char *cache_dir =
+      list->opts->incremental ? NULL : list->opts->cache_dir;
+  TimeReport *times = &job->times;
+  uint64_t start = time_now_ns();
+
+  job->failed = true;
+  job->output = NULL;
+  job->output_sz = 0;
+  job->output_map = NULL;
+
+  /* the cache and incremental compilation hash the whole source first, and
+   * IR is only parsed once it's all there */
+  bool whole = list->opts->cache_dir != NULL || list->opts->from_ir;
+  JobInput input;
+  job->io_error = job_input_open(&input, job->filename, whole);
+  if (job->io_error != NULL) {
+    return;
+  }
+  time_report_phase(times, PHASE_READ, &start);
+
+  uint8_t key[CACHE_KEY_SZ];
+  if (cache_dir != NULL) {
+    CachedOutput cached;
+    cache_key(key, input.src, input.sz, list->opts);
+    if (cache_load(cache_dir, key, &cached)) {
+      job->failed = false;
+      job->output = (char *)cached.output;
+      job->output_sz = cached.output_sz;
+      job->output_map = cached.map;
+      job->output_map_sz = cached.map_sz;
+      times->cache_hits++;
+      time_report_phase(times, PHASE_CACHE, &start);
+      job_input_close(&input);
+      return;
+    }
+    times->cache_misses++;
+    time_report_phase(times, PHASE_CACHE, &start);
+  }
+
+  FILE *out = open_memstream(&job->output, &job->output_sz);
+  if (out == NULL) {
+    log_internal_err("unable to open output stream", NULL);
+  }
+
+  BoncContext ctx;
+  const char *name = strcmp(job->filename, "-") == 0 ? "<stdin>" : job->filename;
+  bonc_context_init(&ctx, input.src, input.sz, name, out);
+  if (!input.mapped && !whole) {
+    lexer_init_stream(&ctx.lex, &ctx, &input.stream);
+  }
+  if (list->opts->from_ir) {
+    job->failed = !compile_ir(&ctx, list->opts, out, times);
+  } else if (list->opts->incremental) {
+    job->failed = !compile_incremental(&ctx, list->opts, out, times);
+  } else if (list->opts->per_function) {
+    job->failed = !compile_per_function(&ctx, list->opts, out, times);
+  } else {
+    job->failed = !compile_source(&ctx, list->opts, out, times);
+  }
+  bonc_context_deinit(&ctx);
+
+  fclose(out);
+  if (!input.mapped && input.stream.error != NULL) {
+    /* the input was cut short, so whatever was compiled doesn't count */
+    job->io_error = input.stream.error;
+    job->failed = true;
+    free(job->output);
+    job->output = NULL;
+  }
+  job_input_close(&input);
+
+  if (cache_dir != NULL && !job->failed) {
+    start = time_now_ns();
+    cache_store(cache_dir, key, job->output, job->output_sz);
+    time_report_phase(times, PHASE_CACHE, &start);
+  }
+}
+
+void
+compile_jobs(CompileJob *jobs, size_t njobs, CompileOptions *opts,
+             size_t nworkers) {
+  JobList list = {.jobs = jobs, .opts = opts};
+  for (size_t i = 0; i < njobs; i++) {
+    jobs[i].io_error = NULL;
+    memset(&jobs[i].times, 0, sizeof(TimeReport));
+  }
+  threadpool_run(njobs, nworkers, compile_job, &list);
+}
+
+void
+compile_job_release(CompileJob *job) {
+  if (job->output_map != NULL) {
+    munmap(job->output_map, job->output_map_sz);
+  } else {
+    free(job->output);
+  }
+  job->output = NULL;
+}
+
+static void
+add_pass_stats(PassStats *to, const PassStats *from) {
+  for (int i = 0; i < PASS_COUNT; i++) {
+    to[i].runs += from[i].runs;
+    to[i].ns += from[i].ns;
+    to[i].added += from[i].added;
+    to[i].removed += from[i].removed;
+  }
+}
+
+void
+time_report_add(TimeReport *total, TimeReport *report) {
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    total->phase_ns[i] += report->phase_ns[i];
+  }
+  total->cache_hits += report->cache_hits;
+  total->cache_misses += report->cache_misses;
+  total->fn_cache_hits += report->fn_cache_hits;
+  total->fn_cache_misses += report->fn_cache_misses;
+  add_pass_stats(total->passes, report->passes);
+}
+
+void
+time_report_passes(TimeReport *times, PassManager *pm) {
+  if (times != NULL) {
+    add_pass_stats(times->passes, pm->stats);
+  }
+}
+
+void
+time_report_print(FILE *file, TimeReport *report, uint64_t wall_ns,
+                  bool cache_used) {
+  uint64_t total = 0;
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    total += report->phase_ns[i];
+  }
+  fprintf(file, "time report (summed over all files):\n");
+  for (int i = 0; i < PHASE_COUNT; i++) {
+    if (i == PHASE_CACHE && !cache_used) {
+      continue;
+    }
+    fprintf(file, "  %-16s %10.3f ms %5.1f%%\n", phase_name_tbl[i],
+            report->phase_ns[i] / 1e6,
+            total == 0 ? 0.0 : report->phase_ns[i] * 100.0 / total);
+  }
+  fprintf(file, "  %-16s %10.3f ms\n", "total", total / 1e6);
+  fprintf(file, "  %-16s %10.3f ms\n", "wall", wall_ns / 1e6);
+  if (report->cache_hits + report->cache_misses != 0) {
+    fprintf(file, "cache: %zu hit%s, %zu miss%s\n", report->cache_hits,
+            report->cache_hits == 1 ? "" : "s", report->cache_misses,
+            report->cache_misses == 1 ? "" : "es");
+  }
+  if (report->fn_cache_hits + report->fn_cache_misses != 0) {
+    fprintf(file, "functions: %zu reused, %zu recompiled\n",
+            report->fn_cache_hits, report->fn_cache_misses);
+  }
+  bool header = false;
+  for (int i = 0; i < PASS_COUNT; i++) {
+    PassStats *stats = &report->passes[i];
+    if (stats->runs == 0) {
+      continue;
+    }
+    if (!header) {
+      fprintf(file, "passes (time summed over all workers):\n");
+      header = true;
+    }
+    fprintf(file, "  %-16s %10.3f ms %8zu runs  +%zu -%zu instructions\n",
+            pass_tbl[i].name, stats->ns / 1e6, stats->runs, stats->added,
+            stats->removed);
+  }
+}
@@ -0,0 +1,98 @@
+#include "emit.h"
+
+#include <stdlib.h>
+
+/* the digits of every number from 00 to 99, so two are written at a time */
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+void
+emitter_init(Emitter *em, FILE *file) {
+  em->file = file;
+  em->len = 0;
+  /* in memory, the buffer starts small since it's kept around once taken */
+  em->alloc = file == NULL ? 4096 : EMIT_CHUNK;
+  em->buf = malloc(em->alloc);
+  if (em->buf == NULL) {
+    log_internal_err("unable to allocate output buffer", NULL);
+  }
+}
+
+void
+emitter_flush(Emitter *em) {
+  if (em->file != NULL && em->len != 0) {
+    fwrite(em->buf, 1, em->len, em->file);
+    em->len = 0;
+  }
+}
+
+void
+emitter_deinit(Emitter *em) {
+  emitter_flush(em);
+  free(em->buf);
+  em->buf = NULL;
+}
+
+char *
+emitter_take(Emitter *em, size_t *sz) {
+  char *buf = em->buf;
+  *sz = em->len;
+  em->buf = NULL;
+  em->len = 0;
+  em->alloc = 0;
+  return buf;
+}
+
+void
+emitter_reserve(Emitter *em, size_t sz) {
+  emitter_flush(em);
+  if (em->alloc - em->len >= sz) {
+    return;
+  }
+  size_t alloc = em->alloc == 0 ? 4096 : em->alloc;
+  while (alloc - em->len < sz) {
+    alloc *= 2;
+  }
+  em->buf = realloc(em->buf, alloc);
+  if (em->buf == NULL) {
+    log_internal_err("unable to allocate output buffer", NULL);
+  }
+  em->alloc = alloc;
+}
+
+void
+emit_u64(Emitter *em, uint64_t num) {
+  char digits[20];
+  char *iter = digits + sizeof(digits);
+  while (num >= 100) {
+    iter -= 2;
+    memcpy(iter, &digit_pairs[(num % 100) * 2], 2);
+    num /= 100;
+  }
+  if (num >= 10) {
+    iter -= 2;
+    memcpy(iter, &digit_pairs[num * 2], 2);
+  } else {
+    *--iter = (char)('0' + num);
+  }
+  emit_mem(em, iter, digits + sizeof(digits) - iter);
+}
+
+void
+emit_i64(Emitter *em, int64_t num) {
+  if (num < 0) {
+    emit_char(em, '-');
+    /* negated as unsigned, so INT64_MIN doesn't overflow */
+    emit_u64(em, -(uint64_t)num);
+  } else {
+    emit_u64(em, (uint64_t)num);
+  }
+}
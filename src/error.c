@@ -1,5 +1,5 @@
 #include <error.h>
-#include <stdlib.h>
+#include <setjmp.h>
 
 #define KRED "\x1B[31m"
 #define KNRM "\x1B[0m"
@@ -47,49 +47,57 @@ error_output_int(FILE *file, int i) {
   fprintf(file, "%d", i);
 }
 
-Vector errs; /* Diag */
-const uint8_t *base;
-const char *filename;
-
 #include "diags.txt"
 
 void
-errors_init(MemPool *pool, const uint8_t *_base, const char *_filename) {
+errors_init(BoncContext *ctx) {
   (void)error_output_type;
   (void)error_output_char;
   (void)error_output_pos;
   (void)error_output_int;
-  vector_init(&errs, sizeof(Diag), pool);
-  base = _base;
-  filename = _filename;
+  vector_init(&ctx->errs, sizeof(Diag), &ctx->pool);
 }
 
 bool
-errors_exist() {
-  return errs.items != 0;
+errors_exist(BoncContext *ctx) {
+  return ctx->errs.items != 0;
 }
 
 void
-errors_output(FILE *file) {
-  if (errs.items == 0) {
+errors_output(BoncContext *ctx) {
+  if (ctx->errs.items == 0) {
     return;
   }
-  for (size_t i = 0; i < errs.items; i++) {
-    Diag *diag = vector_idx(&errs, i);
-    fprintf(file, "%s:%zu: " KRED "error:" KNRM " ", filename,
-            diag->range.line);
+  FILE *file = ctx->err_file;
+  for (size_t i = 0; file != NULL && i < ctx->errs.items; i++) {
+    Diag *diag = vector_idx(&ctx->errs, i);
+    size_t line = ctx->diag_line == NULL
+                      ? diag->range.line
+                      : ctx->diag_line(ctx->diag_line_data, diag->range);
+    fprintf(file, "%s:%zu: " KRED "error:" KNRM " ", ctx->filename, line);
     diag_output(diag, file);
     fprintf(file, ".\n");
   }
-  fprintf(file, "%ld error%s found. Aborting.\n", errs.items,
-          errs.items == 1 ? "" : "s");
-  exit(EXIT_FAILURE);
+  if (file != NULL) {
+    fprintf(file, "%ld error%s found. Aborting.\n", ctx->errs.items,
+            ctx->errs.items == 1 ? "" : "s");
+  }
+  if (ctx->bailout == NULL) {
+    log_internal_err("diagnostic reported without a bailout", NULL);
+  }
+  longjmp(*ctx->bailout, 1);
 }
 
 void
-errors_log(Diag diag) {
-  vector_push(&errs, &diag);
+errors_log(BoncContext *ctx, Diag diag) {
+  vector_push(&ctx->errs, &diag);
   /* this is 100% temporary and will be removed when the error handling system
    * is designed to handle multiple errors */
-  errors_output(stdout);
+  errors_output(ctx);
+}
+
+void
+errors_clear(BoncContext *ctx) {
+  mempool_reset(&ctx->pool);
+  errors_init(ctx);
 }
@@ -0,0 +1,172 @@
+#include <string.h>
+
+#include "cfg.h"
+#include "passes.h"
+
+/* Global value numbering over the dominator tree. In SSA form a register
+ * already is the name of a value, so two instructions compute the same value
+ * if they do the same thing, at the same size, to the same registers. The
+ * blocks are walked in preorder of the dominator tree with a table of the
+ * instructions seen in the blocks that dominate the current one, and an
+ * instruction found in it is redundant: its register is replaced by the one
+ * found everywhere, which is fine as the one found dominates all of its uses.
+ * Leaving a block takes what it added out of the table again */
+
+typedef struct {
+  uint8_t t;
+  uint8_t sz;
+  RegId a;    /* the first operand */
+  uint64_t b; /* the second operand, or the value of an immediate */
+} ValueKey;
+
+typedef struct {
+  ValueKey key;
+  RegId reg;
+  uint32_t next; /* the next entry in the bucket, or NO_ENTRY */
+} ValueEntry;
+
+#define NO_ENTRY UINT32_MAX
+
+typedef struct {
+  uint32_t *buckets;
+  size_t mask;
+  /* added to in preorder and taken from in postorder, so an entry is always
+   * the first of its bucket when it is taken out */
+  ValueEntry *entries;
+  uint32_t nentries;
+} ValueTable;
+
+static bool
+is_commutative(InstKind t) {
+  return t == INST_ADD || t == INST_IMUL || t == INST_UMUL;
+}
+
+/* the key of an instruction, false for those that aren't numbered. Calls may
+ * have side effects, phis are left to other passes, and copies to copy
+ * propagation */
+static bool
+value_key(SSA_Fn *fn, SSA_Inst *inst, ValueKey *key) {
+  memset(key, 0, sizeof(*key));
+  if (inst->result == 0) {
+    return false;
+  }
+  key->t = inst->t;
+  key->sz = inst->sz;
+  if (inst->t == INST_IMM) {
+    key->b = inst_imm(fn, inst) & sz_mask(inst->sz);
+    return true;
+  }
+  if (inst->t == INST_COPY || inst_arity_tbl[inst->t] != 2 ||
+      !inst_returns_tbl[inst->t]) {
+    return false;
+  }
+  RegId a = inst->data.operands[0];
+  RegId b = inst->data.operands[1];
+  if (is_commutative(inst->t) && b < a) {
+    key->a = b;
+    key->b = a;
+  } else {
+    key->a = a;
+    key->b = b;
+  }
+  return true;
+}
+
+static size_t
+value_hash(ValueKey *key) {
+  uint64_t h = key->b * 0x9e3779b97f4a7c15u;
+  h ^= ((uint64_t)key->a << 16 | (uint64_t)key->sz << 8 | key->t) *
+       0xc2b2ae3d27d4eb4fu;
+  return (size_t)(h ^ (h >> 29));
+}
+
+static bool
+value_key_eq(ValueKey *a, ValueKey *b) {
+  return a->t == b->t && a->sz == b->sz && a->a == b->a && a->b == b->b;
+}
+
+/* the register of the value, which is added as reg if it isn't there yet */
+static RegId
+value_find_or_add(ValueTable *table, ValueKey *key, RegId reg) {
+  uint32_t *bucket = &table->buckets[value_hash(key) & table->mask];
+  for (uint32_t i = *bucket; i != NO_ENTRY; i = table->entries[i].next) {
+    if (value_key_eq(&table->entries[i].key, key)) {
+      return table->entries[i].reg;
+    }
+  }
+  ValueEntry *entry = &table->entries[table->nentries];
+  entry->key = *key;
+  entry->reg = reg;
+  entry->next = *bucket;
+  *bucket = table->nentries++;
+  return reg;
+}
+
+static void
+value_table_pop(ValueTable *table, uint32_t nentries) {
+  while (table->nentries > nentries) {
+    ValueEntry *entry = &table->entries[--table->nentries];
+    table->buckets[value_hash(&entry->key) & table->mask] = entry->next;
+  }
+}
+
+static void
+number_block(SSA_Fn *fn, SSA_BBlock *block, ValueTable *table) {
+  for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+    ValueKey key;
+    if (!value_key(fn, inst, &key)) {
+      continue;
+    }
+    RegId leader = value_find_or_add(table, &key, inst->result);
+    if (leader != inst->result) {
+      ssa_replace_all_uses(fn, inst->result, leader);
+      bblock_remove_inst(fn, block, inst);
+    }
+  }
+}
+
+void
+pass_gvn(SSA_Fn *fn, PassContext *pc) {
+  if (!fn->has_uses) {
+    ssa_fn_build_uses(fn, pc->pool);
+  }
+  cfg_build(fn, pc->pool, pc->scratch);
+  cfg_dominators(fn, pc->pool, pc->scratch);
+
+  size_t ninsts = 0;
+  for (size_t i = 0; i < fn->nrpo; i++) {
+    ninsts += fn->rpo[i]->ninsts;
+  }
+  size_t nbuckets = 16;
+  while (nbuckets < ninsts * 2) {
+    nbuckets *= 2;
+  }
+  ValueTable table = {.mask = nbuckets - 1, .nentries = 0};
+  table.buckets = mempool_alloc(pc->scratch, nbuckets * sizeof(uint32_t));
+  memset(table.buckets, 0xff, nbuckets * sizeof(uint32_t));
+  table.entries = mempool_alloc(pc->scratch, ninsts * sizeof(ValueEntry));
+
+  /* preorder of the dominator tree with an explicit stack, along with the
+   * size of the table when each block was entered */
+  SSA_BBlock **stack = mempool_alloc(pc->scratch,
+                                     fn->nrpo * sizeof(SSA_BBlock *));
+  size_t *next_child = mempool_alloc(pc->scratch, fn->nrpo * sizeof(size_t));
+  uint32_t *entered = mempool_alloc(pc->scratch, fn->nrpo * sizeof(uint32_t));
+  size_t depth = 0;
+  stack[depth] = fn->entry;
+  next_child[depth] = 0;
+  entered[depth++] = 0;
+  number_block(fn, fn->entry, &table);
+  while (depth != 0) {
+    SSA_BBlock *block = stack[depth - 1];
+    if (next_child[depth - 1] == block->ndom_children) {
+      value_table_pop(&table, entered[--depth]);
+      continue;
+    }
+    SSA_BBlock *child = block->dom_children[next_child[depth - 1]++];
+    stack[depth] = child;
+    next_child[depth] = 0;
+    entered[depth++] = table.nentries;
+    number_block(fn, child, &table);
+  }
+}
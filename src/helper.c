@@ -14,6 +14,10 @@
 
 #define POOL_MAX_SZ 4294967296
 #define POOL_CHUNK_SZ 4096
+/* of everything a pool hands out, enough for any of the compiler's structures */
+#define POOL_ALIGN 8
+/* how much memory mempool_reset keeps committed */
+#define POOL_WARM_SZ (64 * 1024 * 1024)
 
 SourcePosition
 combine_pos(SourcePosition pos1, SourcePosition pos2) {
@@ -26,12 +30,6 @@ make_pos(const uint8_t *buf, size_t sz, size_t line) {
   return ret;
 }
 
-int64_t
-next_vn() {
-  static int64_t reg = 1;
-  return reg++;
-}
-
 void
 log_err(const char *fmt, ...) {
   va_list args;
@@ -79,7 +77,6 @@ log_source_err(const char *fmt, const uint8_t *base, SourcePosition pos, ...) {
     putc(*pos.start, stderr);
   }
   fprintf(stderr, RESET "\n");
-  exit(EXIT_FAILURE);
 }
 
 void
@@ -94,6 +91,7 @@ mempool_init(MemPool *pool) {
   }
   pool->size = 0;
   pool->alloc = POOL_CHUNK_SZ;
+  pool->dirty = 0;
 }
 
 void
@@ -104,6 +102,35 @@ mempool_deinit(MemPool *pool) {
   pool->base = NULL;
 }
 
+void
+mempool_reset(MemPool *pool) {
+  if (pool->alloc > POOL_WARM_SZ) {
+    madvise(pool->base + POOL_WARM_SZ, pool->alloc - POOL_WARM_SZ,
+            MADV_DONTNEED);
+    mprotect(pool->base + POOL_WARM_SZ, pool->alloc - POOL_WARM_SZ,
+             PROT_NONE);
+    pool->alloc = POOL_WARM_SZ;
+    /* what was given back reads as zeroes again */
+    if (pool->dirty > POOL_WARM_SZ) {
+      pool->dirty = POOL_WARM_SZ;
+    }
+  }
+  pool->size = 0;
+}
+
+MemPoolMark
+mempool_mark(MemPool *pool) {
+  return pool->size;
+}
+
+void
+mempool_release(MemPool *pool, MemPoolMark mark) {
+  if (mark > pool->size) {
+    log_internal_err("released a pool past its end", NULL);
+  }
+  pool->size = mark;
+}
+
 static inline size_t
 size_needed(size_t requested) {
   size_t ret = 0;
@@ -115,6 +142,8 @@ size_needed(size_t requested) {
 
 void *
 mempool_alloc(MemPool *pool, size_t amount) {
+  /* every allocation is rounded up, so that they all stay aligned */
+  amount = (amount + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
   if (pool->size + amount + 1 >= pool->alloc) {
     size_t needed = size_needed(amount);
     if (pool->alloc + needed > POOL_MAX_SZ) {
@@ -124,12 +153,25 @@ mempool_alloc(MemPool *pool, size_t amount) {
     pool->alloc += needed;
   }
   void *ret = pool->base + pool->size;
+  /* fresh pool memory is zeroed by mmap, and the compiler relies on that, so
+   * what was used before is zeroed when it's reused rather than when it's
+   * freed */
+  if (pool->size < pool->dirty) {
+    size_t used = pool->dirty - pool->size;
+    memset(ret, 0, used < amount ? used : amount);
+  }
   pool->size += amount;
+  if (pool->size > pool->dirty) {
+    pool->dirty = pool->size;
+  }
   return ret;
 }
 
 /* start this high, so that we don't have to copy too many times */
 #define VEC_INIT_ALLOC 32
+/* vectors that start out empty are mostly ones that stay small, like the
+ * instructions of a block */
+#define VEC_LAZY_ALLOC 4
 
 void
 vector_init(Vector *vec, size_t it_sz, MemPool *pool) {
@@ -151,10 +193,12 @@ vector_init_size(Vector *vec, size_t it_sz, MemPool *pool, size_t items) {
 
 void
 vector_resize(Vector *vec) {
-  uint8_t *new_data = mempool_alloc(vec->pool, vec->alloc * vec->it_sz * 2);
+  /* vectors made with vector_init_size can start out empty */
+  size_t alloc = vec->alloc == 0 ? VEC_LAZY_ALLOC : vec->alloc * 2;
+  uint8_t *new_data = mempool_alloc(vec->pool, alloc * vec->it_sz);
   memcpy(new_data, vec->data, vec->items * vec->it_sz);
   vec->data = new_data;
-  vec->alloc *= 2;
+  vec->alloc = alloc;
 }
 void
 vector_push(Vector *vec, void *data) {
@@ -167,7 +211,7 @@ vector_push(Vector *vec, void *data) {
 void
 vector_remove(Vector *vec, size_t idx) {
   memmove(vec->data + idx * vec->it_sz, vec->data + (idx + 1) * vec->it_sz,
-          (vec->items - idx) * vec->it_sz);
+          (vec->items - idx - 1) * vec->it_sz);
   vec->items--;
 }
 
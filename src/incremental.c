@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include "incremental.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "error.h"
+#include "ir_gen.h"
+#include "parser.h"
+#include "passes.h"
+#include "semantics.h"
+#include "ssa.h"
+
+/* The output of every function of a file is kept in a single cache entry, the
+ * pack, so that a rebuild maps one file no matter how many functions there
+ * are. In host byte order, a pack is:
+ *
+ *   u32 padding, which keeps the rest 8 byte aligned after the entry header
+ *   u64 count
+ *   PackRecord records[count], sorted by key
+ *   the AST and IR dumps of every function, which records point into */
+typedef struct {
+  uint8_t key[CACHE_KEY_SZ];
+  uint64_t offset; /* from the end of the records */
+  uint64_t ast_sz;
+  uint64_t ir_sz;
+} PackRecord;
+
+typedef struct {
+  const PackRecord *records;
+  uint64_t count;
+  const char *data;
+  size_t data_sz;
+} Pack;
+
+typedef struct {
+  /* the names of the body are only kept until the key is made */
+  FnExtent extent;
+
+  uint8_t key[CACHE_KEY_SZ];
+  bool cached;
+  /* the AST dump, then the IR dump. Points into the pack if cached */
+  const char *output;
+  size_t ast_sz;
+  size_t ir_sz;
+  char *fresh; /* the output if it isn't cached, to be freed */
+} FnInfo;
+
+#define PACK_HEADER_SZ (sizeof(uint32_t) + sizeof(uint64_t))
+
+static bool
+pack_open(Pack *pack, CachedOutput *entry) {
+  if (entry->output_sz < PACK_HEADER_SZ ||
+      (uintptr_t)(entry->output + PACK_HEADER_SZ) % sizeof(uint64_t) != 0) {
+    return false;
+  }
+  memcpy(&pack->count, entry->output + sizeof(uint32_t), sizeof(uint64_t));
+  size_t rest = entry->output_sz - PACK_HEADER_SZ;
+  if (pack->count > rest / sizeof(PackRecord)) {
+    return false;
+  }
+  pack->records = (const PackRecord *)(entry->output + PACK_HEADER_SZ);
+  pack->data = (const char *)(pack->records + pack->count);
+  pack->data_sz = rest - pack->count * sizeof(PackRecord);
+  return true;
+}
+
+static int
+record_cmp(const void *key, const void *record) {
+  return memcmp(key, ((const PackRecord *)record)->key, CACHE_KEY_SZ);
+}
+
+static bool
+pack_find(Pack *pack, FnInfo *info) {
+  const PackRecord *record = bsearch(info->key, pack->records, pack->count,
+                                     sizeof(PackRecord), record_cmp);
+  if (record == NULL || record->offset > pack->data_sz ||
+      record->ast_sz + record->ir_sz > pack->data_sz - record->offset) {
+    return false;
+  }
+  info->output = pack->data + record->offset;
+  info->ast_sz = record->ast_sz;
+  info->ir_sz = record->ir_sz;
+  return true;
+}
+
+static int
+info_cmp(const void *a, const void *b) {
+  return memcmp((*(FnInfo *const *)a)->key, (*(FnInfo *const *)b)->key,
+                CACHE_KEY_SZ);
+}
+
+static void
+pack_store(const char *dir, const uint8_t key[CACHE_KEY_SZ], Vector *infos) {
+  FnInfo **sorted = malloc(sizeof(FnInfo *) * (infos->items + 1));
+  for (size_t i = 0; i < infos->items; i++) {
+    sorted[i] = vector_idx(infos, i);
+  }
+  qsort(sorted, infos->items, sizeof(FnInfo *), info_cmp);
+  /* functions with the same text, which can only be the same function, are
+   * stored once */
+  uint64_t count = 0;
+  for (size_t i = 0; i < infos->items; i++) {
+    if (count == 0 || info_cmp(&sorted[count - 1], &sorted[i]) != 0) {
+      sorted[count++] = sorted[i];
+    }
+  }
+
+  char *buf;
+  size_t buf_sz;
+  FILE *file = open_memstream(&buf, &buf_sz);
+  if (file == NULL) {
+    log_internal_err("unable to open output stream", NULL);
+  }
+  fwrite(&(uint32_t){0}, sizeof(uint32_t), 1, file);
+  fwrite(&count, sizeof(count), 1, file);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < count; i++) {
+    PackRecord record = {
+        .offset = offset,
+        .ast_sz = sorted[i]->ast_sz,
+        .ir_sz = sorted[i]->ir_sz,
+    };
+    memcpy(record.key, sorted[i]->key, CACHE_KEY_SZ);
+    fwrite(&record, sizeof(record), 1, file);
+    offset += record.ast_sz + record.ir_sz;
+  }
+  for (size_t i = 0; i < count; i++) {
+    fwrite(sorted[i]->output, 1, sorted[i]->ast_sz + sorted[i]->ir_sz, file);
+  }
+  fclose(file);
+
+  cache_store(dir, key, buf, buf_sz);
+  free(buf);
+  free(sorted);
+}
+
+/* the key covers the function's text and the signature of every function any
+ * name in its body would find in the global scope, which is all that the
+ * analysis of a single function looks at. Names that are really locals only
+ * make the key stricter than it needs to be */
+static void
+fn_key(Scope *sigs, Vector *infos, FnInfo *info, CompileOptions *opts) {
+  Sha256 sha;
+  cache_key_begin(&sha, CACHE_FUNCTION, opts);
+  FnExtent *extent = &info->extent;
+  sha256_update(&sha, &extent->total_sz, sizeof(extent->total_sz));
+  sha256_update(&sha, extent->start, extent->total_sz);
+  for (size_t i = 0; i < extent->names.items; i++) {
+    SourcePosition *name = vector_idx(&extent->names, i);
+    ScopeEntry *entry = scope_find(sigs, *name);
+    FnInfo *found = entry == NULL ? NULL : vector_idx(infos, entry->inf.id);
+    uint64_t sig_sz = found == NULL ? UINT64_MAX : found->extent.sig_sz;
+    sha256_update(&sha, &sig_sz, sizeof(sig_sz));
+    if (found != NULL) {
+      sha256_update(&sha, found->extent.start, sig_sz);
+    }
+  }
+  sha256_final(&sha, info->key);
+}
+
+/* the pack is found by the name the file was given as */
+static void
+pack_key(uint8_t key[CACHE_KEY_SZ], BoncContext *ctx, CompileOptions *opts) {
+  Sha256 sha;
+  cache_key_begin(&sha, CACHE_PACK, opts);
+  sha256_update(&sha, ctx->filename, strlen(ctx->filename) + 1);
+  sha256_final(&sha, key);
+}
+
+/* the parts that can bail out, everything allocated is owned by the caller */
+static bool
+run_incremental(BoncContext *ctx, CompileOptions *opts, FILE *out, AST *ast,
+                SSA_Prog *prog, Vector *infos, Pack *pack, PassManager *pm,
+                TimeReport *times) {
+  /* the names in the bodies and the signatures are only needed for the keys */
+  MemPoolMark scratch_mark = mempool_mark(&ctx->scratch);
+  jmp_buf bailout;
+  if (setjmp(bailout)) {
+    mempool_release(&ctx->scratch, scratch_mark);
+    ctx->bailout = NULL;
+    return false;
+  }
+  ctx->bailout = &bailout;
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+
+  /* split the file into functions, only parsing their signatures */
+  Vector extents;
+  vector_init(&extents, sizeof(FnExtent), &ctx->scratch);
+  parse_fn_headers(ast, &extents, &ctx->scratch, true);
+  errors_output(ctx);
+  Scope *sigs = scope_init(&ctx->scratch, NULL);
+  for (size_t i = 0; i < extents.items; i++) {
+    FnInfo *info = vector_alloc(infos);
+    info->extent = *(FnExtent *)vector_idx(&extents, i);
+    /* the id of these entries is the index of the function instead */
+    VarInfo inf = make_var_info(0, NULL);
+    inf.id = i;
+    scope_insert(&ctx->scratch, sigs,
+                 ((Function *)vector_idx(&ast->fns, i))->name, inf);
+  }
+  time_report_phase(times, PHASE_PARSE, &start);
+
+  for (size_t i = 0; i < infos->items; i++) {
+    FnInfo *info = vector_idx(infos, i);
+    fn_key(sigs, infos, info, opts);
+    info->cached = pack->records != NULL && pack_find(pack, info);
+    if (times != NULL) {
+      info->cached ? times->fn_cache_hits++ : times->fn_cache_misses++;
+    }
+  }
+  mempool_release(&ctx->scratch, scratch_mark);
+  time_report_phase(times, PHASE_CACHE, &start);
+
+  for (size_t i = 0; i < infos->items; i++) {
+    FnInfo *info = vector_idx(infos, i);
+    if (!info->cached) {
+      ctx->lex = info->extent.body;
+      parse_block(&((Function *)vector_idx(&ast->fns, i))->body, ast);
+    }
+  }
+  errors_output(ctx);
+  time_report_phase(times, PHASE_PARSE, &start);
+
+  /* every signature is still checked, since they're visible everywhere */
+  declare_fns(ast);
+  for (size_t i = 0; i < infos->items; i++) {
+    if (!((FnInfo *)vector_idx(infos, i))->cached) {
+      resolve_fn_names(ast, vector_idx(&ast->fns, i));
+    }
+  }
+  time_report_phase(times, PHASE_NAMES, &start);
+
+  declare_fn_types(ast);
+  for (size_t i = 0; i < infos->items; i++) {
+    if (!((FnInfo *)vector_idx(infos, i))->cached) {
+      resolve_fn_types(ast, vector_idx(&ast->fns, i));
+    }
+  }
+  time_report_phase(times, PHASE_TYPES, &start);
+
+  for (size_t i = 0; i < infos->items; i++) {
+    if (!((FnInfo *)vector_idx(infos, i))->cached) {
+      check_fn_returns(ast, vector_idx(&ast->fns, i));
+    }
+  }
+  time_report_phase(times, PHASE_RETURNS, &start);
+
+  /* the functions that aren't translated only need their names, for the
+   * calls to them */
+  declare_ssa_fns(ast, prog);
+  for (size_t i = 0; i < infos->items; i++) {
+    if (!((FnInfo *)vector_idx(infos, i))->cached) {
+      translate_function(vector_idx(&ast->fns, i), vector_idx(&prog->fns, i),
+                         &prog->pool, &ctx->scratch);
+    }
+  }
+  time_report_phase(times, PHASE_IR, &start);
+
+  /* the function passes only look at the function, so the ones reused were
+   * already optimized with the same passes, which are part of their keys */
+  if (opts->passes.npasses != 0) {
+    for (size_t i = 0; i < infos->items; i++) {
+      if (!((FnInfo *)vector_idx(infos, i))->cached) {
+        pass_manager_run_fn(pm, vector_idx(&prog->fns, i), &prog->pool);
+      }
+    }
+    time_report_phase(times, PHASE_OPT, &start);
+  }
+
+  for (size_t i = 0; i < infos->items; i++) {
+    FnInfo *info = vector_idx(infos, i);
+    if (info->cached) {
+      continue;
+    }
+    size_t fresh_sz;
+    Emitter em;
+    emitter_init(&em, NULL);
+    if (opts->dump_ast) {
+      ast_fn_dump(&em, vector_idx(&ast->fns, i));
+    }
+    info->ast_sz = em.len;
+    if (opts->dump_ir) {
+      function_dump(&em, vector_idx(&prog->fns, i), opts->dump_reg);
+    }
+    info->fresh = emitter_take(&em, &fresh_sz);
+    info->output = info->fresh;
+    info->ir_sz = fresh_sz - info->ast_sz;
+  }
+
+  if (opts->dump_ast) {
+    fprintf(out, "AST_DUMP:\n");
+    for (size_t i = 0; i < infos->items; i++) {
+      FnInfo *info = vector_idx(infos, i);
+      fwrite(info->output, 1, info->ast_sz, out);
+    }
+    fprintf(out, "\n");
+  }
+  if (opts->dump_ir) {
+    fprintf(out, "IR_DUMP:\n");
+    for (size_t i = 0; i < infos->items; i++) {
+      FnInfo *info = vector_idx(infos, i);
+      fwrite(info->output + info->ast_sz, 1, info->ir_sz, out);
+    }
+  }
+  time_report_phase(times, PHASE_DUMP, &start);
+  ctx->bailout = NULL;
+  return true;
+}
+
+bool
+compile_incremental(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                    TimeReport *times) {
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+  AST ast;
+  SSA_Prog prog;
+  Vector infos;
+  prog.pool.base = NULL;
+  ast_init(&ast, ctx);
+  vector_init(&infos, sizeof(FnInfo), &ast.pool);
+
+  uint8_t key[CACHE_KEY_SZ];
+  CachedOutput entry;
+  Pack pack = {0};
+  pack_key(key, ctx, opts);
+  bool have_entry = cache_load(opts->cache_dir, key, &entry);
+  if (have_entry && !pack_open(&pack, &entry)) {
+    pack.records = NULL;
+  }
+  time_report_phase(times, PHASE_CACHE, &start);
+
+  PassManager pm;
+  pass_manager_init(&pm, &opts->passes, 1);
+
+  bool ok = run_incremental(ctx, opts, out, &ast, &prog, &infos, &pack, &pm,
+                            times);
+  time_report_passes(times, &pm);
+  pass_manager_deinit(&pm);
+
+  /* the pack is only replaced once the whole file is known to be correct, so
+   * that every function in it compiled */
+  start = times == NULL ? 0 : time_now_ns();
+  bool changed = pack.count != infos.items;
+  for (size_t i = 0; i < infos.items; i++) {
+    changed |= !((FnInfo *)vector_idx(&infos, i))->cached;
+  }
+  if (ok && changed) {
+    pack_store(opts->cache_dir, key, &infos);
+  }
+  for (size_t i = 0; i < infos.items; i++) {
+    free(((FnInfo *)vector_idx(&infos, i))->fresh);
+  }
+  if (have_entry) {
+    cache_release(&entry);
+  }
+  time_report_phase(times, PHASE_CACHE, &start);
+
+  if (prog.pool.base != NULL) {
+    bonc_context_pool_put(ctx, &prog.pool);
+  }
+  ast_deinit(&ast);
+  return ok;
+}
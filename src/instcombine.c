@@ -0,0 +1,349 @@
+#include <string.h>
+
+#include "passes.h"
+
+/* Peephole rewrites of single instructions, looking through their operands
+ * to the instructions that set them: algebraic identities, constants
+ * gathered from chains of adds and multiplications, and multiplications and
+ * divisions by constants done with shifts and multiplications instead. What
+ * replaces an instruction is put in front of it, and gets its users. The
+ * instructions it leaves unused are left to dce, and the immediates it makes
+ * to gvn */
+
+typedef struct {
+  SSA_Fn *fn;
+  SSA_BBlock *block;
+  SSA_Inst *before; /* what is made goes in front of it */
+  SizeKind sz;
+  unsigned bits;
+  uint64_t mask;
+  SSA_Inst *first; /* the first instruction made, NULL if none */
+} Combine;
+
+static RegId
+emit(Combine *c, InstKind t, RegId a, RegId b) {
+  SSA_Inst inst = {.t = t, .sz = c->sz, .result = ssa_new_reg(c->fn, c->sz)};
+  inst.data.operands[0] = a;
+  inst.data.operands[1] = b;
+  SSA_Inst *added = bblock_insert_inst(c->fn, c->block, c->before, &inst);
+  if (c->first == NULL) {
+    c->first = added;
+  }
+  return inst.result;
+}
+
+static RegId
+emit_imm(Combine *c, uint64_t value) {
+  SSA_Inst inst = {.t = INST_IMM, .sz = c->sz,
+                   .result = ssa_new_reg(c->fn, c->sz)};
+  inst_set_imm(c->fn, &inst, value & c->mask);
+  SSA_Inst *added = bblock_insert_inst(c->fn, c->block, c->before, &inst);
+  if (c->first == NULL) {
+    c->first = added;
+  }
+  return inst.result;
+}
+
+/* whether reg is set by an immediate, which is then put in value */
+static bool
+const_of(Combine *c, RegId reg, uint64_t *value) {
+  SSA_Inst *def = reg == 0 ? NULL : ssa_reg_def(c->fn, reg);
+  if (def == NULL || def->t != INST_IMM) {
+    return false;
+  }
+  *value = inst_imm(c->fn, def) & c->mask;
+  return true;
+}
+
+/* the instruction of kind t, with a constant operand, that sets reg. The
+ * other operand goes in other */
+static bool
+const_operand_of(Combine *c, RegId reg, InstKind t, RegId *other,
+                 uint64_t *value) {
+  SSA_Inst *def = reg == 0 ? NULL : ssa_reg_def(c->fn, reg);
+  if (def == NULL || def->t != t || def->sz != c->sz) {
+    return false;
+  }
+  if (const_of(c, def->data.operands[1], value)) {
+    *other = def->data.operands[0];
+    return true;
+  }
+  /* shifts only take the amount from their second operand */
+  if (t != INST_SHL && const_of(c, def->data.operands[0], value)) {
+    *other = def->data.operands[1];
+    return true;
+  }
+  return false;
+}
+
+static int64_t
+signed_value(Combine *c, uint64_t value) {
+  uint64_t sign = (c->mask >> 1) + 1;
+  return (value & sign) ? (int64_t)(value | ~c->mask) : (int64_t)value;
+}
+
+/* log2 of value if it is a power of 2, -1 otherwise */
+static int
+power_of_2(uint64_t value) {
+  if (value == 0 || (value & (value - 1)) != 0) {
+    return -1;
+  }
+  int log = 0;
+  while (value >>= 1) {
+    log++;
+  }
+  return log;
+}
+
+/* The multiplications that divide by a constant, from Warren, "Hacker's
+ * Delight", chapter 10. They are worked out with unsigned arithmetic of the
+ * size of the division, that wraps around at bits */
+
+/* n / d for 2 <= d: the upper half of n * magic shifted right by shift. If add
+ * is set, magic needs one bit more than the size has, and its top bit is
+ * added in separately */
+static RegId
+udiv_by_const(Combine *c, RegId n, uint64_t d) {
+  uint64_t mask = c->mask;
+  uint64_t half = (mask >> 1) + 1; /* 2^(bits - 1) */
+  uint64_t nc = (mask - ((0 - d) & mask) % d) & mask;
+  unsigned p = c->bits - 1;
+  uint64_t q1 = half / nc, r1 = half - q1 * nc;
+  uint64_t q2 = (half - 1) / d, r2 = (half - 1) - q2 * d;
+  bool add = false;
+  uint64_t delta;
+  do {
+    p++;
+    if (r1 >= nc - r1) {
+      q1 = (2 * q1 + 1) & mask;
+      r1 = (2 * r1 - nc) & mask;
+    } else {
+      q1 = (2 * q1) & mask;
+      r1 = (2 * r1) & mask;
+    }
+    if (r2 + 1 >= d - r2) {
+      add |= q2 >= half - 1;
+      q2 = (2 * q2 + 1) & mask;
+      r2 = (2 * r2 + 1 - d) & mask;
+    } else {
+      add |= q2 >= half;
+      q2 = (2 * q2) & mask;
+      r2 = (2 * r2 + 1) & mask;
+    }
+    delta = d - 1 - r2;
+  } while (p < 2 * c->bits && (q1 < delta || (q1 == delta && r1 == 0)));
+  uint64_t magic = (q2 + 1) & mask;
+  unsigned shift = p - c->bits;
+
+  RegId hi = emit(c, INST_UMULHI, n, emit_imm(c, magic));
+  if (!add) {
+    return shift == 0 ? hi : emit(c, INST_LSHR, hi, emit_imm(c, shift));
+  }
+  /* (n - hi) / 2 + hi is n * magic / 2^bits without overflowing */
+  RegId diff = emit(c, INST_SUB, n, hi);
+  RegId q = emit(c, INST_ADD, emit(c, INST_LSHR, diff, emit_imm(c, 1)), hi);
+  return shift == 1 ? q : emit(c, INST_LSHR, q, emit_imm(c, shift - 1));
+}
+
+/* n / d for d = 2^log, rounded towards 0: a negative n is biased by d - 1
+ * first */
+static RegId
+idiv_by_power_of_2(Combine *c, RegId n, int log) {
+  RegId sign = log == 1 ? n : emit(c, INST_ASHR, n, emit_imm(c, log - 1));
+  RegId bias = emit(c, INST_LSHR, sign, emit_imm(c, c->bits - log));
+  RegId biased = emit(c, INST_ADD, n, bias);
+  return emit(c, INST_ASHR, biased, emit_imm(c, log));
+}
+
+/* n / d for d not in -1, 0 or 1: the upper half of the signed n * magic,
+ * corrected by n if magic came out with the other sign, shifted right by
+ * shift and rounded towards 0 */
+static RegId
+idiv_by_const(Combine *c, RegId n, uint64_t d) {
+  uint64_t mask = c->mask;
+  uint64_t half = (mask >> 1) + 1;
+  bool negative = signed_value(c, d) < 0;
+  uint64_t ad = negative ? (0 - d) & mask : d;
+  uint64_t t = half + negative;
+  uint64_t anc = (t - 1 - t % ad) & mask; /* |nc| */
+  unsigned p = c->bits - 1;
+  uint64_t q1 = half / anc, r1 = half - q1 * anc;
+  uint64_t q2 = half / ad, r2 = half - q2 * ad;
+  uint64_t delta;
+  do {
+    p++;
+    q1 = (2 * q1) & mask;
+    r1 = (2 * r1) & mask;
+    if (r1 >= anc) {
+      q1 = (q1 + 1) & mask;
+      r1 = (r1 - anc) & mask;
+    }
+    q2 = (2 * q2) & mask;
+    r2 = (2 * r2) & mask;
+    if (r2 >= ad) {
+      q2 = (q2 + 1) & mask;
+      r2 = (r2 - ad) & mask;
+    }
+    delta = (ad - r2) & mask;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  uint64_t magic = (q2 + 1) & mask;
+  if (negative) {
+    magic = (0 - magic) & mask;
+  }
+  unsigned shift = p - c->bits;
+
+  RegId q = emit(c, INST_IMULHI, n, emit_imm(c, magic));
+  if (!negative && signed_value(c, magic) < 0) {
+    q = emit(c, INST_ADD, q, n);
+  } else if (negative && signed_value(c, magic) > 0) {
+    q = emit(c, INST_SUB, q, n);
+  }
+  if (shift != 0) {
+    q = emit(c, INST_ASHR, q, emit_imm(c, shift));
+  }
+  /* adds 1 if q is negative */
+  return emit(c, INST_ADD, q, emit(c, INST_LSHR, q, emit_imm(c, c->bits - 1)));
+}
+
+/* what the result of inst can be replaced with, 0 if nothing */
+static RegId
+combine(Combine *c, SSA_Inst *inst) {
+  InstKind t = inst->t;
+  RegId x = inst->data.operands[0];
+  RegId y = inst->data.operands[1];
+  uint64_t cx, cy;
+  bool x_const = const_of(c, x, &cx);
+  bool y_const = const_of(c, y, &cy);
+  if (x_const && y_const) {
+    uint64_t result;
+    return inst_fold(t, c->sz, cx, cy, &result) ? emit_imm(c, result) : 0;
+  }
+  /* the constant of a commutative instruction goes second */
+  if (x_const && (t == INST_ADD || t == INST_IMUL || t == INST_UMUL)) {
+    RegId reg = x;
+    x = y;
+    y = reg;
+    cy = cx;
+    y_const = true;
+  }
+  if (t == INST_SUB && x == y) {
+    return emit_imm(c, 0);
+  }
+  if (!y_const) {
+    return 0;
+  }
+
+  RegId inner;
+  uint64_t ci;
+  int log = power_of_2(cy);
+  switch (t) {
+    case INST_SUB:
+      if (cy == 0) {
+        return x;
+      }
+      /* x - c is x + -c, which is then gathered like any other add */
+      if (const_operand_of(c, x, INST_ADD, &inner, &ci)) {
+        return emit(c, INST_ADD, inner, emit_imm(c, ci - cy));
+      }
+      return emit(c, INST_ADD, x, emit_imm(c, 0 - cy));
+    case INST_ADD:
+      if (cy == 0) {
+        return x;
+      }
+      if (const_operand_of(c, x, INST_ADD, &inner, &ci)) {
+        return emit(c, INST_ADD, inner, emit_imm(c, ci + cy));
+      }
+      return 0;
+    case INST_IMUL:
+    case INST_UMUL:
+      if (cy == 0) {
+        return emit_imm(c, 0);
+      }
+      if (cy == 1) {
+        return x;
+      }
+      /* the low half of a product doesn't depend on the signs, so either
+       * kind gathers with the other */
+      if (const_operand_of(c, x, INST_IMUL, &inner, &ci) ||
+          const_operand_of(c, x, INST_UMUL, &inner, &ci)) {
+        return emit(c, t, inner, emit_imm(c, ci * cy));
+      }
+      if (log > 0) {
+        return emit(c, INST_SHL, x, emit_imm(c, log));
+      }
+      return 0;
+    case INST_SHL:
+      if (cy == 0) {
+        return x;
+      }
+      if (cy < c->bits && const_operand_of(c, x, INST_SHL, &inner, &ci) &&
+          ci + cy < c->bits) {
+        return emit(c, INST_SHL, inner, emit_imm(c, ci + cy));
+      }
+      return 0;
+    case INST_LSHR:
+    case INST_ASHR:
+      return cy == 0 ? x : 0;
+    case INST_UDIV:
+      /* a division by 0 is left to trap */
+      if (cy == 0) {
+        return 0;
+      }
+      if (cy == 1) {
+        return x;
+      }
+      if (log > 0) {
+        return emit(c, INST_LSHR, x, emit_imm(c, log));
+      }
+      return udiv_by_const(c, x, cy);
+    case INST_IDIV: {
+      /* as is one by -1, which traps for the smallest value */
+      int64_t d = signed_value(c, cy);
+      if (d == 0 || d == -1) {
+        return 0;
+      }
+      if (d == 1) {
+        return x;
+      }
+      if (d > 0 && log > 0) {
+        return idiv_by_power_of_2(c, x, log);
+      }
+      return idiv_by_const(c, x, cy);
+    }
+    default:
+      return 0;
+  }
+}
+
+void
+pass_instcombine(SSA_Fn *fn, PassContext *pc) {
+  if (!fn->has_uses) {
+    ssa_fn_build_uses(fn, pc->pool);
+  }
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *inst = block->first;
+    while (inst != NULL) {
+      if (inst->result == 0 || inst_arity_tbl[inst->t] != 2 ||
+          inst->sz == SZ_NONE) {
+        inst = inst->next;
+        continue;
+      }
+      Combine c = {.fn = fn,
+                   .block = block,
+                   .before = inst,
+                   .sz = inst->sz,
+                   .bits = 8u << (inst->sz - SZ_8),
+                   .mask = sz_mask(inst->sz),
+                   .first = NULL};
+      RegId with = combine(&c, inst);
+      if (with == 0 || with == inst->result) {
+        inst = inst->next;
+        continue;
+      }
+      ssa_replace_all_uses(fn, inst->result, with);
+      bblock_remove_inst(fn, block, inst);
+      /* what was made is looked at again, it may combine further */
+      inst = c.first != NULL ? c.first : inst->next;
+    }
+  }
+}
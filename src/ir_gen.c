@@ -10,7 +10,6 @@ type_sz(int ast_type) {
       return SZ_8;
     case TYPE_I16:
     case TYPE_U16:
-      printf("here\n");
       return SZ_16;
     case TYPE_I32:
     case TYPE_U32:
@@ -23,13 +22,10 @@ type_sz(int ast_type) {
   return 0;
 }
 
-static RegId
-sym_table_reg(SSA_Fn *fn, ScopeEntry *entry) {
-  if (entry->inf.id == 0) {
-    return entry->inf.id = ssa_new_reg(fn, type_sz(entry->inf.type->t));
-  } else {
-    return entry->inf.id;
-  }
+/* makes the variable of a declaration, which is kept in its scope entry */
+static size_t
+declare_var(SSABuilder *b, ScopeEntry *entry) {
+  return entry->inf.id = ssa_builder_new_var(b, type_sz(entry->inf.type->t));
 }
 
 static int
@@ -63,53 +59,54 @@ inst_init(SSA_Inst *inst, int t, int sz, RegId result) {
 }
 
 static RegId
-translate_expr(Expr *expr, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
+translate_expr(Expr *expr, Scope *scope, SSA_BBlock *block, SSABuilder *b,
                MemPool *pool) {
+  SSA_Fn *fn = b->fn;
   switch (expr->t) {
     case EXPR_INT:
       {
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_IMM, type_sz(expr->type->t),
+        SSA_Inst inst;
+        inst_init(&inst, INST_IMM, type_sz(expr->type->t),
                   ssa_new_reg(fn, type_sz(expr->type->t)));
-        inst->data.imm = expr->data.intlit.val;
-        return inst->result;
+        inst_set_imm(fn, &inst, expr->data.intlit.val);
+        return bblock_append(fn, block, &inst)->result;
       }
     case EXPR_VAR:
       {
-        return sym_table_reg(fn, expr->data.var);
+        return ssa_builder_read(b, expr->data.var->inf.id, block);
       }
     case EXPR_BINOP:
       {
         RegId obj1 =
-            translate_expr(expr->data.binop.left, scope, block, fn, pool);
+            translate_expr(expr->data.binop.left, scope, block, b, pool);
         RegId obj2 =
-            translate_expr(expr->data.binop.right, scope, block, fn, pool);
-        SSA_Inst *inst = bblock_append(block);
-        inst->sz = type_sz(expr->type->t);
-        inst->t = translate_binop(expr->type->t, expr->data.binop.op);
-        inst->data.operands[0] = obj1;
-        inst->data.operands[1] = obj2;
-        inst->result = ssa_new_reg(fn, type_sz(expr->type->t));
-        return inst->result;
+            translate_expr(expr->data.binop.right, scope, block, b, pool);
+        SSA_Inst inst;
+        inst_init(&inst, translate_binop(expr->type->t, expr->data.binop.op),
+                  type_sz(expr->type->t),
+                  ssa_new_reg(fn, type_sz(expr->type->t)));
+        inst.data.operands[0] = obj1;
+        inst.data.operands[1] = obj2;
+        return bblock_append(fn, block, &inst)->result;
       }
     case EXPR_FUNCALL:
       {
-        Vector passed_params;
-        vector_init(&passed_params, sizeof(RegId), pool);
-        for (size_t i = 0; i < expr->data.funcall.args.items; i++) {
+        /* the instruction copies them into the function's args, the builder
+         * gives the scratch memory back */
+        size_t nargs = expr->data.funcall.args.items;
+        RegId *args = mempool_alloc(b->scratch, nargs * sizeof(RegId));
+        for (size_t i = 0; i < nargs; i++) {
           Expr *temp_expr = *((Expr **)vector_idx(&expr->data.funcall.args, i));
-          RegId temp_id = translate_expr(temp_expr, scope, block, fn, pool);
-          vector_push(&passed_params, &temp_id);
+          args[i] = translate_expr(temp_expr, scope, block, b, pool);
         }
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_CALLFN, type_sz(expr->type->t),
+        SSA_Inst inst;
+        inst_init(&inst, INST_CALLFN, type_sz(expr->type->t),
                   ssa_new_reg(fn, type_sz(expr->type->t)));
         if (expr->data.funcall.fn->inf.fn == NULL) {
           log_internal_err("cannot call runtime selected functions", NULL);
         }
-        inst->data.callfn.fn = expr->data.funcall.fn->inf.fn;
-        inst->data.callfn.args = passed_params;
-        return inst->result;
+        inst_set_call(fn, &inst, expr->data.funcall.fn->inf.fn, args, nargs);
+        return bblock_append(fn, block, &inst)->result;
       }
     default:
       log_internal_err("invalid expression type %d", expr->t);
@@ -118,40 +115,45 @@ translate_expr(Expr *expr, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
 }
 
 static void
-translate_stmt(Stmt *stmt, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
+translate_stmt(Stmt *stmt, Scope *scope, SSA_BBlock *block, SSABuilder *b,
                MemPool *pool) {
   switch (stmt->t) {
     case STMT_LET:
-      if (stmt->data.let.value != NULL) {
-        RegId obj =
-            translate_expr(stmt->data.let.value, scope, block, fn, pool);
-        SSA_Inst *inst = bblock_append(block);
-
-        inst_init(inst, INST_COPY, type_sz(stmt->data.let.value->type->t),
-                  sym_table_reg(fn, stmt->data.let.var));
-        inst->data.operands[0] = obj;
+      {
+        size_t var = declare_var(b, stmt->data.let.var);
+        if (stmt->data.let.value == NULL) {
+          break;
+        }
+        RegId obj = translate_expr(stmt->data.let.value, scope, block, b, pool);
+        /* every definition gets a register of its own */
+        int sz = type_sz(stmt->data.let.value->type->t);
+        SSA_Inst inst;
+        inst_init(&inst, INST_COPY, sz, ssa_new_reg(b->fn, sz));
+        inst.data.operands[0] = obj;
+        bblock_append(b->fn, block, &inst);
+        ssa_builder_write(b, var, block, inst.result);
+        break;
       }
-      break;
     case STMT_EXPR:
       {
-        RegId op = translate_expr(stmt->data.expr, scope, block, fn, pool);
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_COPY, type_sz(stmt->data.expr->type->t), 0);
-        inst->data.operands[0] = op;
+        RegId op = translate_expr(stmt->data.expr, scope, block, b, pool);
+        SSA_Inst inst;
+        inst_init(&inst, INST_COPY, type_sz(stmt->data.expr->type->t), 0);
+        inst.data.operands[0] = op;
+        bblock_append(b->fn, block, &inst);
         break;
       }
     case STMT_RETURN:
       {
         RegId op = 0;
         if (stmt->data.ret != NULL) {
-          op = translate_expr(stmt->data.ret, scope, block, fn, pool);
+          op = translate_expr(stmt->data.ret, scope, block, b, pool);
         }
-        SSA_Inst *inst = bblock_append(block);
-        inst_init(inst, INST_RET, 0,
-                  stmt->data.let.value == NULL
-                      ? SZ_NONE
-                      : type_sz(stmt->data.ret->type->t));
-        inst->data.operands[0] = op;
+        /* like everything without a result, it goes without a size */
+        SSA_Inst inst;
+        inst_init(&inst, INST_RET, SZ_NONE, 0);
+        inst.data.operands[0] = op;
+        bblock_append(b->fn, block, &inst);
         break;
       }
     default:
@@ -160,36 +162,45 @@ translate_stmt(Stmt *stmt, Scope *scope, SSA_BBlock *block, SSA_Fn *fn,
 }
 
 void
-translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool) {
-  SSA_BBlock *block = bblock_init(pool);
-  vector_init(&sem_fn->params, sizeof(RegId), pool);
-  vector_init(&sem_fn->regs, sizeof(SSA_Reg), pool);
+translate_function(Function *fn, SSA_Fn *sem_fn, MemPool *pool,
+                   MemPool *scratch) {
+  SSABuilder b;
+  ssa_builder_init(&b, sem_fn, pool, scratch);
+  SSA_BBlock *block = sem_fn->entry;
   for (size_t i = 0; i < fn->params.items; i++) {
     Param *param = vector_idx(&fn->params, i);
-    RegId temp = sym_table_reg(sem_fn, param->entry);
+    size_t var = declare_var(&b, param->entry);
+    RegId temp = ssa_new_reg(sem_fn, type_sz(param->entry->inf.type->t));
+    ssa_builder_write(&b, var, block, temp);
     vector_push(&sem_fn->params, &temp);
   }
 
   for (size_t i = 0; i < fn->body.stmts.items; i++) {
-    translate_stmt(vector_idx(&fn->body.stmts, i), fn->scope, block, sem_fn,
+    translate_stmt(vector_idx(&fn->body.stmts, i), fn->scope, block, &b,
                    pool);
   }
+  ssa_builder_finish(&b);
   sem_fn->name = fn->name;
-  sem_fn->entry = block;
 }
 
 void
-translate_ast(AST *ast, SSA_Prog *prog) {
-  mempool_init(&prog->pool);
-  vector_init(&prog->fns, sizeof(SSA_Fn), &prog->pool);
-
+declare_ssa_fns(AST *ast, SSA_Prog *prog) {
+  bonc_context_pool_get(ast->ctx, &prog->pool);
+  /* allocated up front, since calls keep pointers to the functions */
+  vector_init_size(&prog->fns, sizeof(SSA_Fn), &prog->pool, ast->fns.items);
   for (size_t i = 0; i < ast->fns.items; i++) {
     Function *fn = vector_idx(&ast->fns, i);
-    SSA_Fn *ssa_fn = vector_alloc(&prog->fns);
+    SSA_Fn *ssa_fn = vector_idx(&prog->fns, i);
+    ssa_fn->name = fn->name;
     fn->entry->inf.fn = ssa_fn;
   }
+}
+
+void
+translate_ast(AST *ast, SSA_Prog *prog) {
+  declare_ssa_fns(ast, prog);
   for (size_t i = 0; i < ast->fns.items; i++) {
     translate_function(vector_idx(&ast->fns, i), vector_idx(&prog->fns, i),
-                       &prog->pool);
+                       &prog->pool, &ast->ctx->scratch);
   }
 }
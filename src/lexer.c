@@ -6,48 +6,90 @@
 
 #include "error.h"
 #include "helper.h"
+#include "stream.h"
+#include "token_ring.h"
 
-struct {
-  const uint8_t *buf;
-  size_t sz;
-  size_t line;
+void
+lexer_init(Lexer *lex, struct BoncContext *ctx, const uint8_t *buf,
+           size_t sz) {
+  lex->ctx = ctx;
+  lex->buf = buf;
+  lex->sz = sz;
+  lex->line = 1;
 
-  size_t end;
-  size_t start;
+  lex->end = lex->start = 0;
 
-  int prev;
-  Token peek;
-  int peekf; /* 0 if no token available to peek */
-} lex;
+  lex->peekf = 0;
+  lex->stream = NULL;
+  lex->ring = NULL;
+  lex->toks = NULL;
+}
 
 void
-lexer_init(const uint8_t *buf, size_t sz) {
-  lex.buf = buf;
-  lex.sz = sz;
-  lex.line = 1;
+lexer_init_stream(Lexer *lex, struct BoncContext *ctx, InputStream *stream) {
+  lexer_init(lex, ctx, stream->base, stream->sz);
+  lex->stream = stream;
+}
 
-  lex.end = lex.start = 0;
+void
+lexer_init_tokens(Lexer *lex, struct BoncContext *ctx, const Token *toks,
+                  size_t ntoks, size_t line_base) {
+  lexer_init(lex, ctx, NULL, 0);
+  lex->toks = toks;
+  lex->ntoks = ntoks;
+  lex->tok_idx = 0;
+  lex->line_base = line_base;
+}
 
-  lex.peekf = 0;
+static Token
+replay_token(Lexer *lex) {
+  Token ret = lex->toks[lex->tok_idx];
+  if (lex->tok_idx + 1 < lex->ntoks) {
+    lex->tok_idx++;
+  }
+  ret.pos.line += lex->line_base;
+  return ret;
 }
 
 static inline size_t
-cur_len() {
-  return lex.end - lex.start;
+cur_len(Lexer *lex) {
+  return lex->end - lex->start;
 }
 
 static Token
-make_token(int t) {
+make_token(Lexer *lex, int t) {
   Token ret;
-  ret.pos = make_pos(lex.buf + lex.start, cur_len(), lex.line);
+  ret.pos = make_pos(lex->buf + lex->start, cur_len(lex), lex->line);
   ret.t = t;
-  lex.start = lex.end; /* reset lexer */
+  lex->start = lex->end; /* reset lexer */
   return ret;
 }
 
+/* waits until end + n bytes have been read from the stream, returns false if
+ * the input ends first */
 static int
-is_eof() {
-  return lex.end >= lex.sz;
+wait_for_chars(Lexer *lex, size_t n) {
+  while (lex->end + n > lex->sz) {
+    if (lex->stream == NULL) {
+      return 0;
+    }
+    /* copies of the lexer can be behind the stream */
+    if (lex->stream->sz == lex->sz && !input_stream_fill(lex->stream)) {
+      return 0;
+    }
+    lex->sz = lex->stream->sz;
+  }
+  return 1;
+}
+
+static inline int
+has_chars(Lexer *lex, size_t n) {
+  return lex->end + n <= lex->sz || wait_for_chars(lex, n);
+}
+
+static int
+is_eof(Lexer *lex) {
+  return !has_chars(lex, 1);
 }
 
 static inline int
@@ -56,100 +98,101 @@ is_whitespace(int32_t c) {
 }
 
 static inline uint8_t
-next_c() {
-  return lex.buf[lex.end++];
+next_c(Lexer *lex) {
+  return lex->buf[lex->end++];
 }
 
 static inline uint8_t
-peek_c() {
-  return lex.buf[lex.end];
+peek_c(Lexer *lex) {
+  return lex->buf[lex->end];
 }
 
 static inline int
-needs_newline() {
-  return lex.prev == TOK_INT || lex.prev == TOK_SYM || lex.prev == TOK_FALSE ||
-         lex.prev == TOK_TRUE || lex.prev == TOK_U8 || lex.prev == TOK_I8 ||
-         lex.prev == TOK_U16 || lex.prev == TOK_I16 || lex.prev == TOK_U32 ||
-         lex.prev == TOK_I32 || lex.prev == TOK_U64 || lex.prev == TOK_I64 ||
-         lex.prev == TOK_BOOL || lex.prev == TOK_LPAREN ||
-         lex.prev == TOK_RPAREN;
+needs_newline(Lexer *lex) {
+  int prev = lex->prev;
+  return prev == TOK_INT || prev == TOK_SYM || prev == TOK_FALSE ||
+         prev == TOK_TRUE || prev == TOK_U8 || prev == TOK_I8 ||
+         prev == TOK_U16 || prev == TOK_I16 || prev == TOK_U32 ||
+         prev == TOK_I32 || prev == TOK_U64 || prev == TOK_I64 ||
+         prev == TOK_BOOL || prev == TOK_LPAREN || prev == TOK_RPAREN;
 }
 
 static int
-skip_whitespace() {
+skip_whitespace(Lexer *lex) {
   int c;
-  while (!is_eof() && is_whitespace(peek_c())) {
-    if ((c = peek_c()) == '\t' || c == ' ') {
-      next_c();
+  while (!is_eof(lex) && is_whitespace(peek_c(lex))) {
+    if ((c = peek_c(lex)) == '\t' || c == ' ') {
+      next_c(lex);
     } else if (c == '\n') {
-      lex.line++;
-      next_c();
-      if (needs_newline()) {
-        lex.start = lex.end;
+      lex->line++;
+      next_c(lex);
+      if (needs_newline(lex)) {
+        lex->start = lex->end;
         return 1;
       }
     } else {
-      next_c();
+      next_c(lex);
     }
   }
-  lex.start = lex.end;
+  lex->start = lex->end;
   return 0;
 }
 
 static inline int
-match(int t, const char *name) {
-  if (strlen(name) != cur_len()) {
+match(Lexer *lex, int t, const char *name) {
+  if (strlen(name) != cur_len(lex)) {
     return TOK_SYM;
   }
-  if (strncmp((char *)name, (char *)lex.buf + lex.start, cur_len()) == 0) {
+  if (strncmp((char *)name, (char *)lex->buf + lex->start, cur_len(lex)) ==
+      0) {
     return t;
   }
   return TOK_SYM;
 }
 
 static int
-pick_symbol_type() {
-  switch (lex.buf[lex.start]) {
+pick_symbol_type(Lexer *lex) {
+  switch (lex->buf[lex->start]) {
     case 't':
-      return match(TOK_TRUE, "true");
+      return match(lex, TOK_TRUE, "true");
     case 'r':
-      return match(TOK_RETURN, "return");
+      return match(lex, TOK_RETURN, "return");
     case 'f':
-      return match(TOK_FALSE, "false");
+      return match(lex, TOK_FALSE, "false");
     case 'b':
-      return match(TOK_BOOL, "bool");
+      return match(lex, TOK_BOOL, "bool");
     case 'm':
-      return match(TOK_MUT, "mut");
+      return match(lex, TOK_MUT, "mut");
     case 'l':
-      return match(TOK_LET, "let");
+      return match(lex, TOK_LET, "let");
     case 'u':
-      if (cur_len() < 2) {
+      if (cur_len(lex) < 2) {
         return TOK_SYM;
       }
-      switch (lex.buf[lex.start + 1]) {
+      switch (lex->buf[lex->start + 1]) {
         case '8':
-          return match(TOK_U8, "u8");
+          return match(lex, TOK_U8, "u8");
         case '1':
-          return match(TOK_U16, "u16");
+          return match(lex, TOK_U16, "u16");
         case '3':
-          return match(TOK_U32, "u32");
+          return match(lex, TOK_U32, "u32");
         case '6':
-          return match(TOK_U64, "u64");
+          return match(lex, TOK_U64, "u64");
       }
       break;
     case 'i':
-      if (cur_len() < 2) {
+      if (cur_len(lex) < 2) {
         return TOK_SYM;
       }
-      switch (lex.buf[lex.start + 1]) {
+      switch (lex->buf[lex->start + 1]) {
         case '8':
-          return match(TOK_I8, "i8");
+          return match(lex, TOK_I8, "i8");
         case '1':
-          return match(TOK_I16, "i16");
+          return match(lex, TOK_I16, "i16");
         case '3':
-          return match(TOK_I32, "i32");
+          return match(lex, TOK_I32, "i32");
         case '6':
-          return match(TOK_I64, "i64");
+          return match(lex, TOK_I64, "i64");
       }
       break;
   }
@@ -157,157 +200,165 @@ pick_symbol_type() {
 }
 
 static Token
-make_symbol() {
+make_symbol(Lexer *lex) {
   int c;
-  while (!is_eof() && (isalpha(c = peek_c()) || isdigit(c) || c == '_')) {
-    next_c();
+  while (!is_eof(lex) && (isalpha(c = peek_c(lex)) || isdigit(c) || c == '_')) {
+    next_c(lex);
   }
-  return make_token(pick_symbol_type());
+  return make_token(lex, pick_symbol_type(lex));
 }
 
 static int
-next_matches(const char *text) {
+next_matches(Lexer *lex, const char *text) {
   size_t len = strlen(text);
-  if (lex.end + len >= lex.sz) {
+  if (!has_chars(lex, len + 1)) {
     return 0;
   }
-  if (strncmp(text, (char *)lex.buf + lex.end, len) == 0) {
-    lex.end += len;
+  if (strncmp(text, (char *)lex->buf + lex->end, len) == 0) {
+    lex->end += len;
     return 1;
   }
   return 0;
 }
 
 static inline Token
-make_intlit(int type) {
-  Token tok = make_token(TOK_INT);
+make_intlit(Lexer *lex, int type) {
+  Token tok = make_token(lex, TOK_INT);
   tok.intlit_type = type;
   return tok;
 }
 
 static Token
-make_int() {
-  while (!is_eof() && isdigit(peek_c())) {
-    next_c();
+make_int(Lexer *lex) {
+  while (!is_eof(lex) && isdigit(peek_c(lex))) {
+    next_c(lex);
   }
-  if (next_matches("i8"))
-    return make_intlit(INTLIT_I8);
-  if (next_matches("u8"))
-    return make_intlit(INTLIT_U8);
-  if (next_matches("i16"))
-    return make_intlit(INTLIT_I16);
-  if (next_matches("u16"))
-    return make_intlit(INTLIT_U16);
-  if (next_matches("i32"))
-    return make_intlit(INTLIT_I32);
-  if (next_matches("u32"))
-    return make_intlit(INTLIT_U32);
-  if (next_matches("i64"))
-    return make_intlit(INTLIT_I64);
-  if (next_matches("u64"))
-    return make_intlit(INTLIT_U64);
-  return make_intlit(INTLIT_I64_NONE);
+  if (next_matches(lex, "i8"))
+    return make_intlit(lex, INTLIT_I8);
+  if (next_matches(lex, "u8"))
+    return make_intlit(lex, INTLIT_U8);
+  if (next_matches(lex, "i16"))
+    return make_intlit(lex, INTLIT_I16);
+  if (next_matches(lex, "u16"))
+    return make_intlit(lex, INTLIT_U16);
+  if (next_matches(lex, "i32"))
+    return make_intlit(lex, INTLIT_I32);
+  if (next_matches(lex, "u32"))
+    return make_intlit(lex, INTLIT_U32);
+  if (next_matches(lex, "i64"))
+    return make_intlit(lex, INTLIT_I64);
+  if (next_matches(lex, "u64"))
+    return make_intlit(lex, INTLIT_U64);
+  return make_intlit(lex, INTLIT_I64_NONE);
 }
 
 static Token
-match_character(int c, int t1, int t2) {
-  if (is_eof()) {
-    return make_token(t2);
+match_character(Lexer *lex, int c, int t1, int t2) {
+  if (is_eof(lex)) {
+    return make_token(lex, t2);
   }
 
-  if (peek_c() == c) {
-    next_c();
-    return make_token(t1);
+  if (peek_c(lex) == c) {
+    next_c(lex);
+    return make_token(lex, t1);
   }
-  return make_token(t2);
+  return make_token(lex, t2);
 }
 
 static Token
-lexer_fetch() {
+lexer_fetch(Lexer *lex) {
+  if (lex->toks != NULL) {
+    return replay_token(lex);
+  }
+  Token tok;
+  if (lex->ring != NULL && token_ring_next(lex->ring, &tok)) {
+    return tok;
+  }
 
-  if (skip_whitespace()) {
-    return make_token(TOK_NEWLINE);
+  if (skip_whitespace(lex)) {
+    return make_token(lex, TOK_NEWLINE);
   }
 
-  if (is_eof())
-    return make_token(TOK_EOF);
+  if (is_eof(lex))
+    return make_token(lex, TOK_EOF);
 
-  int c = next_c();
+  int c = next_c(lex);
   if (isdigit(c)) {
-    return make_int();
+    return make_int(lex);
   }
   if (isalpha(c) || c == '_') {
-    return make_symbol();
+    return make_symbol(lex);
   }
   switch (c) {
     case '+':
-      return make_token(TOK_ADD);
+      return make_token(lex, TOK_ADD);
     case '-':
-      return make_token(TOK_SUB);
+      return make_token(lex, TOK_SUB);
     case '*':
-      return make_token(TOK_MUL);
+      return make_token(lex, TOK_MUL);
     case '/':
-      return make_token(TOK_DIV);
+      return make_token(lex, TOK_DIV);
     case '=':
-      if (is_eof()) {
-        return make_token(TOK_EQ);
+      if (is_eof(lex)) {
+        return make_token(lex, TOK_EQ);
       }
-      if (peek_c() == '=') {
-        next_c();
-        return make_token(TOK_DEQ);
+      if (peek_c(lex) == '=') {
+        next_c(lex);
+        return make_token(lex, TOK_DEQ);
       }
-      return make_token(TOK_EQ);
+      return make_token(lex, TOK_EQ);
     case '>':
-      return match_character('=', TOK_GREQ, TOK_GR);
+      return match_character(lex, '=', TOK_GREQ, TOK_GR);
     case '<':
-      return match_character('=', TOK_LEEQ, TOK_LE);
+      return match_character(lex, '=', TOK_LEEQ, TOK_LE);
     case '!':
-      return match_character('=', TOK_NOT, TOK_NEQ);
+      return match_character(lex, '=', TOK_NOT, TOK_NEQ);
     case '(':
-      return make_token(TOK_LPAREN);
+      return make_token(lex, TOK_LPAREN);
     case ')':
-      return make_token(TOK_RPAREN);
+      return make_token(lex, TOK_RPAREN);
     case '{':
-      return make_token(TOK_LCURLY);
+      return make_token(lex, TOK_LCURLY);
     case '}':
-      return make_token(TOK_RCURLY);
+      return make_token(lex, TOK_RCURLY);
     case '[':
-      return make_token(TOK_LBRACK);
+      return make_token(lex, TOK_LBRACK);
     case ']':
-      return make_token(TOK_RBRACK);
+      return make_token(lex, TOK_RBRACK);
     case ';':
-      return make_token(TOK_NEWLINE);
+      return make_token(lex, TOK_NEWLINE);
     case ':':
-      return make_token(TOK_COLON);
+      return make_token(lex, TOK_COLON);
     case ',':
-      return make_token(TOK_COMMA);
+      return make_token(lex, TOK_COMMA);
     default:
-      log_unexpected_char(make_pos(lex.buf + lex.start, cur_len(), lex.line),
-                          c);
-      return lexer_fetch();
+      log_unexpected_char(
+          lex->ctx, make_pos(lex->buf + lex->start, cur_len(lex), lex->line),
+          c);
+      return lexer_fetch(lex);
   }
-  return make_token(TOK_EOF); /* unreachable */
+  return make_token(lex, TOK_EOF); /* unreachable */
 }
 
 Token
-lexer_next() {
-  if (lex.peekf) {
-    lex.peekf = 0;
-    return lex.peek;
+lexer_next(Lexer *lex) {
+  if (lex->peekf) {
+    lex->peekf = 0;
+    return lex->peek;
   }
-  Token ret = lexer_fetch();
-  lex.prev = ret.t;
+  Token ret = lexer_fetch(lex);
+  lex->prev = ret.t;
   return ret;
 }
 
 Token
-lexer_peek() {
-  if (lex.peekf) {
-    return lex.peek;
+lexer_peek(Lexer *lex) {
+  if (lex->peekf) {
+    return lex->peek;
   }
-  Token ret = lexer_fetch();
-  lex.prev = ret.t;
-  lex.peekf = 1;
-  lex.peek = ret;
+  Token ret = lexer_fetch(lex);
+  lex->prev = ret.t;
+  lex->peekf = 1;
+  lex->peek = ret;
   return ret;
 }
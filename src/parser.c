@@ -1,13 +1,12 @@
 #include "parser.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "error.h"
 #include "ast.h"
 #include "lexer.h"
 
-const uint8_t *src_base;
-
 static Expr *
 make_expr(AST *ast, int t, SourcePosition pos) {
   Expr *ret = mempool_alloc(&ast->pool, sizeof(Expr));
@@ -40,7 +39,7 @@ make_intlit_expr(AST *ast, SourcePosition whole_pos, int t) {
   whole_pos.sz -= intlit_pos_sz[t];
   if (pos_to_num(whole_pos, &ret->data.intlit.val)) {
     whole_pos.sz += intlit_pos_sz[t];
-    log_intlit_overflow(whole_pos, whole_pos);
+    log_intlit_overflow(ast->ctx, whole_pos, whole_pos);
   }
   ret->data.intlit.type = t;
   return ret;
@@ -48,20 +47,20 @@ make_intlit_expr(AST *ast, SourcePosition whole_pos, int t) {
 
 static Expr *
 parse_funcall(AST *ast, Token name_tok) {
-  lexer_next();
+  lexer_next(&ast->ctx->lex);
   Vector args;
   vector_init(&args, sizeof(Expr *), &ast->pool);
-  while (lexer_peek().t != TOK_RPAREN) {
+  while (lexer_peek(&ast->ctx->lex).t != TOK_RPAREN) {
     Expr *temp = parse_expr(ast);
     vector_push(&args, &temp);
-    if (lexer_peek().t != TOK_COMMA) {
+    if (lexer_peek(&ast->ctx->lex).t != TOK_COMMA) {
       break;
     }
-    lexer_next();
+    lexer_next(&ast->ctx->lex);
   }
-  Token last_paren = lexer_next();
+  Token last_paren = lexer_next(&ast->ctx->lex);
   if (last_paren.t != TOK_RPAREN) {
-    log_expected_closing_paren(last_paren.pos);
+    log_expected_closing_paren(ast->ctx, last_paren.pos);
   }
   Expr *ret =
       make_expr(ast, EXPR_FUNCALL, combine_pos(name_tok.pos, last_paren.pos));
@@ -72,35 +71,35 @@ parse_funcall(AST *ast, Token name_tok) {
 
 static Expr *
 parse_primary(AST *ast) {
-  Token tok = lexer_next();
+  Token tok = lexer_next(&ast->ctx->lex);
   switch (tok.t) {
     case TOK_INT:
       return make_intlit_expr(ast, tok.pos, tok.intlit_type);
     case TOK_SYM:
-      if (lexer_peek().t == TOK_LPAREN) {
+      if (lexer_peek(&ast->ctx->lex).t == TOK_LPAREN) {
         return parse_funcall(ast, tok);
       }
       return make_expr(ast, EXPR_VAR, tok.pos);
     case TOK_LPAREN:
       {
         Expr *ret = parse_expr(ast);
-        Token _closing_paren = lexer_next();
+        Token _closing_paren = lexer_next(&ast->ctx->lex);
         if (_closing_paren.t != TOK_RPAREN) {
-          log_expected_closing_paren(_closing_paren.pos);
+          log_expected_closing_paren(ast->ctx, _closing_paren.pos);
         }
         return ret;
       }
     default:
       {
-        log_expected_expression(tok.pos);
+        log_expected_expression(ast->ctx, tok.pos);
         return NULL; /* unreachable */
       }
   }
 }
 
 static int
-parse_binop() {
-  Token tok = lexer_next();
+parse_binop(AST *ast) {
+  Token tok = lexer_next(&ast->ctx->lex);
   switch (tok.t) {
     case TOK_ADD:
       return BINOP_ADD;
@@ -132,8 +131,8 @@ static Expr *
 parse_factor(AST *ast) {
   Expr *ret = parse_primary(ast);
   Token tok;
-  while ((tok = lexer_peek()).t == TOK_MUL || tok.t == TOK_DIV) {
-    int op = parse_binop();
+  while ((tok = lexer_peek(&ast->ctx->lex)).t == TOK_MUL || tok.t == TOK_DIV) {
+    int op = parse_binop(ast);
     Expr *right = parse_primary(ast);
     Expr *new_ret =
         make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
@@ -149,8 +148,8 @@ static Expr *
 parse_term(AST *ast) {
   Expr *ret = parse_factor(ast);
   Token tok;
-  while ((tok = lexer_peek()).t == TOK_ADD || tok.t == TOK_SUB) {
-    int op = parse_binop();
+  while ((tok = lexer_peek(&ast->ctx->lex)).t == TOK_ADD || tok.t == TOK_SUB) {
+    int op = parse_binop(ast);
     Expr *right = parse_factor(ast);
     Expr *new_ret =
         make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
@@ -166,10 +165,10 @@ static Expr *
 parse_comp(AST *ast) {
   Expr *ret = parse_term(ast);
   Token tok;
-  while ((tok = lexer_peek()).t == TOK_DEQ || tok.t == TOK_NEQ ||
+  while ((tok = lexer_peek(&ast->ctx->lex)).t == TOK_DEQ || tok.t == TOK_NEQ ||
          tok.t == TOK_GR || tok.t == TOK_LE || tok.t == TOK_GREQ ||
          tok.t == TOK_LEEQ) {
-    int op = parse_binop();
+    int op = parse_binop(ast);
     Expr *right = parse_term(ast);
     Expr *new_ret =
         make_expr(ast, EXPR_BINOP, combine_pos(ret->pos, right->pos));
@@ -189,7 +188,7 @@ parse_expr(AST *ast) {
 static Type *
 parse_type(AST *ast) {
   (void)ast; /* will need this later for allocations */
-  Token type_tok = lexer_next();
+  Token type_tok = lexer_next(&ast->ctx->lex);
   switch (type_tok.t) {
     case TOK_U8:
       return &U8_const;
@@ -210,46 +209,46 @@ parse_type(AST *ast) {
     case TOK_BOOL:
       return &bool_const;
     default:
-      log_expected_type(type_tok.pos);
+      log_expected_type(ast->ctx, type_tok.pos);
       return NULL;
   }
 }
 
 static void
 parse_let(AST *ast, Stmt *stmt, int mut) {
-  Token first_tok = lexer_next();
+  Token first_tok = lexer_next(&ast->ctx->lex);
   stmt->t = STMT_LET;
-  Token var_name = lexer_next();
+  Token var_name = lexer_next(&ast->ctx->lex);
   if (var_name.t != TOK_SYM) {
-    log_expected_name(var_name.pos);
+    log_expected_name(ast->ctx, var_name.pos);
   }
 
   Token last_tok;
-  Token middle_tok = lexer_next();
+  Token middle_tok = lexer_next(&ast->ctx->lex);
   if (middle_tok.t == TOK_EQ) {
     stmt->data.let.value = parse_expr(ast);
     stmt->data.let.type = NULL;
-    last_tok = lexer_next();
+    last_tok = lexer_next(&ast->ctx->lex);
     if (last_tok.t != TOK_NEWLINE) {
-      log_expected_newline(last_tok.pos);
+      log_expected_newline(ast->ctx, last_tok.pos);
     }
   } else if (middle_tok.t == TOK_COLON) {
     stmt->data.let.type = parse_type(ast);
-    Token equal_tok = lexer_next();
+    Token equal_tok = lexer_next(&ast->ctx->lex);
     if (equal_tok.t == TOK_EQ) {
       stmt->data.let.value = parse_expr(ast);
-      last_tok = lexer_next();
+      last_tok = lexer_next(&ast->ctx->lex);
       if (last_tok.t != TOK_NEWLINE) {
-        log_expected_newline(last_tok.pos);
+        log_expected_newline(ast->ctx, last_tok.pos);
       }
     } else if (equal_tok.t == TOK_NEWLINE) {
       last_tok = equal_tok;
       stmt->data.let.value = NULL;
     } else {
-      log_expected_equals(equal_tok.pos);
+      log_expected_equals(ast->ctx, equal_tok.pos);
     }
   } else {
-    log_expected_equals(middle_tok.pos);
+    log_expected_equals(ast->ctx, middle_tok.pos);
   }
 
   stmt->pos = combine_pos(first_tok.pos, last_tok.pos);
@@ -261,34 +260,36 @@ static void
 parse_expr_stmt(AST *ast, Stmt *stmt) {
   stmt->t = STMT_EXPR;
   stmt->data.expr = parse_expr(ast);
-  Token _newline = lexer_next();
+  Token _newline = lexer_next(&ast->ctx->lex);
   if (_newline.t != TOK_NEWLINE) {
-    log_expected_newline(_newline.pos);
+    log_expected_newline(ast->ctx, _newline.pos);
   }
+  stmt->pos = combine_pos(stmt->data.expr->pos, _newline.pos);
 }
 
 static void
 parse_return(AST *ast, Stmt *stmt) {
-  lexer_next(); /* skip 'return' */
+  Token return_tok = lexer_next(&ast->ctx->lex);
   stmt->t = STMT_RETURN;
-  if (lexer_peek().t == TOK_NEWLINE) {
-    lexer_next();
+  if (lexer_peek(&ast->ctx->lex).t == TOK_NEWLINE) {
+    stmt->pos = combine_pos(return_tok.pos, lexer_next(&ast->ctx->lex).pos);
     stmt->data.ret = NULL;
   } else {
     stmt->data.ret = parse_expr(ast);
-    Token _newline = lexer_next();
+    Token _newline = lexer_next(&ast->ctx->lex);
     if (_newline.t != TOK_NEWLINE) {
-      log_expected_newline(_newline.pos);
+      log_expected_newline(ast->ctx, _newline.pos);
     }
+    stmt->pos = combine_pos(return_tok.pos, _newline.pos);
   }
 }
 
 void
 parse_block(Block *block, AST *ast) {
-  lexer_next(); /* skip '{' */
+  lexer_next(&ast->ctx->lex); /* skip '{' */
   vector_init(&block->stmts, sizeof(Stmt), &ast->pool);
   while (1) {
-    switch (lexer_peek().t) {
+    switch (lexer_peek(&ast->ctx->lex).t) {
       case TOK_LET:
         parse_let(ast, vector_alloc(&block->stmts), 0);
         break;
@@ -300,7 +301,7 @@ parse_block(Block *block, AST *ast) {
         break;
       /* TODO: Replace this with '}' for proper blocks */
       case TOK_RCURLY:
-        lexer_next();
+        lexer_next(&ast->ctx->lex);
         return;
       default:
         parse_expr_stmt(ast, vector_alloc(&block->stmts));
@@ -310,55 +311,81 @@ parse_block(Block *block, AST *ast) {
 }
 
 void
-parse_fn(AST *ast, Function *function) {
-  Token name_tok = lexer_next();
+parse_fn_header(AST *ast, Function *function) {
+  Token name_tok = lexer_next(&ast->ctx->lex);
   if (name_tok.t != TOK_SYM) {
-    log_expected_name(name_tok.pos);
+    log_expected_name(ast->ctx, name_tok.pos);
   }
   function->name = name_tok.pos;
   function->pos = name_tok.pos;
 
-  Token _lparen = lexer_next();
+  Token _lparen = lexer_next(&ast->ctx->lex);
   if (_lparen.t != TOK_LPAREN) {
-    log_expected_opening_paren(_lparen.pos);
+    log_expected_opening_paren(ast->ctx, _lparen.pos);
   }
 
   vector_init(&function->params, sizeof(Param), &ast->pool);
 
-  while (lexer_peek().t != TOK_RPAREN) {
+  while (lexer_peek(&ast->ctx->lex).t != TOK_RPAREN) {
     Param *param = vector_alloc(&function->params);
-    Token name_tok = lexer_next();
+    Token name_tok = lexer_next(&ast->ctx->lex);
     if (name_tok.t != TOK_SYM) {
-      log_expected_name(name_tok.pos);
+      log_expected_name(ast->ctx, name_tok.pos);
     }
     param->name = name_tok.pos;
 
     param->type = parse_type(ast);
-    if (lexer_peek().t == TOK_COMMA) {
-      lexer_next();
+    if (lexer_peek(&ast->ctx->lex).t == TOK_COMMA) {
+      lexer_next(&ast->ctx->lex);
     }
   }
-  lexer_next(); /* skip ')' */
+  lexer_next(&ast->ctx->lex); /* skip ')' */
 
   function->ret_type = &void_const;
-  if (lexer_peek().t != TOK_LCURLY) {
+  if (lexer_peek(&ast->ctx->lex).t != TOK_LCURLY) {
     function->ret_type = parse_type(ast);
   }
+}
 
+void
+parse_fn(AST *ast, Function *function) {
+  parse_fn_header(ast, function);
   parse_block(&function->body, ast);
 }
 
-AST
-parse_ast(const uint8_t *src) {
-  AST ret;
-
-  ast_init(&ret, src);
-  ast_init(&ret, src);
+/* like parse_block, the first token is taken to be the '{' */
+static void
+skip_body(Lexer *lex, FnExtent *extent, bool names) {
+  Token tok = lexer_next(lex);
+  while ((tok = lexer_next(lex)).t != TOK_RCURLY && tok.t != TOK_EOF) {
+    if (names && tok.t == TOK_SYM) {
+      vector_push(&extent->names, &tok.pos);
+    }
+  }
+  extent->total_sz = tok.pos.start + tok.pos.sz - extent->start;
+}
 
-  while (lexer_peek().t != TOK_EOF) {
-    parse_fn(&ret, vector_alloc(&ret.fns));
+void
+parse_fn_headers(AST *ast, Vector *extents, MemPool *pool, bool names) {
+  Lexer *lex = &ast->ctx->lex;
+  while (lexer_peek(lex).t != TOK_EOF) {
+    FnExtent *extent = vector_alloc(extents);
+    extent->start = lexer_peek(lex).pos.start;
+    parse_fn_header(ast, vector_alloc(&ast->fns));
+    extent->sig_sz = lexer_peek(lex).pos.start - extent->start;
+    extent->body = *lex;
+    if (names) {
+      vector_init(&extent->names, sizeof(SourcePosition), pool);
+    } else {
+      memset(&extent->names, 0, sizeof(Vector));
+    }
+    skip_body(lex, extent, names);
   }
+}
 
-  src_base = src;
-  return ret;
+void
+parse_ast(AST *ast) {
+  while (lexer_peek(&ast->ctx->lex).t != TOK_EOF) {
+    parse_fn(ast, vector_alloc(&ast->fns));
+  }
 }
@@ -0,0 +1,273 @@
+#include "passes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver.h"
+#include "threadpool.h"
+
+const Pass pass_tbl[] = {
+    [PASS_VERIFY] = {.name = "verify",
+                     .description = "checks that every function is well "
+                                    "formed",
+                     .run_fn = pass_verify_fn,
+                     .run_prog = pass_verify},
+    [PASS_COMPACT_REGS] = {.name = "compact-regs",
+                           .description = "numbers the registers densely "
+                                          "again",
+                           .run_fn = pass_compact_regs},
+    [PASS_SCCP] = {.name = "sccp",
+                   .description = "propagates and folds constants, and "
+                                  "removes the blocks branches never go to",
+                   .run_fn = pass_sccp},
+    [PASS_GVN] = {.name = "gvn",
+                  .description = "removes computations of values that are "
+                                 "already known",
+                  .run_fn = pass_gvn},
+    [PASS_COPY_PROP] = {.name = "copy-prop",
+                        .description = "reads what copies copy instead of "
+                                       "the copies",
+                        .run_fn = pass_copy_prop},
+    [PASS_DCE] = {.name = "dce",
+                  .description = "removes the instructions whose results "
+                                 "aren't needed",
+                  .run_fn = pass_dce},
+    [PASS_INSTCOMBINE] = {.name = "instcombine",
+                          .description = "simplifies arithmetic, and divides "
+                                         "by constants without dividing",
+                          .run_fn = pass_instcombine},
+};
+
+/* the pipelines of the optimization levels, as --passes would take them.
+ * -O1 keeps to the passes that take a single walk over the function, and
+ * leaves out gvn, which needs the dominator tree, and instcombine */
+static const struct {
+  const char *level;
+  const char *passes;
+} level_tbl[] = {
+    {"0", ""},
+    {"1", "copy-prop,sccp,dce,compact-regs"},
+    {"2", "copy-prop,sccp,instcombine,gvn,dce,compact-regs"},
+    {"s", "copy-prop,sccp,gvn,dce,compact-regs"},
+};
+
+bool
+pass_pipeline_level(PassPipeline *pl, const char *level) {
+  for (size_t i = 0; i < sizeof(level_tbl) / sizeof(level_tbl[0]); i++) {
+    if (strcmp(level, level_tbl[i].level) == 0) {
+      if (pass_pipeline_parse(pl, level_tbl[i].passes) != NULL) {
+        log_internal_err("bad pipeline for -O%s", level);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *
+pass_pipeline_parse(PassPipeline *pl, const char *list) {
+  pl->npasses = 0;
+  const char *iter = list;
+  while (*iter != '\0') {
+    size_t len = strcspn(iter, ",");
+    PassId id = 0;
+    while (id < PASS_COUNT && (strlen(pass_tbl[id].name) != len ||
+                               memcmp(pass_tbl[id].name, iter, len) != 0)) {
+      id++;
+    }
+    if (id == PASS_COUNT) {
+      return "'%s' names a pass that doesn't exist";
+    }
+    if (pl->npasses == PASS_PIPELINE_MAX) {
+      return "'%s' has too many passes";
+    }
+    pl->passes[pl->npasses++] = id;
+    iter += len;
+    if (*iter == ',') {
+      iter++;
+    }
+  }
+  return NULL;
+}
+
+void
+pass_manager_init(PassManager *pm, const PassPipeline *pipeline,
+                  size_t nworkers) {
+  pm->pipeline = pipeline;
+  pm->nworkers = nworkers == 0 ? 1 : nworkers;
+  pm->pools = NULL;
+  pm->scratch = NULL;
+  pm->npools = 0;
+  memset(pm->stats, 0, sizeof(pm->stats));
+}
+
+/* makes sure the first n workers have their pools */
+static void
+reserve_pools(PassManager *pm, size_t n) {
+  if (pm->pools == NULL) {
+    pm->pools = malloc(pm->nworkers * sizeof(MemPool));
+    pm->scratch = malloc(pm->nworkers * sizeof(MemPool));
+  }
+  for (; pm->npools < n; pm->npools++) {
+    mempool_init(&pm->pools[pm->npools]);
+    mempool_init(&pm->scratch[pm->npools]);
+  }
+}
+
+static void
+run_fn_pass(SSA_Fn *fn, PassId id, PassContext *pc, PassStats *stats) {
+  MemPoolMark mark = mempool_mark(pc->scratch);
+  size_t inserted = fn->ninserted;
+  size_t removed = fn->nremoved;
+  uint64_t start = time_now_ns();
+  pass_tbl[id].run_fn(fn, pc);
+  stats->ns += time_now_ns() - start;
+  stats->runs++;
+  stats->added += fn->ninserted - inserted;
+  stats->removed += fn->nremoved - removed;
+  mempool_release(pc->scratch, mark);
+}
+
+/* function passes that follow each other, run over every function */
+typedef struct {
+  PassManager *pm;
+  SSA_Prog *prog;
+  const uint8_t *passes;
+  size_t npasses;
+  size_t next;      /* the next function, only touched atomically */
+  PassStats *stats; /* PASS_COUNT of them for every worker */
+} FnPassRun;
+
+static void
+fn_pass_worker(void *data, size_t worker) {
+  FnPassRun *run = data;
+  PassContext pc = {&run->pm->pools[worker], &run->pm->scratch[worker]};
+  PassStats *stats = &run->stats[worker * PASS_COUNT];
+  size_t i;
+  while ((i = __atomic_fetch_add(&run->next, 1, __ATOMIC_RELAXED)) <
+         run->prog->fns.items) {
+    SSA_Fn *fn = vector_idx(&run->prog->fns, i);
+    /* a function may have been given to another worker before */
+    ssa_fn_set_pool(fn, pc.pool);
+    for (size_t p = 0; p < run->npasses; p++) {
+      run_fn_pass(fn, run->passes[p], &pc, &stats[run->passes[p]]);
+    }
+  }
+}
+
+static void
+run_fn_passes(PassManager *pm, SSA_Prog *prog, const uint8_t *passes,
+              size_t npasses) {
+  size_t nworkers = pm->nworkers;
+  if (nworkers > prog->fns.items) {
+    nworkers = prog->fns.items;
+  }
+  if (nworkers == 0) {
+    return;
+  }
+  reserve_pools(pm, nworkers);
+  PassStats *stats = calloc(nworkers * PASS_COUNT, sizeof(PassStats));
+  FnPassRun run = {.pm = pm,
+                   .prog = prog,
+                   .passes = passes,
+                   .npasses = npasses,
+                   .next = 0,
+                   .stats = stats};
+  /* a job for every worker, which takes functions until none are left */
+  threadpool_run(nworkers, nworkers, fn_pass_worker, &run);
+  for (size_t i = 0; i < nworkers * PASS_COUNT; i++) {
+    PassStats *from = &stats[i];
+    PassStats *to = &pm->stats[i % PASS_COUNT];
+    to->runs += from->runs;
+    to->ns += from->ns;
+    to->added += from->added;
+    to->removed += from->removed;
+  }
+  free(stats);
+}
+
+/* the instructions ever added to and removed from the program's functions */
+static void
+count_changes(SSA_Prog *prog, size_t *inserted, size_t *removed) {
+  *inserted = 0;
+  *removed = 0;
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    SSA_Fn *fn = vector_idx(&prog->fns, i);
+    *inserted += fn->ninserted;
+    *removed += fn->nremoved;
+  }
+}
+
+/* runs on the calling thread, with the pools of the first worker */
+static void
+run_prog_pass(PassManager *pm, SSA_Prog *prog, PassId id) {
+  reserve_pools(pm, 1);
+  PassContext pc = {&pm->pools[0], &pm->scratch[0]};
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    ssa_fn_set_pool(vector_idx(&prog->fns, i), pc.pool);
+  }
+  size_t inserted, removed;
+  count_changes(prog, &inserted, &removed);
+
+  PassStats *stats = &pm->stats[id];
+  MemPoolMark mark = mempool_mark(pc.scratch);
+  uint64_t start = time_now_ns();
+  pass_tbl[id].run_prog(prog, &pc);
+  stats->ns += time_now_ns() - start;
+  stats->runs++;
+  mempool_release(pc.scratch, mark);
+
+  size_t inserted_after, removed_after;
+  count_changes(prog, &inserted_after, &removed_after);
+  stats->added += inserted_after - inserted;
+  stats->removed += removed_after - removed;
+}
+
+void
+pass_manager_run(PassManager *pm, SSA_Prog *prog) {
+  const PassPipeline *pl = pm->pipeline;
+  size_t i = 0;
+  while (i < pl->npasses) {
+    PassId id = pl->passes[i];
+    if (pass_tbl[id].run_prog != NULL) {
+      run_prog_pass(pm, prog, id);
+      i++;
+      continue;
+    }
+    size_t end = i;
+    while (end < pl->npasses && pass_tbl[pl->passes[end]].run_prog == NULL) {
+      end++;
+    }
+    run_fn_passes(pm, prog, &pl->passes[i], end - i);
+    i = end;
+  }
+}
+
+void
+pass_manager_run_fn(PassManager *pm, SSA_Fn *fn, MemPool *pool) {
+  reserve_pools(pm, 1);
+  PassContext pc = {pool, &pm->scratch[0]};
+  ssa_fn_set_pool(fn, pool);
+  const PassPipeline *pl = pm->pipeline;
+  for (size_t i = 0; i < pl->npasses; i++) {
+    PassId id = pl->passes[i];
+    if (pass_tbl[id].run_fn != NULL) {
+      run_fn_pass(fn, id, &pc, &pm->stats[id]);
+    }
+  }
+}
+
+void
+pass_manager_deinit(PassManager *pm) {
+  for (size_t i = 0; i < pm->npools; i++) {
+    mempool_deinit(&pm->pools[i]);
+    mempool_deinit(&pm->scratch[i]);
+  }
+  free(pm->pools);
+  free(pm->scratch);
+}
+
+void
+pass_compact_regs(SSA_Fn *fn, PassContext *pc) {
+  ssa_fn_compact_regs(fn, pc->scratch);
+}
@@ -0,0 +1,175 @@
+#define _GNU_SOURCE
+#include "per_function.h"
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "ir_gen.h"
+#include "parser.h"
+#include "passes.h"
+#include "semantics.h"
+#include "ssa.h"
+
+/* The dumps are staged in unlinked temporary files rather than in memory,
+ * and only copied to the output once the whole file compiled, since a file
+ * with errors has nothing but the errors in its output */
+typedef struct {
+  FILE *ast;
+  FILE *ir;
+  Emitter ast_em; /* set up for the files that are there */
+  Emitter ir_em;
+} Dumps;
+
+static void
+copy_dump(FILE *from, FILE *to) {
+  char buf[65536];
+  size_t got;
+  rewind(from);
+  while ((got = fread(buf, 1, sizeof(buf), from)) != 0) {
+    fwrite(buf, 1, got, to);
+  }
+}
+
+/* runs one function through everything after the signatures, and frees all
+ * of it but its signature */
+static void
+compile_function(AST *ast, SSA_Prog *prog, size_t idx, Lexer *body,
+                 CompileOptions *opts, PassManager *pm, Dumps *dumps,
+                 TimeReport *times) {
+  BoncContext *ctx = ast->ctx;
+  Function *fn = vector_idx(&ast->fns, idx);
+  SSA_Fn *ssa_fn = vector_idx(&prog->fns, idx);
+  MemPoolMark ast_mark = mempool_mark(&ast->pool);
+  MemPoolMark prog_mark = mempool_mark(&prog->pool);
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+
+  ctx->lex = *body;
+  parse_block(&fn->body, ast);
+  time_report_phase(times, PHASE_PARSE, &start);
+  resolve_fn_names(ast, fn);
+  time_report_phase(times, PHASE_NAMES, &start);
+  resolve_fn_types(ast, fn);
+  time_report_phase(times, PHASE_TYPES, &start);
+  check_fn_returns(ast, fn);
+  time_report_phase(times, PHASE_RETURNS, &start);
+  translate_function(fn, ssa_fn, &prog->pool, &ctx->scratch);
+  time_report_phase(times, PHASE_IR, &start);
+  /* what the passes add goes with the rest of the function */
+  if (opts->passes.npasses != 0) {
+    pass_manager_run_fn(pm, ssa_fn, &prog->pool);
+    time_report_phase(times, PHASE_OPT, &start);
+  }
+
+  if (opts->dump_ast) {
+    ast_fn_dump(&dumps->ast_em, fn);
+  }
+  if (opts->dump_ir) {
+    function_dump(&dumps->ir_em, ssa_fn, opts->dump_reg);
+  }
+  time_report_phase(times, PHASE_DUMP, &start);
+
+  /* only the names are kept, for the calls to the function */
+  memset(&fn->body, 0, sizeof(Block));
+  fn->scope = NULL;
+  SourcePosition name = ssa_fn->name;
+  memset(ssa_fn, 0, sizeof(SSA_Fn));
+  ssa_fn->name = name;
+  mempool_release(&ast->pool, ast_mark);
+  mempool_release(&prog->pool, prog_mark);
+}
+
+/* the parts that can bail out, everything allocated is owned by the caller */
+static bool
+run_per_function(BoncContext *ctx, CompileOptions *opts, FILE *out, AST *ast,
+                 SSA_Prog *prog, PassManager *pm, Dumps *dumps,
+                 TimeReport *times) {
+  MemPoolMark scratch_mark = mempool_mark(&ctx->scratch);
+  jmp_buf bailout;
+  if (setjmp(bailout)) {
+    mempool_release(&ctx->scratch, scratch_mark);
+    ctx->bailout = NULL;
+    return false;
+  }
+  ctx->bailout = &bailout;
+  uint64_t start = times == NULL ? 0 : time_now_ns();
+
+  Vector extents;
+  vector_init(&extents, sizeof(FnExtent), &ctx->scratch);
+  parse_fn_headers(ast, &extents, &ctx->scratch, false);
+  errors_output(ctx);
+  time_report_phase(times, PHASE_PARSE, &start);
+
+  declare_fns(ast);
+  time_report_phase(times, PHASE_NAMES, &start);
+  declare_fn_types(ast);
+  time_report_phase(times, PHASE_TYPES, &start);
+
+  declare_ssa_fns(ast, prog);
+  time_report_phase(times, PHASE_IR, &start);
+
+  for (size_t i = 0; i < ast->fns.items; i++) {
+    FnExtent *extent = vector_idx(&extents, i);
+    compile_function(ast, prog, i, &extent->body, opts, pm, dumps, times);
+  }
+
+  start = times == NULL ? 0 : time_now_ns();
+  if (opts->dump_ast) {
+    fprintf(out, "AST_DUMP:\n");
+    emitter_flush(&dumps->ast_em);
+    copy_dump(dumps->ast, out);
+    fprintf(out, "\n");
+  }
+  if (opts->dump_ir) {
+    fprintf(out, "IR_DUMP:\n");
+    emitter_flush(&dumps->ir_em);
+    copy_dump(dumps->ir, out);
+  }
+  time_report_phase(times, PHASE_DUMP, &start);
+  mempool_release(&ctx->scratch, scratch_mark);
+  ctx->bailout = NULL;
+  return true;
+}
+
+bool
+compile_per_function(BoncContext *ctx, CompileOptions *opts, FILE *out,
+                     TimeReport *times) {
+  AST ast;
+  SSA_Prog prog;
+  prog.pool.base = NULL;
+  ast_init(&ast, ctx);
+
+  Dumps dumps = {.ast = NULL, .ir = NULL};
+  if ((opts->dump_ast && (dumps.ast = tmpfile()) == NULL) ||
+      (opts->dump_ir && (dumps.ir = tmpfile()) == NULL)) {
+    log_internal_err("unable to create a temporary file for the dumps", NULL);
+  }
+  if (dumps.ast != NULL) {
+    emitter_init(&dumps.ast_em, dumps.ast);
+  }
+  if (dumps.ir != NULL) {
+    emitter_init(&dumps.ir_em, dumps.ir);
+  }
+
+  PassManager pm;
+  pass_manager_init(&pm, &opts->passes, 1);
+
+  bool ok = run_per_function(ctx, opts, out, &ast, &prog, &pm, &dumps, times);
+
+  time_report_passes(times, &pm);
+  pass_manager_deinit(&pm);
+  if (dumps.ast != NULL) {
+    emitter_deinit(&dumps.ast_em);
+    fclose(dumps.ast);
+  }
+  if (dumps.ir != NULL) {
+    emitter_deinit(&dumps.ir_em);
+    fclose(dumps.ir);
+  }
+  if (prog.pool.base != NULL) {
+    bonc_context_pool_put(ctx, &prog.pool);
+  }
+  ast_deinit(&ast);
+  return ok;
+}
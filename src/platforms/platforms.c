@@ -1,8 +1,20 @@
 #include "platforms.h"
 
+#include <string.h>
+
 Platform *platforms[] = {
     &platform_x86_64_sysv,
     &platform_riscv_64,
     NULL,
 };
 
+Platform *
+platform_find(const char *name) {
+  for (size_t i = 0; platforms[i] != NULL; i++) {
+    if (strcmp(platforms[i]->name, name) == 0) {
+      return platforms[i];
+    }
+  }
+  return NULL;
+}
+
@@ -0,0 +1,327 @@
+#include <string.h>
+
+#include "cfg.h"
+#include "passes.h"
+
+/* Sparse conditional constant propagation, as in Wegman and Zadeck,
+ * "Constant Propagation with Conditional Branches". Every register starts out
+ * unknown and only ever moves down to a constant and then to varying, while
+ * only the blocks that can be reached from the entry, through the edges of
+ * branches whose condition isn't known to go the other way, are looked at. A
+ * register whose value moves has its users looked at again, through the use
+ * chains, so every instruction is looked at a bounded number of times */
+
+typedef enum {
+  VAL_UNKNOWN,
+  VAL_CONST,
+  VAL_VARYING,
+} ValState;
+
+typedef struct {
+  uint64_t value; /* masked to the size of the register, if VAL_CONST */
+  uint8_t state;  /* ValState */
+} Value;
+
+typedef struct {
+  SSA_Fn *fn;
+  Value *values;   /* by register */
+  uint8_t *edges;  /* by block id, a bit for every successor taken */
+  uint8_t *reached; /* by block id */
+  /* the blocks reached but not looked at yet, each is added once */
+  SSA_BBlock **blocks;
+  size_t nblocks;
+  /* the registers whose value moved, each can move twice */
+  RegId *regs;
+  size_t nregs;
+} Sccp;
+
+static void
+set_value(Sccp *s, RegId reg, ValState state, uint64_t value) {
+  Value *val = &s->values[reg];
+  if (state == VAL_UNKNOWN || val->state == VAL_VARYING) {
+    return;
+  }
+  if (state == VAL_CONST && val->state == VAL_CONST) {
+    if (value == val->value) {
+      return;
+    }
+    /* two constants don't meet in one */
+    state = VAL_VARYING;
+  }
+  val->state = state;
+  val->value = value;
+  s->regs[s->nregs++] = reg;
+}
+
+static void
+take_edge(Sccp *s, SSA_BBlock *from, uint8_t succ);
+
+/* marks the edges of block that can be taken, by its last instruction */
+static void
+visit_edges(Sccp *s, SSA_BBlock *block) {
+  SSA_Inst *last = block->last;
+  if (last == NULL || last->t != INST_CBR) {
+    for (uint8_t i = 0; i < block->nsuccs; i++) {
+      take_edge(s, block, i);
+    }
+    return;
+  }
+  Value *cond = &s->values[last->data.br.cond];
+  if (cond->state == VAL_VARYING) {
+    for (uint8_t i = 0; i < block->nsuccs; i++) {
+      take_edge(s, block, i);
+    }
+  } else if (cond->state == VAL_CONST) {
+    SSA_BBlock *target = inst_targets(s->fn, last)[cond->value != 0 ? 0 : 1];
+    for (uint8_t i = 0; i < block->nsuccs; i++) {
+      if (block->succs[i] == target) {
+        take_edge(s, block, i);
+      }
+    }
+  }
+}
+
+static bool
+edge_taken(Sccp *s, SSA_BBlock *from, SSA_BBlock *to) {
+  for (uint8_t i = 0; i < from->nsuccs; i++) {
+    if (from->succs[i] == to && (s->edges[from->id] & (1 << i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* a phi meets the values coming in over the edges that can be taken */
+static void
+visit_phi(Sccp *s, SSA_BBlock *block, SSA_Inst *phi) {
+  ValState state = VAL_UNKNOWN;
+  uint64_t value = 0;
+  SSA_PhiArg *args = inst_phi_args(s->fn, phi);
+  for (uint32_t i = 0; i < phi->data.phi.nargs; i++) {
+    if (!edge_taken(s, args[i].block, block)) {
+      continue;
+    }
+    Value *arg = &s->values[args[i].reg];
+    if (arg->state == VAL_VARYING ||
+        (arg->state == VAL_CONST && state == VAL_CONST &&
+         arg->value != value)) {
+      state = VAL_VARYING;
+      break;
+    }
+    if (arg->state == VAL_CONST) {
+      state = VAL_CONST;
+      value = arg->value;
+    }
+  }
+  set_value(s, phi->result, state, value & sz_mask(phi->sz));
+}
+
+static void
+visit_inst(Sccp *s, SSA_BBlock *block, SSA_Inst *inst) {
+  if (inst->t == INST_PHI) {
+    visit_phi(s, block, inst);
+    return;
+  }
+  if (inst == block->last && inst->t == INST_CBR) {
+    visit_edges(s, block);
+  }
+  if (inst->result == 0) {
+    return;
+  }
+
+  uint64_t mask = sz_mask(inst->sz);
+  if (inst->t == INST_IMM) {
+    set_value(s, inst->result, VAL_CONST, inst_imm(s->fn, inst) & mask);
+  } else if (inst->t == INST_COPY) {
+    Value *from = &s->values[inst->data.operands[0]];
+    set_value(s, inst->result, from->state, from->value & mask);
+  } else if (inst_arity_tbl[inst->t] == 2) {
+    Value *a = &s->values[inst->data.operands[0]];
+    Value *b = &s->values[inst->data.operands[1]];
+    uint64_t result;
+    if (a->state == VAL_VARYING || b->state == VAL_VARYING) {
+      set_value(s, inst->result, VAL_VARYING, 0);
+    } else if (a->state == VAL_CONST && b->state == VAL_CONST) {
+      /* what can't be folded, such as a division by 0, is left for when the
+       * program runs */
+      if (inst_fold(inst->t, inst->sz, a->value, b->value, &result)) {
+        set_value(s, inst->result, VAL_CONST, result);
+      } else {
+        set_value(s, inst->result, VAL_VARYING, 0);
+      }
+    }
+  } else {
+    set_value(s, inst->result, VAL_VARYING, 0);
+  }
+}
+
+static void
+take_edge(Sccp *s, SSA_BBlock *from, uint8_t succ) {
+  if (s->edges[from->id] & (1 << succ)) {
+    return;
+  }
+  s->edges[from->id] |= 1 << succ;
+  SSA_BBlock *to = from->succs[succ];
+  if (!s->reached[to->id]) {
+    s->reached[to->id] = 1;
+    s->blocks[s->nblocks++] = to;
+    return;
+  }
+  /* only the phis see which edges come in */
+  for (SSA_Inst *inst = to->first; inst != NULL && inst->t == INST_PHI;
+       inst = inst->next) {
+    visit_phi(s, to, inst);
+  }
+}
+
+static void
+solve(Sccp *s) {
+  while (s->nblocks != 0 || s->nregs != 0) {
+    if (s->nblocks != 0) {
+      SSA_BBlock *block = s->blocks[--s->nblocks];
+      for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+        visit_inst(s, block, inst);
+      }
+      visit_edges(s, block);
+      continue;
+    }
+    SSA_DefUse *du = ssa_reg_defuse(s->fn, s->regs[--s->nregs]);
+    for (uint32_t i = 0; i < du->nuses; i++) {
+      if (s->reached[du->uses[i].block->id]) {
+        visit_inst(s, du->uses[i].block, du->uses[i].inst);
+      }
+    }
+  }
+}
+
+/* replaces inst, which is taken out, with one in its place */
+static void
+replace_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst, SSA_Inst *with) {
+  SSA_Inst *next = inst->next;
+  bblock_remove_inst(fn, block, inst);
+  bblock_insert_inst(fn, block, next, with);
+}
+
+/* drops the arguments of a phi that come over edges that are never taken */
+static void
+prune_phi(Sccp *s, SSA_BBlock *block, SSA_Inst *phi, MemPool *scratch) {
+  SSA_Fn *fn = s->fn;
+  SSA_PhiArg *args = inst_phi_args(fn, phi);
+  uint32_t nargs = phi->data.phi.nargs;
+  SSA_PhiArg *kept = mempool_alloc(scratch, nargs * sizeof(SSA_PhiArg));
+  uint32_t nkept = 0;
+  for (uint32_t i = 0; i < nargs; i++) {
+    if (edge_taken(s, args[i].block, block)) {
+      kept[nkept++] = args[i];
+    }
+  }
+  if (nkept == nargs || nkept == 0) {
+    return;
+  }
+  if (nkept == 1 && kept[0].reg != phi->result) {
+    ssa_replace_all_uses(fn, phi->result, kept[0].reg);
+    bblock_remove_inst(fn, block, phi);
+    return;
+  }
+  SSA_Inst with = {.t = INST_PHI, .sz = phi->sz, .result = phi->result};
+  inst_set_phi(fn, &with, kept, nkept);
+  replace_inst(fn, block, phi, &with);
+}
+
+static void
+rewrite_block(Sccp *s, SSA_BBlock *block, MemPool *scratch) {
+  SSA_Fn *fn = s->fn;
+  /* constant phis become immediates, which have to come after the phis */
+  SSA_Inst *body = block->first;
+  while (body != NULL && body->t == INST_PHI) {
+    body = body->next;
+  }
+
+  for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+    Value *val = &s->values[inst->result];
+    if (inst->result != 0 && val->state == VAL_CONST &&
+        inst->t != INST_IMM) {
+      SSA_Inst imm = {.t = INST_IMM, .sz = inst->sz, .result = inst->result};
+      inst_set_imm(fn, &imm, val->value);
+      if (inst->t == INST_PHI) {
+        bblock_remove_inst(fn, block, inst);
+        bblock_insert_inst(fn, block, body, &imm);
+      } else {
+        replace_inst(fn, block, inst, &imm);
+      }
+    } else if (inst->t == INST_PHI) {
+      prune_phi(s, block, inst, scratch);
+    } else if (inst == block->last && inst->t == INST_CBR &&
+               s->values[inst->data.br.cond].state == VAL_CONST) {
+      SSA_Inst br = {.t = INST_BR, .sz = SZ_NONE};
+      SSA_BBlock *target =
+          inst_targets(fn, inst)[s->values[inst->data.br.cond].value != 0
+                                      ? 0
+                                      : 1];
+      inst_set_targets(fn, &br, &target);
+      replace_inst(fn, block, inst, &br);
+    }
+  }
+}
+
+void
+pass_sccp(SSA_Fn *fn, PassContext *pc) {
+  if (!fn->has_uses) {
+    ssa_fn_build_uses(fn, pc->pool);
+  }
+  cfg_build(fn, pc->pool, pc->scratch);
+  size_t nblocks = ssa_number_blocks(fn);
+  size_t nregs = fn->regs.items;
+
+  Sccp s = {.fn = fn, .nblocks = 0, .nregs = 0};
+  s.values = mempool_alloc(pc->scratch, (nregs + 1) * sizeof(Value));
+  memset(s.values, 0, (nregs + 1) * sizeof(Value));
+  s.edges = mempool_alloc(pc->scratch, nblocks);
+  memset(s.edges, 0, nblocks);
+  s.reached = mempool_alloc(pc->scratch, nblocks);
+  memset(s.reached, 0, nblocks);
+  s.blocks = mempool_alloc(pc->scratch, nblocks * sizeof(SSA_BBlock *));
+  s.regs = mempool_alloc(pc->scratch, 2 * (nregs + 1) * sizeof(RegId));
+
+  /* what isn't set by an instruction, parameters included, could be
+   * anything */
+  for (RegId reg = 1; reg <= nregs; reg++) {
+    if (ssa_reg_def(fn, reg) == NULL) {
+      s.values[reg].state = VAL_VARYING;
+    }
+  }
+  s.values[0].state = VAL_VARYING;
+  s.reached[fn->entry->id] = 1;
+  s.blocks[s.nblocks++] = fn->entry;
+  solve(&s);
+  /* a branch on a register that is still unknown reads it before it is set,
+   * which only IR that isn't strictly SSA does. Both ways are taken then */
+  bool again = true;
+  while (again) {
+    again = false;
+    for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+      SSA_Inst *last = block->last;
+      if (s.reached[block->id] && last != NULL && last->t == INST_CBR &&
+          s.values[last->data.br.cond].state == VAL_UNKNOWN) {
+        set_value(&s, last->data.br.cond, VAL_VARYING, 0);
+        visit_edges(&s, block);
+        again = true;
+      }
+    }
+    solve(&s);
+  }
+
+  SSA_BBlock *prev = NULL;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    if (s.reached[block->id]) {
+      rewrite_block(&s, block, pc->scratch);
+      prev = block;
+      continue;
+    }
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      bblock_remove_inst(fn, block, inst);
+    }
+    /* the entry is always reached, so there is a block before */
+    prev->next = block->next;
+  }
+}
@@ -12,7 +12,7 @@ resolve_expr(AST *ast, Scope *scope, Expr *expr) {
       {
         ScopeEntry *entry = scope_find(scope, expr->pos);
         if (entry == NULL) {
-          log_name_not_in_scope(expr->pos, expr->pos);
+          log_name_not_in_scope(ast->ctx, expr->pos, expr->pos);
         }
         expr->data.var = entry;
       }
@@ -21,7 +21,7 @@ resolve_expr(AST *ast, Scope *scope, Expr *expr) {
       {
         ScopeEntry *entry = scope_find(scope, expr->data.funcall.name);
         if (entry == NULL) {
-          log_name_not_in_scope(expr->pos, expr->data.funcall.name);
+          log_name_not_in_scope(ast->ctx, expr->pos, expr->data.funcall.name);
         }
         for (size_t i = 0; i < expr->data.funcall.args.items; i++) {
           Expr *temp_expr = *((Expr **)vector_idx(&expr->data.funcall.args, i));
@@ -46,7 +46,7 @@ resolve_stmt(AST *ast, Stmt *stmt, Scope *scope) {
             &ast->pool, scope, stmt->data.let.name,
             make_var_info(stmt->data.let.mut, stmt->data.let.type));
         if (entry == NULL) {
-          log_name_redeclaration(stmt->pos, stmt->data.let.name);
+          log_name_redeclaration(ast->ctx, stmt->pos, stmt->data.let.name);
         }
         stmt->data.let.var = entry;
         if (stmt->data.let.value) {
@@ -67,7 +67,7 @@ resolve_stmt(AST *ast, Stmt *stmt, Scope *scope) {
   }
 }
 void
-resolve_fn(AST *ast, Function *fn) {
+resolve_fn_names(AST *ast, Function *fn) {
   fn->scope = scope_init(&ast->pool, ast->global);
   for (size_t i = 0; i < fn->params.items; i++) {
     Param *param = vector_idx(&fn->params, i);
@@ -80,17 +80,22 @@ resolve_fn(AST *ast, Function *fn) {
 }
 
 void
-resolve_names(AST *ast) {
+declare_fns(AST *ast) {
   ast->global = scope_init(&ast->pool, NULL);
   for (size_t i = 0; i < ast->fns.items; i++) {
     Function *fn = vector_idx(&ast->fns, i);
     fn->entry =
         scope_insert(&ast->pool, ast->global, fn->name, make_var_info(0, NULL));
     if (!fn->entry) {
-      log_name_redeclaration(fn->pos, fn->name);
+      log_name_redeclaration(ast->ctx, fn->pos, fn->name);
     }
   }
+}
+
+void
+resolve_names(AST *ast) {
+  declare_fns(ast);
   for (size_t i = 0; i < ast->fns.items; i++) {
-    resolve_fn(ast, vector_idx(&ast->fns, i));
+    resolve_fn_names(ast, vector_idx(&ast->fns, i));
   }
 }
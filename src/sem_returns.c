@@ -25,6 +25,8 @@ check_fn(AST *ast, Function *fn, Stmt **first_wrong_stmt,
           if (fn->ret_type->t == TYPE_VOID) {
             return RETURN_RIGHT;
           } else {
+            *first_wrong_stmt = stmt;
+            *first_wrong_type = &void_const;
             return RETURN_WRONG;
           }
         }
@@ -45,20 +47,25 @@ check_fn(AST *ast, Function *fn, Stmt **first_wrong_stmt,
 }
 
 void
-check_returns(AST *ast) {
+check_fn_returns(AST *ast, Function *fn) {
   Stmt *wrong_stmt;
   Type *wrong_type;
+  switch (check_fn(ast, fn, &wrong_stmt, &wrong_type)) {
+    case RETURN_RIGHT:
+      break;
+    case RETURN_NEVER:
+      log_never_returns(ast->ctx, fn->pos);
+      break;
+    case RETURN_WRONG:
+      log_incorrect_return(ast->ctx, wrong_stmt->pos, wrong_type,
+                           fn->ret_type);
+      break;
+  }
+}
+
+void
+check_returns(AST *ast) {
   for (size_t i = 0; i < ast->fns.items; i++) {
-    Function *fn = vector_idx(&ast->fns, i);
-    switch (check_fn(ast, fn, &wrong_stmt, &wrong_type)) {
-      case RETURN_RIGHT:
-        break;
-      case RETURN_NEVER:
-        log_never_returns(fn->pos);
-        break;
-      case RETURN_WRONG:
-        log_incorrect_return(wrong_stmt->pos, wrong_type, fn->ret_type);
-        break;
-    }
+    check_fn_returns(ast, vector_idx(&ast->fns, i));
   }
 }
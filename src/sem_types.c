@@ -53,7 +53,8 @@ resolve_expr(Expr *expr, AST *ast, MemPool *pool) {
           coerce_type(expr->data.binop.op, &expr->data.binop.left->type,
                       &expr->data.binop.right->type, pool);
       if (expr->type == NULL) {
-        log_incorrect_type_binop(expr->pos, expr->data.binop.left->type,
+        log_incorrect_type_binop(ast->ctx, expr->pos,
+                                 expr->data.binop.left->type,
                                  expr->data.binop.right->type);
       }
       break;
@@ -61,10 +62,11 @@ resolve_expr(Expr *expr, AST *ast, MemPool *pool) {
       {
         Type *fn_type = expr->data.funcall.fn->inf.type;
         if (fn_type->t != TYPE_FN) {
-          log_incorrect_type_funcall(expr->pos, fn_type);
+          log_incorrect_type_funcall(ast->ctx, expr->pos, fn_type);
         }
         if (fn_type->data.fn.args.items != expr->data.funcall.args.items) {
-          log_wrong_param_count(expr->pos, fn_type->data.fn.args.items,
+          log_wrong_param_count(ast->ctx, expr->pos,
+                                fn_type->data.fn.args.items,
                                 expr->data.funcall.args.items);
         }
         for (size_t i = 0; i < fn_type->data.fn.args.items; i++) {
@@ -73,7 +75,8 @@ resolve_expr(Expr *expr, AST *ast, MemPool *pool) {
           resolve_expr(temp_expr, ast, pool);
           Type **given = &temp_expr->type;
           if (coerce_type(BINOP_ASSIGN, expected, given, pool) == NULL) {
-            log_incorrect_type_param(temp_expr->pos, *given, *expected);
+            log_incorrect_type_param(ast->ctx, temp_expr->pos, *given,
+                                     *expected);
           }
         }
         expr->type = fn_type->data.fn.ret;
@@ -84,8 +87,8 @@ resolve_expr(Expr *expr, AST *ast, MemPool *pool) {
   }
 }
 
-static void
-resolve_fn(AST *ast, Function *fn) {
+void
+resolve_fn_types(AST *ast, Function *fn) {
   for (size_t i = 0; i < fn->body.stmts.items; i++) {
     Stmt *temp_stmt = vector_idx(&fn->body.stmts, i);
     switch (temp_stmt->t) {
@@ -95,13 +98,14 @@ resolve_fn(AST *ast, Function *fn) {
           resolve_expr(temp_stmt->data.let.value, ast, &ast->pool);
           Type *type = temp_stmt->data.let.value->type;
           /* is this an inferred assignment? */
-          if (!temp_stmt->data.let.type) {
+          if (!temp_stmt->data.let.type || temp_stmt->data.let.inferred) {
             temp_stmt->data.let.type = type;
+            temp_stmt->data.let.inferred = 1;
             temp_stmt->data.let.var->inf.type = type; /* set the symbol table */
           } else if (coerce_type(BINOP_ASSIGN, &temp_stmt->data.let.value->type,
                                  &temp_stmt->data.let.type,
                                  &ast->pool) == NULL) {
-            log_incorrect_type_assign(temp_stmt->pos,
+            log_incorrect_type_assign(ast->ctx, temp_stmt->pos,
                                       temp_stmt->data.let.value->type,
                                       temp_stmt->data.let.type);
           }
@@ -137,14 +141,18 @@ build_fn_type(AST *ast, Function *fn) {
 }
 
 void
-resolve_types(AST *ast) {
+declare_fn_types(AST *ast) {
   for (size_t i = 0; i < ast->fns.items; i++) {
     Function *fn = vector_idx(&ast->fns, i);
     Type *fn_type = build_fn_type(ast, fn);
     fn->entry->inf.type = fn_type;
   }
+}
 
+void
+resolve_types(AST *ast) {
+  declare_fn_types(ast);
   for (size_t i = 0; i < ast->fns.items; i++) {
-    resolve_fn(ast, vector_idx(&ast->fns, i));
+    resolve_fn_types(ast, vector_idx(&ast->fns, i));
   }
 }
@@ -0,0 +1,439 @@
+#define _GNU_SOURCE
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "driver.h"
+#include "helper.h"
+#include "threadpool.h"
+
+#define SERVER_MAGIC 0x434e4f42 /* "BONC" read as a little endian u32 */
+#define REQUEST_HEADER_SZ 28
+#define RESPONSE_HEADER_SZ 16
+#define MAX_NAME_SZ 4096
+#define MAX_PLATFORM_SZ 64
+#define MAX_SOURCE_SZ (1 << 30)
+#define CACHE_BUCKETS 1024
+
+enum {
+  REQUEST_PATH,
+  REQUEST_BUFFER,
+};
+
+enum {
+  REQUEST_DUMP_AST = 1 << 0,
+  REQUEST_DUMP_IR = 1 << 1,
+  REQUEST_DUMP_REG = 1 << 2,
+};
+
+enum {
+  STATUS_OK,
+  STATUS_ERRORS, /* the source had errors, the output has the diagnostics */
+  STATUS_FAILED, /* the request couldn't be handled, the output says why */
+};
+
+enum {
+  RESPONSE_CACHED = 1 << 0,
+};
+
+/* The result of compiling a file, valid as long as the file's metadata
+ * doesn't change */
+typedef struct CacheEntry {
+  struct CacheEntry *next;
+  char *path;
+  uint32_t flags;
+  Platform *platform;
+
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  struct timespec ctime;
+
+  uint32_t status;
+  char *output;
+  size_t output_sz;
+} CacheEntry;
+
+typedef struct {
+  int listen_fd;
+  pthread_mutex_t cache_lock;
+  CacheEntry *cache[CACHE_BUCKETS];
+} Server;
+
+typedef struct {
+  BoncContext ctx;
+  bool ctx_live;
+
+  /* holds the sources sent with buffer requests */
+  uint8_t *src;
+  size_t src_alloc;
+
+  char *output;
+  size_t output_sz;
+  uint32_t status;
+  uint32_t response_flags;
+} Worker;
+
+static const char *server_socket_path;
+
+static void
+server_stop(int sig) {
+  (void)sig;
+  unlink(server_socket_path);
+  _exit(EXIT_SUCCESS);
+}
+
+static uint32_t
+read_u32(const uint8_t *buf) {
+  return (uint32_t)buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 |
+         (uint32_t)buf[3] << 24;
+}
+
+static uint64_t
+read_u64(const uint8_t *buf) {
+  return (uint64_t)read_u32(buf) | (uint64_t)read_u32(buf + 4) << 32;
+}
+
+static void
+write_u32(uint8_t *buf, uint32_t val) {
+  for (int i = 0; i < 4; i++) {
+    buf[i] = val >> (i * 8);
+  }
+}
+
+static void
+write_u64(uint8_t *buf, uint64_t val) {
+  write_u32(buf, val);
+  write_u32(buf + 4, val >> 32);
+}
+
+/* returns the number of bytes read, which is only short at end of file or on
+ * an error */
+static size_t
+read_full(int fd, void *buf, size_t sz) {
+  size_t done = 0;
+  while (done < sz) {
+    ssize_t got = read(fd, (uint8_t *)buf + done, sz - done);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      break;
+    }
+    done += got;
+  }
+  return done;
+}
+
+static bool
+write_full(int fd, const void *buf, size_t sz) {
+  size_t done = 0;
+  while (done < sz) {
+    ssize_t put = write(fd, (const uint8_t *)buf + done, sz - done);
+    if (put == -1 && errno == EINTR) {
+      continue;
+    }
+    if (put <= 0) {
+      return false;
+    }
+    done += put;
+  }
+  return true;
+}
+
+static size_t
+hash_path(const char *path) {
+  size_t hash = 14695981039346656037ULL;
+  for (; *path != '\0'; path++) {
+    hash = (hash ^ (uint8_t)*path) * 1099511628211ULL;
+  }
+  return hash % CACHE_BUCKETS;
+}
+
+static bool
+same_time(struct timespec a, struct timespec b) {
+  return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static CacheEntry **
+cache_find(Server *server, const char *path, uint32_t flags,
+           Platform *platform) {
+  CacheEntry **iter = &server->cache[hash_path(path)];
+  for (; *iter != NULL; iter = &(*iter)->next) {
+    if ((*iter)->flags == flags && (*iter)->platform == platform &&
+        strcmp((*iter)->path, path) == 0) {
+      break;
+    }
+  }
+  return iter;
+}
+
+/* copies the cached output into the worker if st still matches */
+static bool
+cache_lookup(Server *server, Worker *worker, const char *path, uint32_t flags,
+             Platform *platform, struct stat *st) {
+  bool found = false;
+  pthread_mutex_lock(&server->cache_lock);
+  CacheEntry *entry = *cache_find(server, path, flags, platform);
+  if (entry != NULL && entry->dev == st->st_dev && entry->ino == st->st_ino &&
+      entry->size == st->st_size && same_time(entry->mtime, st->st_mtim) &&
+      same_time(entry->ctime, st->st_ctim)) {
+    worker->output = malloc(entry->output_sz + 1);
+    memcpy(worker->output, entry->output, entry->output_sz);
+    worker->output_sz = entry->output_sz;
+    worker->status = entry->status;
+    found = true;
+  }
+  pthread_mutex_unlock(&server->cache_lock);
+  return found;
+}
+
+static void
+cache_store(Server *server, Worker *worker, const char *path, uint32_t flags,
+            Platform *platform, struct stat *st) {
+  CacheEntry *entry = malloc(sizeof(CacheEntry));
+  entry->path = strdup(path);
+  entry->flags = flags;
+  entry->platform = platform;
+  entry->dev = st->st_dev;
+  entry->ino = st->st_ino;
+  entry->size = st->st_size;
+  entry->mtime = st->st_mtim;
+  entry->ctime = st->st_ctim;
+  entry->status = worker->status;
+  entry->output = malloc(worker->output_sz + 1);
+  memcpy(entry->output, worker->output, worker->output_sz);
+  entry->output_sz = worker->output_sz;
+
+  pthread_mutex_lock(&server->cache_lock);
+  CacheEntry **slot = cache_find(server, path, flags, platform);
+  CacheEntry *old = *slot;
+  entry->next = old == NULL ? NULL : old->next;
+  *slot = entry;
+  pthread_mutex_unlock(&server->cache_lock);
+
+  if (old != NULL) {
+    free(old->path);
+    free(old->output);
+    free(old);
+  }
+}
+
+static void
+fail_request(Worker *worker, const char *fmt, const char *arg) {
+  free(worker->output);
+  worker->output_sz = asprintf(&worker->output, fmt, arg);
+  worker->status = STATUS_FAILED;
+}
+
+static void
+compile_request(Worker *worker, const uint8_t *src, size_t sz,
+                const char *name, CompileOptions *opts) {
+  FILE *out = open_memstream(&worker->output, &worker->output_sz);
+  if (out == NULL) {
+    log_internal_err("unable to open output stream", NULL);
+  }
+  if (worker->ctx_live) {
+    bonc_context_reuse(&worker->ctx, src, sz, name, out);
+  } else {
+    bonc_context_init(&worker->ctx, src, sz, name, out);
+    worker->ctx_live = true;
+  }
+  worker->status = compile_source(&worker->ctx, opts, out, NULL) ? STATUS_OK
+                                                             : STATUS_ERRORS;
+  fclose(out);
+}
+
+static void
+compile_path(Server *server, Worker *worker, const char *path, uint32_t flags,
+             CompileOptions *opts) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    fail_request(worker, "error: unable to open '%s'\n", path);
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    fail_request(worker, "error: unable to get stats on '%s'\n", path);
+    return;
+  }
+  if (cache_lookup(server, worker, path, flags, opts->platform, &st)) {
+    close(fd);
+    worker->response_flags |= RESPONSE_CACHED;
+    return;
+  }
+
+  const uint8_t *src = (const uint8_t *)"";
+  if (st.st_size != 0) {
+    src = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (src == MAP_FAILED) {
+    fail_request(worker, "error: unable to get contents of '%s'\n", path);
+    return;
+  }
+
+  compile_request(worker, src, st.st_size, path, opts);
+  cache_store(server, worker, path, flags, opts->platform, &st);
+
+  if (st.st_size != 0) {
+    munmap((uint8_t *)src, st.st_size);
+  }
+}
+
+/* returns false once the connection should be closed */
+static bool
+handle_request(Server *server, Worker *worker, int fd) {
+  uint8_t header[REQUEST_HEADER_SZ];
+  if (read_full(fd, header, REQUEST_HEADER_SZ) != REQUEST_HEADER_SZ ||
+      read_u32(header) != SERVER_MAGIC) {
+    return false;
+  }
+  uint32_t flags = read_u32(header + 4);
+  uint32_t kind = read_u32(header + 8);
+  uint32_t platform_sz = read_u32(header + 12);
+  uint32_t name_sz = read_u32(header + 16);
+  uint64_t src_sz = read_u64(header + 20);
+
+  if (platform_sz > MAX_PLATFORM_SZ || name_sz > MAX_NAME_SZ ||
+      src_sz > MAX_SOURCE_SZ || (kind == REQUEST_PATH && src_sz != 0)) {
+    return false;
+  }
+
+  char platform_name[MAX_PLATFORM_SZ + 1];
+  char name[MAX_NAME_SZ + 1];
+  if (read_full(fd, platform_name, platform_sz) != platform_sz ||
+      read_full(fd, name, name_sz) != name_sz) {
+    return false;
+  }
+  platform_name[platform_sz] = '\0';
+  name[name_sz] = '\0';
+
+  if (src_sz > worker->src_alloc) {
+    free(worker->src);
+    worker->src = malloc(src_sz);
+    worker->src_alloc = src_sz;
+  }
+  if (read_full(fd, worker->src, src_sz) != src_sz) {
+    return false;
+  }
+
+  worker->output = NULL;
+  worker->output_sz = 0;
+  worker->response_flags = 0;
+
+  CompileOptions opts = {
+      .dump_ast = flags & REQUEST_DUMP_AST,
+      .dump_ir = flags & REQUEST_DUMP_IR,
+      .dump_reg = flags & REQUEST_DUMP_REG,
+      .platform = &platform_x86_64_sysv,
+  };
+  if (platform_sz != 0) {
+    opts.platform = platform_find(platform_name);
+  }
+
+  if (opts.platform == NULL) {
+    fail_request(worker, "error: unknown platform '%s'\n", platform_name);
+  } else if (opts.dump_reg && !opts.dump_ir) {
+    fail_request(worker, "error: %s\n",
+                 "cannot print registers without printing the IR");
+  } else if (kind == REQUEST_PATH) {
+    compile_path(server, worker, name, flags, &opts);
+  } else if (kind == REQUEST_BUFFER) {
+    compile_request(worker, worker->src, src_sz,
+                    name_sz == 0 ? "<buffer>" : name, &opts);
+  } else {
+    fail_request(worker, "error: %s\n", "unknown request kind");
+  }
+
+  uint8_t response[RESPONSE_HEADER_SZ];
+  write_u32(response, worker->status);
+  write_u32(response + 4, worker->response_flags);
+  write_u64(response + 8, worker->output_sz);
+  bool ok = write_full(fd, response, RESPONSE_HEADER_SZ) &&
+            write_full(fd, worker->output, worker->output_sz);
+  free(worker->output);
+  return ok;
+}
+
+static void
+server_worker(void *data, size_t idx) {
+  (void)idx;
+  Server *server = data;
+  Worker worker = {.ctx_live = false, .src = NULL, .src_alloc = 0};
+
+  while (1) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd == -1) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        log_err("unable to accept connection: %s", strerror(errno));
+      }
+      continue;
+    }
+    while (handle_request(server, &worker, fd)) {
+    }
+    close(fd);
+  }
+}
+
+void
+server_run(const char *socket_path, size_t nworkers) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    log_err_final("socket path '%s' is too long", socket_path);
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  Server *server = malloc(sizeof(Server));
+  memset(server->cache, 0, sizeof(server->cache));
+  pthread_mutex_init(&server->cache_lock, NULL);
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server->listen_fd == -1) {
+    log_err_final("unable to create socket");
+  }
+
+  /* only replace a socket left behind by a server that is gone */
+  struct stat st;
+  if (stat(socket_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      log_err_final("'%s' exists and is not a socket", socket_path);
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      log_err_final("a server is already listening on '%s'", socket_path);
+    }
+    close(probe);
+    unlink(socket_path);
+  }
+
+  if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    log_err_final("unable to bind to '%s'", socket_path);
+  }
+  if (listen(server->listen_fd, 64) == -1) {
+    log_err_final("unable to listen on '%s'", socket_path);
+  }
+
+  server_socket_path = socket_path;
+  struct sigaction stop = {.sa_handler = server_stop};
+  sigaction(SIGINT, &stop, NULL);
+  sigaction(SIGTERM, &stop, NULL);
+  /* clients going away are noticed through write errors instead */
+  signal(SIGPIPE, SIG_IGN);
+
+  /* the jobs never finish, every job is one worker */
+  threadpool_run(nworkers, nworkers, server_worker, server);
+}
@@ -1,151 +1,665 @@
 #include "ssa.h"
 
-#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
 
 const uint8_t inst_arity_tbl[] = {
-    [INST_ADD] = 2,  [INST_SUB] = 2,    [INST_IMUL] = 2, [INST_UMUL] = 2,
-    [INST_IDIV] = 2, [INST_UDIV] = 2,   [INST_COPY] = 1, [INST_RET] = 1,
-    [INST_IMM] = 0,  [INST_CALLFN] = 0,
+    [INST_ADD] = 2,    [INST_SUB] = 2,    [INST_IMUL] = 2,   [INST_UMUL] = 2,
+    [INST_IDIV] = 2,   [INST_UDIV] = 2,   [INST_COPY] = 1,   [INST_RET] = 1,
+    [INST_IMM] = 0,    [INST_CALLFN] = 0, [INST_BR] = 0,     [INST_CBR] = 1,
+    [INST_PHI] = 0,    [INST_SHL] = 2,    [INST_LSHR] = 2,   [INST_ASHR] = 2,
+    [INST_UMULHI] = 2, [INST_IMULHI] = 2,
 };
 
 const uint8_t inst_returns_tbl[] = {
-    [INST_ADD] = 1,  [INST_SUB] = 1,    [INST_UMUL] = 1, [INST_IMUL] = 1,
-    [INST_IDIV] = 1, [INST_UDIV] = 1,   [INST_COPY] = 1, [INST_RET] = 0,
-    [INST_IMM] = 1,  [INST_CALLFN] = 1,
+    [INST_ADD] = 1,    [INST_SUB] = 1,    [INST_UMUL] = 1,   [INST_IMUL] = 1,
+    [INST_IDIV] = 1,   [INST_UDIV] = 1,   [INST_COPY] = 1,   [INST_RET] = 0,
+    [INST_IMM] = 1,    [INST_CALLFN] = 1, [INST_BR] = 0,     [INST_CBR] = 0,
+    [INST_PHI] = 1,    [INST_SHL] = 1,    [INST_LSHR] = 1,   [INST_ASHR] = 1,
+    [INST_UMULHI] = 1, [INST_IMULHI] = 1,
+};
+
+const uint8_t inst_targets_tbl[INST_COUNT] = {
+    [INST_BR] = 1,
+    [INST_CBR] = 2,
 };
 
 const char *inst_name_tbl[] = {
     [INST_ADD] = "add",       [INST_SUB] = "sub",   [INST_IMUL] = "imul",
     [INST_UMUL] = "umul",     [INST_IDIV] = "idiv", [INST_UDIV] = "udiv",
     [INST_COPY] = "copy",     [INST_RET] = "ret",   [INST_IMM] = "imm",
-    [INST_CALLFN] = "callfn",
+    [INST_CALLFN] = "callfn", [INST_BR] = "br",     [INST_CBR] = "cbr",
+    [INST_PHI] = "phi",       [INST_SHL] = "shl",   [INST_LSHR] = "lshr",
+    [INST_ASHR] = "ashr",     [INST_UMULHI] = "umulhi",
+    [INST_IMULHI] = "imulhi",
 };
 
+const char *sz_name_tbl[] = {"", "8", "16", "32", "64"};
+
+/* the encoding relies on this */
+typedef char ssa_inst_is_16_bytes[offsetof(SSA_Inst, prev) == 16 ? 1 : -1];
+/* and so does the size of a node given in ssa.h */
+typedef char ssa_inst_node_size[
+    sizeof(SSA_Inst) == 16 + 3 * sizeof(void *) ? 1 : -1];
+
+void
+ssa_fn_init(SSA_Fn *fn, MemPool *pool) {
+  fn->entry = NULL;
+  fn->rpo = NULL;
+  fn->nrpo = 0;
+  fn->pool = pool;
+  vector_init_size(&fn->params, sizeof(RegId), pool, 0);
+  vector_init_size(&fn->regs, sizeof(SSA_Reg), pool, 0);
+  vector_init_size(&fn->imms, sizeof(uint64_t), pool, 0);
+  vector_init_size(&fn->calls, sizeof(SSA_Call), pool, 0);
+  vector_init_size(&fn->args, sizeof(RegId), pool, 0);
+  vector_init_size(&fn->phi_args, sizeof(SSA_PhiArg), pool, 0);
+  vector_init_size(&fn->targets, sizeof(SSA_BBlock *), pool, 0);
+  vector_init_size(&fn->defuse, sizeof(SSA_DefUse), pool, 0);
+  vector_init_size(&fn->use_pos, sizeof(uint32_t), pool, 0);
+  fn->has_uses = false;
+  fn->ninserted = 0;
+  fn->nremoved = 0;
+}
+
+void
+ssa_fn_set_pool(SSA_Fn *fn, MemPool *pool) {
+  fn->pool = pool;
+  Vector *vecs[] = {&fn->params,   &fn->regs,    &fn->imms,
+                    &fn->calls,    &fn->args,    &fn->phi_args,
+                    &fn->targets,  &fn->defuse,   &fn->use_pos};
+  for (size_t i = 0; i < sizeof(vecs) / sizeof(vecs[0]); i++) {
+    vecs[i]->pool = pool;
+  }
+}
+
 SSA_BBlock *
 bblock_init(MemPool *pool) {
   SSA_BBlock *block = mempool_alloc(pool, sizeof(SSA_BBlock));
-  vector_init(&block->insts, sizeof(SSA_Inst), pool);
+  block->first = NULL;
+  block->last = NULL;
+  block->ninsts = 0;
   block->next = NULL;
   return block;
 }
 
-SSA_Inst *
-bblock_append(SSA_BBlock *block) {
-  return vector_alloc(&block->insts);
+/* n items at the end of a side table, returns the index of the first */
+static uint32_t
+table_append(Vector *table, const void *items, size_t n) {
+  size_t first = table->items;
+  if (first + n > UINT32_MAX) {
+    log_internal_err("side table too big", NULL);
+  }
+  for (size_t i = 0; i < n; i++) {
+    vector_push(table, (uint8_t *)items + i * table->it_sz);
+  }
+  return (uint32_t)first;
+}
+
+uint64_t
+inst_imm(SSA_Fn *fn, SSA_Inst *inst) {
+  return *(uint64_t *)vector_idx(&fn->imms, inst->data.imm);
+}
+
+void
+inst_set_imm(SSA_Fn *fn, SSA_Inst *inst, uint64_t imm) {
+  inst->data.imm = table_append(&fn->imms, &imm, 1);
+}
+
+SSA_Call *
+inst_call(SSA_Fn *fn, SSA_Inst *inst) {
+  return vector_idx(&fn->calls, inst->data.call);
+}
+
+RegId *
+inst_call_args(SSA_Fn *fn, SSA_Inst *inst) {
+  return (RegId *)fn->args.data + inst_call(fn, inst)->args;
+}
+
+void
+inst_set_call(SSA_Fn *fn, SSA_Inst *inst, SSA_Fn *callee, const RegId *args,
+              size_t nargs) {
+  SSA_Call call = {callee, table_append(&fn->args, args, nargs),
+                   (uint32_t)nargs};
+  inst->data.call = table_append(&fn->calls, &call, 1);
+}
+
+SSA_PhiArg *
+inst_phi_args(SSA_Fn *fn, SSA_Inst *inst) {
+  return (SSA_PhiArg *)fn->phi_args.data + inst->data.phi.args;
 }
 
 void
-bblock_insert_inst(SSA_BBlock *block, size_t idx, SSA_Inst *inst) {
-  vector_insert(&block->insts, idx, inst);
+inst_set_phi(SSA_Fn *fn, SSA_Inst *inst, const SSA_PhiArg *args,
+             size_t nargs) {
+  inst->data.phi.args = table_append(&fn->phi_args, args, nargs);
+  inst->data.phi.nargs = (uint32_t)nargs;
+}
+
+SSA_BBlock **
+inst_targets(SSA_Fn *fn, SSA_Inst *inst) {
+  return (SSA_BBlock **)fn->targets.data + inst->data.br.targets;
+}
+
+void
+inst_set_targets(SSA_Fn *fn, SSA_Inst *inst, SSA_BBlock *const *targets) {
+  inst->data.br.targets =
+      table_append(&fn->targets, targets, inst_targets_tbl[inst->t]);
+}
+
+size_t
+inst_operand_count(SSA_Fn *fn, SSA_Inst *inst) {
+  if (inst->t == INST_CALLFN) {
+    return inst_call(fn, inst)->nargs;
+  } else if (inst->t == INST_PHI) {
+    return inst->data.phi.nargs;
+  }
+  return inst_arity_tbl[inst->t];
+}
+
+RegId *
+inst_operand(SSA_Fn *fn, SSA_Inst *inst, size_t slot) {
+  if (inst->t == INST_CALLFN) {
+    return inst_call_args(fn, inst) + slot;
+  } else if (inst->t == INST_PHI) {
+    return &inst_phi_args(fn, inst)[slot].reg;
+  }
+  return &inst->data.operands[slot];
+}
+
+SSA_DefUse *
+ssa_reg_defuse(SSA_Fn *fn, RegId reg) {
+  return vector_idx(&fn->defuse, reg - 1);
+}
+
+SSA_Inst *
+ssa_reg_def(SSA_Fn *fn, RegId reg) {
+  return ssa_reg_defuse(fn, reg)->def;
+}
+
+/* where the use of the slot'th operand of inst is in its register's uses */
+static uint32_t *
+use_pos(SSA_Fn *fn, SSA_Inst *inst, size_t slot) {
+  return (uint32_t *)fn->use_pos.data + inst->uses + slot;
+}
+
+static void
+add_use(SSA_Fn *fn, RegId reg, SSA_BBlock *block, SSA_Inst *inst,
+        size_t slot) {
+  /* 0 stands for no register, as in a ret without a value */
+  if (reg == 0) {
+    return;
+  }
+  SSA_DefUse *du = ssa_reg_defuse(fn, reg);
+  if (du->nuses == du->uses_alloc) {
+    uint32_t alloc = du->uses_alloc == 0 ? 2 : du->uses_alloc * 2;
+    SSA_Use *uses = mempool_alloc(fn->defuse.pool, alloc * sizeof(SSA_Use));
+    if (du->nuses != 0) {
+      memcpy(uses, du->uses, du->nuses * sizeof(SSA_Use));
+    }
+    du->uses = uses;
+    du->uses_alloc = alloc;
+  }
+  *use_pos(fn, inst, slot) = du->nuses;
+  du->uses[du->nuses++] = (SSA_Use){block, inst, slot};
+}
+
+static void
+remove_use(SSA_Fn *fn, RegId reg, SSA_Inst *inst, size_t slot) {
+  if (reg == 0) {
+    return;
+  }
+  SSA_DefUse *du = ssa_reg_defuse(fn, reg);
+  uint32_t pos = *use_pos(fn, inst, slot);
+  if (pos >= du->nuses || du->uses[pos].inst != inst ||
+      du->uses[pos].slot != slot) {
+    log_internal_err("missing use of %%%llu", (unsigned long long)reg);
+  }
+  /* the last use takes its place */
+  SSA_Use *last = &du->uses[--du->nuses];
+  du->uses[pos] = *last;
+  *use_pos(fn, last->inst, last->slot) = pos;
+}
+
+/* enters an instruction into the chains */
+static void
+link_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst) {
+  if (inst->result != 0) {
+    SSA_DefUse *du = ssa_reg_defuse(fn, inst->result);
+    du->def_block = block;
+    du->def = inst;
+  }
+  size_t nops = inst_operand_count(fn, inst);
+  if (fn->use_pos.items + nops > UINT32_MAX) {
+    log_internal_err("use table too big", NULL);
+  }
+  inst->uses = (uint32_t)fn->use_pos.items;
+  for (size_t i = 0; i < nops; i++) {
+    vector_alloc(&fn->use_pos);
+  }
+  for (size_t i = 0; i < nops; i++) {
+    add_use(fn, *inst_operand(fn, inst, i), block, inst, i);
+  }
+}
+
+static void
+unlink_inst(SSA_Fn *fn, SSA_Inst *inst) {
+  if (inst->result != 0) {
+    SSA_DefUse *du = ssa_reg_defuse(fn, inst->result);
+    if (du->def == inst) {
+      du->def_block = NULL;
+      du->def = NULL;
+    }
+  }
+  for (size_t i = 0; i < inst_operand_count(fn, inst); i++) {
+    remove_use(fn, *inst_operand(fn, inst, i), inst, i);
+  }
+}
+
+SSA_Inst *
+bblock_append(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst) {
+  return bblock_insert_inst(fn, block, NULL, inst);
+}
+
+SSA_Inst *
+bblock_insert_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *before,
+                   SSA_Inst *inst) {
+  SSA_Inst *added = mempool_alloc(fn->pool, sizeof(SSA_Inst));
+  *added = *inst;
+  added->next = before;
+  added->prev = before == NULL ? block->last : before->prev;
+  if (added->prev == NULL) {
+    block->first = added;
+  } else {
+    added->prev->next = added;
+  }
+  if (before == NULL) {
+    block->last = added;
+  } else {
+    before->prev = added;
+  }
+  block->ninsts++;
+  fn->ninserted++;
+  if (fn->has_uses) {
+    link_inst(fn, block, added);
+  }
+  return added;
 }
 
 void
-bblock_remove_inst(SSA_BBlock *block, size_t idx) {
-  vector_remove(&block->insts, idx);
+bblock_remove_inst(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst) {
+  if (fn->has_uses) {
+    unlink_inst(fn, inst);
+  }
+  /* inst's own links are left alone, for a walk that is at it to go on */
+  if (inst->prev == NULL) {
+    block->first = inst->next;
+  } else {
+    inst->prev->next = inst->next;
+  }
+  if (inst->next == NULL) {
+    block->last = inst->prev;
+  } else {
+    inst->next->prev = inst->prev;
+  }
+  block->ninsts--;
+  fn->nremoved++;
 }
 
 void
-bblock_replace_reg(SSA_BBlock *block, RegId find, RegId replacement,
-                   size_t start, size_t end) {
-  for (size_t i = start; i < end; i++) {
-    SSA_Inst *inst = vector_idx(&block->insts, i);
-
-    for (uint8_t op = 0; op < inst_arity_tbl[inst->t]; op++) {
-      if (inst->data.operands[i] == find) {
-        inst->data.operands[i] = replacement;
+bblock_replace_reg(SSA_Fn *fn, SSA_BBlock *block, RegId find,
+                   RegId replacement, SSA_Inst *start, SSA_Inst *end) {
+  for (SSA_Inst *inst = start; inst != end; inst = inst->next) {
+    for (size_t op = 0; op < inst_operand_count(fn, inst); op++) {
+      RegId *reg = inst_operand(fn, inst, op);
+      if (*reg != find) {
+        continue;
+      }
+      *reg = replacement;
+      if (fn->has_uses) {
+        remove_use(fn, find, inst, op);
+        add_use(fn, replacement, block, inst, op);
       }
     }
   }
 }
 
+void
+ssa_fn_build_uses(SSA_Fn *fn, MemPool *pool) {
+  vector_init_size(&fn->defuse, sizeof(SSA_DefUse), pool, fn->regs.items);
+  /* room for the operands there are now, which is all most functions ever
+   * have */
+  size_t nops = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      nops += inst_operand_count(fn, inst);
+    }
+  }
+  vector_init_size(&fn->use_pos, sizeof(uint32_t), pool, nops);
+  fn->use_pos.items = 0;
+  fn->has_uses = true;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      link_inst(fn, block, inst);
+    }
+  }
+}
+
+void
+ssa_replace_all_uses(SSA_Fn *fn, RegId find, RegId replace) {
+  if (find == replace) {
+    return;
+  }
+  SSA_DefUse *du = ssa_reg_defuse(fn, find);
+  for (uint32_t i = 0; i < du->nuses; i++) {
+    SSA_Use *use = &du->uses[i];
+    *inst_operand(fn, use->inst, use->slot) = replace;
+    add_use(fn, replace, use->block, use->inst, use->slot);
+  }
+  du->nuses = 0;
+}
+
 RegId
 ssa_new_reg(SSA_Fn *fn, int sz) {
   SSA_Reg *reg = vector_alloc(&fn->regs);
   RegId ret = (RegId)fn->regs.items; /* starts at 1 */
   reg->sz = sz;
+  if (fn->has_uses) {
+    SSA_DefUse *du = vector_alloc(&fn->defuse);
+    memset(du, 0, sizeof(SSA_DefUse));
+  }
   return ret;
 }
 
-static const char *sz_name_tbl[] = {"", "8", "16", "32", "64"};
+/* the new number of reg, giving it the next one if it hasn't got one yet */
+static RegId
+compact_reg(RegId *map, RegId *next, RegId reg) {
+  if (reg == 0) {
+    return 0;
+  }
+  if (map[reg - 1] == 0) {
+    map[reg - 1] = ++*next;
+  }
+  return map[reg - 1];
+}
+
+void
+ssa_fn_compact_regs(SSA_Fn *fn, MemPool *scratch) {
+  MemPoolMark mark = mempool_mark(scratch);
+  size_t nregs = fn->regs.items;
+  RegId *map = mempool_alloc(scratch, nregs * sizeof(RegId));
+  memset(map, 0, nregs * sizeof(RegId));
+  RegId next = 0;
+
+  for (size_t i = 0; i < fn->params.items; i++) {
+    RegId *param = vector_idx(&fn->params, i);
+    *param = compact_reg(map, &next, *param);
+  }
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      for (size_t op = 0; op < inst_operand_count(fn, inst); op++) {
+        RegId *reg = inst_operand(fn, inst, op);
+        *reg = compact_reg(map, &next, *reg);
+      }
+      inst->result = compact_reg(map, &next, inst->result);
+    }
+  }
+
+  SSA_Reg *regs = (SSA_Reg *)fn->regs.data;
+  SSA_Reg *old = mempool_alloc(scratch, nregs * sizeof(SSA_Reg));
+  memcpy(old, regs, nregs * sizeof(SSA_Reg));
+  for (size_t i = 0; i < nregs; i++) {
+    if (map[i] != 0) {
+      regs[map[i] - 1] = old[i];
+    }
+  }
+  fn->regs.items = next;
+  mempool_release(scratch, mark);
+
+  if (fn->has_uses) {
+    ssa_fn_build_uses(fn, fn->defuse.pool);
+  }
+}
+
+size_t
+ssa_number_blocks(SSA_Fn *fn) {
+  size_t id = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    block->id = id++;
+  }
+  return id;
+}
+
+int
+inst_is_terminator(SSA_Inst *inst) {
+  return inst->t == INST_BR || inst->t == INST_CBR || inst->t == INST_RET;
+}
+
+uint64_t
+sz_mask(SizeKind sz) {
+  if (sz == SZ_NONE) {
+    return 0;
+  }
+  unsigned bits = 8u << (sz - SZ_8);
+  return bits == 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+}
+
+/* a as the signed value of size sz it stands for */
+static int64_t
+sign_extend(uint64_t a, SizeKind sz) {
+  uint64_t sign = (sz_mask(sz) >> 1) + 1;
+  a &= sz_mask(sz);
+  return (a & sign) ? (int64_t)(a | ~sz_mask(sz)) : (int64_t)a;
+}
+
+/* the upper 64 bits of the 128-bit product of a and b */
+static uint64_t
+umulhi64(uint64_t a, uint64_t b) {
+  uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+  uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+  uint64_t lo = a_lo * b_lo;
+  uint64_t mid1 = a_hi * b_lo + (lo >> 32);
+  uint64_t mid2 = a_lo * b_hi + (mid1 & 0xffffffff);
+  return a_hi * b_hi + (mid1 >> 32) + (mid2 >> 32);
+}
+
+/* the upper half of the unsigned product of a and b of size sz */
+static uint64_t
+umulhi(uint64_t a, uint64_t b, SizeKind sz) {
+  unsigned bits = 8u << (sz - SZ_8);
+  return bits == 64 ? umulhi64(a, b) : (a * b) >> bits;
+}
+
+bool
+inst_fold(InstKind t, SizeKind sz, uint64_t a, uint64_t b, uint64_t *result) {
+  uint64_t mask = sz_mask(sz);
+  if (mask == 0) {
+    return false;
+  }
+  a &= mask;
+  b &= mask;
+  switch (t) {
+    case INST_ADD:
+      *result = a + b;
+      break;
+    case INST_SUB:
+      *result = a - b;
+      break;
+    case INST_IMUL:
+    case INST_UMUL:
+      /* the low bits of a product don't depend on the signs */
+      *result = a * b;
+      break;
+    case INST_UDIV:
+      if (b == 0) {
+        return false;
+      }
+      *result = a / b;
+      break;
+    case INST_IDIV: {
+      int64_t sa = sign_extend(a, sz);
+      int64_t sb = sign_extend(b, sz);
+      if (sb == 0 || (sb == -1 && sa == sign_extend(mask / 2 + 1, sz))) {
+        return false;
+      }
+      *result = (uint64_t)(sa / sb);
+      break;
+    }
+    case INST_SHL:
+    case INST_LSHR:
+    case INST_ASHR: {
+      unsigned bits = 8u << (sz - SZ_8);
+      if (b >= bits) {
+        return false;
+      }
+      if (t == INST_SHL) {
+        *result = a << b;
+      } else if (t == INST_LSHR) {
+        *result = a >> b;
+      } else {
+        /* spelled out, as >> of a negative value is up to the compiler */
+        uint64_t fill = sign_extend(a, sz) < 0 ? mask & ~(mask >> b) : 0;
+        *result = (a >> b) | fill;
+      }
+      break;
+    }
+    case INST_UMULHI:
+      *result = umulhi(a, b, sz);
+      break;
+    case INST_IMULHI:
+      /* the signed product is the unsigned one less b * 2^bits for a
+       * negative a, and the same for b */
+      *result = umulhi(a, b, sz) - (sign_extend(a, sz) < 0 ? b : 0) -
+                (sign_extend(b, sz) < 0 ? a : 0);
+      break;
+    default:
+      return false;
+  }
+  *result &= mask;
+  return true;
+}
 
 static void
-dump_nullable_reg(FILE *file, RegId reg, int sz) {
+dump_nullable_reg(Emitter *em, RegId reg, int sz) {
   if (reg != 0) {
-    fprintf(file, "%%%ld =%s ", reg, sz_name_tbl[sz]);
+    emit_char(em, '%');
+    emit_u64(em, reg);
+    emit_str(em, " =");
+    emit_str(em, sz_name_tbl[sz]);
+    emit_char(em, ' ');
   }
 }
 
 static void
-inst_dump(FILE *file, SSA_Inst *inst) {
+inst_dump(Emitter *em, SSA_Fn *fn, SSA_Inst *inst) {
   if (inst->t == INST_IMM) {
-    dump_nullable_reg(file, inst->result, inst->sz);
-    fprintf(file, "$%" PRIu64, inst->data.imm);
+    dump_nullable_reg(em, inst->result, inst->sz);
+    emit_char(em, '$');
+    emit_u64(em, inst_imm(fn, inst));
   } else if (inst->t == INST_CALLFN) {
-    dump_nullable_reg(file, inst->result, inst->sz);
-    fprintf(file, "callfn %.*s(", (int)inst->data.callfn.fn->name.sz,
-            (char *)inst->data.callfn.fn->name.start);
-    if (inst->data.callfn.args.items != 0) {
-      for (size_t i = 0; i < inst->data.callfn.args.items - 1; i++) {
-        fprintf(file, "%%%zd, ",
-                *((RegId *)vector_idx(&inst->data.callfn.args, i)));
+    SSA_Call *call = inst_call(fn, inst);
+    RegId *args = inst_call_args(fn, inst);
+    dump_nullable_reg(em, inst->result, inst->sz);
+    emit_str(em, "callfn ");
+    emit_pos(em, call->fn->name);
+    emit_char(em, '(');
+    for (size_t i = 0; i < call->nargs; i++) {
+      if (i != 0) {
+        emit_str(em, ", ");
       }
-      fprintf(file, "%%%zd",
-              *((RegId *)vector_idx(&inst->data.callfn.args,
-                                    inst->data.callfn.args.items - 1)));
+      emit_char(em, '%');
+      emit_u64(em, args[i]);
     }
-    fprintf(file, ")");
+    emit_char(em, ')');
+  } else if (inst->t == INST_PHI) {
+    dump_nullable_reg(em, inst->result, inst->sz);
+    emit_str(em, "phi(");
+    for (size_t i = 0; i < inst->data.phi.nargs; i++) {
+      SSA_PhiArg *arg = &inst_phi_args(fn, inst)[i];
+      if (i != 0) {
+        emit_str(em, ", ");
+      }
+      emit_char(em, '@');
+      emit_u64(em, arg->block->id);
+      emit_str(em, " %");
+      emit_u64(em, arg->reg);
+    }
+    emit_char(em, ')');
   } else {
-    dump_nullable_reg(file, inst->result, inst->sz);
-    fprintf(file, "%s", inst_name_tbl[inst->t]);
+    dump_nullable_reg(em, inst->result, inst->sz);
+    emit_str(em, inst_name_tbl[inst->t]);
 
     for (int i = 0; i < inst_arity_tbl[inst->t]; i++) {
-      fprintf(file, " %%%" PRIu64, inst->data.operands[i]);
+      emit_str(em, " %");
+      emit_u64(em, inst->data.operands[i]);
+    }
+    for (int i = 0; i < inst_targets_tbl[inst->t]; i++) {
+      emit_str(em, " @");
+      emit_u64(em, inst_targets(fn, inst)[i]->id);
     }
   }
 
-  fprintf(file, "\n");
+  emit_char(em, '\n');
 }
 
 void
-bblock_dump(FILE *file, SSA_BBlock *block) {
-  for (size_t i = 0; i < block->insts.items; i++) {
-    SSA_Inst *inst = vector_idx(&block->insts, i);
-    inst_dump(file, inst);
+bblock_dump(Emitter *em, SSA_Fn *fn, SSA_BBlock *block) {
+  for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+    inst_dump(em, fn, inst);
   }
 }
 
 void
-function_dump(FILE *file, SSA_Fn *fn, int reg_dump) {
-  fprintf(file, "fn %.*s(", (int)fn->name.sz, (char *)fn->name.start);
-
-  if (fn->params.items > 0) {
-    for (size_t i = 0; i < fn->params.items - 1; i++) {
-      RegId param = *((RegId *)vector_idx(&fn->params, i));
-      SSA_Reg *reg = vector_idx(&fn->regs, param - 1);
-      fprintf(file, "%%%ld: %s, ", param, sz_name_tbl[reg->sz]);
-    }
-    RegId param = *((RegId *)vector_idx(&fn->params, fn->params.items - 1));
+function_dump(Emitter *em, SSA_Fn *fn, int reg_dump) {
+  emit_str(em, "fn ");
+  emit_pos(em, fn->name);
+  emit_char(em, '(');
+  for (size_t i = 0; i < fn->params.items; i++) {
+    RegId param = *((RegId *)vector_idx(&fn->params, i));
     SSA_Reg *reg = vector_idx(&fn->regs, param - 1);
-    fprintf(file, "%%%ld: %s)\n", param, sz_name_tbl[reg->sz]);
-  } else {
-    fprintf(file, ")\n");
+    if (i != 0) {
+      emit_str(em, ", ");
+    }
+    emit_char(em, '%');
+    emit_u64(em, param);
+    emit_str(em, ": ");
+    emit_str(em, sz_name_tbl[reg->sz]);
   }
+  emit_str(em, ")\n");
 
-  bblock_dump(file, fn->entry);
+  /* the entry block goes without a label, the rest are named by their ids */
+  ssa_number_blocks(fn);
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    if (block != fn->entry) {
+      emit_char(em, '@');
+      emit_u64(em, block->id);
+      emit_str(em, ":\n");
+    }
+    bblock_dump(em, fn, block);
+  }
 
   if (reg_dump) {
-    fprintf(file, "\n");
+    emit_char(em, '\n');
     for (size_t i = 0; i < fn->regs.items; i++) {
       SSA_Reg *reg = vector_idx(&fn->regs, i);
-      fprintf(file, "| %zd | bit%s |\n", i + 1, sz_name_tbl[reg->sz]);
+      emit_str(em, "| ");
+      emit_u64(em, i + 1);
+      emit_str(em, " | bit");
+      emit_str(em, sz_name_tbl[reg->sz]);
+      emit_str(em, " |\n");
     }
   }
-  fprintf(file, "\n");
+  emit_char(em, '\n');
+}
+
+void
+ssa_prog_deinit(SSA_Prog *prog) {
+  mempool_deinit(&prog->pool);
 }
 
 void
-ssa_prog_dump(FILE *file, SSA_Prog *prog, int reg_dump) {
+ssa_prog_dump(Emitter *em, SSA_Prog *prog, int reg_dump) {
   for (size_t i = 0; i < prog->fns.items; i++) {
-    function_dump(file, vector_idx(&prog->fns, i), reg_dump);
+    function_dump(em, vector_idx(&prog->fns, i), reg_dump);
   }
 }
@@ -0,0 +1,348 @@
+#include "ssa_bin.h"
+
+#include <setjmp.h>
+#include <string.h>
+
+/* what a load failed with, passed through longjmp */
+enum {
+  LOAD_OK,
+  LOAD_MAGIC,
+  LOAD_VERSION,
+  LOAD_TRUNCATED,
+  LOAD_MALFORMED,
+};
+
+typedef struct {
+  const uint8_t *iter;
+  const uint8_t *end;
+  jmp_buf fail;
+
+  SSA_Prog *prog;
+  /* of the function being loaded */
+  size_t nregs;
+  size_t nargs;
+  size_t args_used;
+  SSA_BBlock *blocks;
+  size_t nblocks;
+} Reader;
+
+static void
+emit_uleb(Emitter *em, uint64_t num) {
+  while (num >= 0x80) {
+    emit_char(em, (char)((num & 0x7f) | 0x80));
+    num >>= 7;
+  }
+  emit_char(em, (char)num);
+}
+
+static size_t
+callfn_args(SSA_Fn *fn) {
+  size_t nargs = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->t == INST_CALLFN) {
+        nargs += inst_call(fn, inst)->nargs;
+      }
+    }
+  }
+  return nargs;
+}
+
+static void
+write_inst(Emitter *em, SSA_Prog *prog, SSA_Fn *fn, SSA_Inst *inst) {
+  emit_char(em, (char)inst->t);
+  emit_uleb(em, (uint64_t)inst->result << 3 | inst->sz);
+  if (inst->t == INST_IMM) {
+    emit_uleb(em, inst_imm(fn, inst));
+  } else if (inst->t == INST_CALLFN) {
+    SSA_Call *call = inst_call(fn, inst);
+    emit_uleb(em, call->fn - (SSA_Fn *)prog->fns.data);
+    emit_uleb(em, call->nargs);
+  } else if (inst->t == INST_PHI) {
+    emit_uleb(em, inst->data.phi.nargs);
+    for (size_t i = 0; i < inst->data.phi.nargs; i++) {
+      SSA_PhiArg *arg = &inst_phi_args(fn, inst)[i];
+      emit_uleb(em, arg->block->id);
+      emit_uleb(em, arg->reg);
+    }
+  } else {
+    for (uint8_t i = 0; i < inst_arity_tbl[inst->t]; i++) {
+      emit_uleb(em, inst->data.operands[i]);
+    }
+    for (uint8_t i = 0; i < inst_targets_tbl[inst->t]; i++) {
+      emit_uleb(em, inst_targets(fn, inst)[i]->id);
+    }
+  }
+}
+
+static void
+write_fn(Emitter *em, SSA_Prog *prog, SSA_Fn *fn) {
+  emit_uleb(em, fn->regs.items);
+  for (size_t i = 0; i < fn->regs.items; i++) {
+    emit_char(em, (char)((SSA_Reg *)vector_idx(&fn->regs, i))->sz);
+  }
+  emit_uleb(em, fn->params.items);
+  for (size_t i = 0; i < fn->params.items; i++) {
+    emit_uleb(em, *(RegId *)vector_idx(&fn->params, i));
+  }
+
+  /* in the order of the calls, as what changed calls left behind in the
+   * function's args isn't written */
+  emit_uleb(em, callfn_args(fn));
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->t != INST_CALLFN) {
+        continue;
+      }
+      RegId *args = inst_call_args(fn, inst);
+      for (size_t j = 0; j < inst_call(fn, inst)->nargs; j++) {
+        emit_uleb(em, args[j]);
+      }
+    }
+  }
+
+  emit_uleb(em, ssa_number_blocks(fn));
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    emit_uleb(em, block->ninsts);
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      write_inst(em, prog, fn, inst);
+    }
+  }
+}
+
+void
+ssa_bin_write(Emitter *em, SSA_Prog *prog) {
+  emit_mem(em, SSA_BIN_MAGIC, SSA_BIN_MAGIC_SZ);
+  emit_char(em, SSA_BIN_VERSION);
+  emit_uleb(em, prog->fns.items);
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    SSA_Fn *fn = vector_idx(&prog->fns, i);
+    emit_uleb(em, fn->name.sz);
+    emit_pos(em, fn->name);
+  }
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    write_fn(em, prog, vector_idx(&prog->fns, i));
+  }
+}
+
+static uint8_t
+read_byte(Reader *r) {
+  if (r->iter == r->end) {
+    longjmp(r->fail, LOAD_TRUNCATED);
+  }
+  return *r->iter++;
+}
+
+static uint64_t
+read_uleb(Reader *r) {
+  uint64_t num = 0;
+  for (unsigned shift = 0;; shift += 7) {
+    uint8_t byte = read_byte(r);
+    /* only the lowest bit of the tenth byte still fits */
+    if (shift == 63 && byte > 1) {
+      longjmp(r->fail, LOAD_MALFORMED);
+    }
+    num |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return num;
+    }
+  }
+}
+
+/* every item takes up at least a byte, so a count can't be bigger than what
+ * is left, which keeps a corrupt count from allocating anything huge */
+static size_t
+read_count(Reader *r) {
+  uint64_t count = read_uleb(r);
+  if (count > (uint64_t)(r->end - r->iter)) {
+    longjmp(r->fail, LOAD_TRUNCATED);
+  }
+  return count;
+}
+
+static RegId
+read_reg(Reader *r) {
+  uint64_t reg = read_uleb(r);
+  if (reg > r->nregs) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  return reg;
+}
+
+static SSA_BBlock *
+read_block(Reader *r) {
+  uint64_t block = read_uleb(r);
+  if (block >= r->nblocks) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  return &r->blocks[block];
+}
+
+/* the side tables are filled in directly, in the order of the instructions */
+static void
+read_inst(Reader *r, SSA_Fn *fn, SSA_Inst *inst) {
+  uint8_t kind = read_byte(r);
+  if (kind >= INST_COUNT) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  uint64_t result = read_uleb(r);
+  if ((result & 7) > SZ_64 || (result >> 3) > r->nregs) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  inst->t = kind;
+  inst->sz = result & 7;
+  inst->result = result >> 3;
+
+  if (kind == INST_IMM) {
+    inst->data.imm = (uint32_t)fn->imms.items;
+    uint64_t imm = read_uleb(r);
+    vector_push(&fn->imms, &imm);
+  } else if (kind == INST_CALLFN) {
+    uint64_t callee = read_uleb(r);
+    uint64_t nargs = read_uleb(r);
+    if (callee >= r->prog->fns.items || nargs > r->nargs - r->args_used) {
+      longjmp(r->fail, LOAD_MALFORMED);
+    }
+    SSA_Call call = {vector_idx(&r->prog->fns, callee),
+                     (uint32_t)r->args_used, (uint32_t)nargs};
+    inst->data.call = (uint32_t)fn->calls.items;
+    vector_push(&fn->calls, &call);
+    r->args_used += nargs;
+  } else if (kind == INST_PHI) {
+    size_t nargs = read_count(r);
+    inst->data.phi.args = (uint32_t)fn->phi_args.items;
+    inst->data.phi.nargs = (uint32_t)nargs;
+    for (size_t i = 0; i < nargs; i++) {
+      SSA_PhiArg arg;
+      arg.block = read_block(r);
+      arg.reg = read_reg(r);
+      vector_push(&fn->phi_args, &arg);
+    }
+  } else {
+    for (uint8_t i = 0; i < inst_arity_tbl[kind]; i++) {
+      inst->data.operands[i] = read_reg(r);
+    }
+    if (inst_targets_tbl[kind] != 0) {
+      inst->data.br.targets = (uint32_t)fn->targets.items;
+    }
+    for (uint8_t i = 0; i < inst_targets_tbl[kind]; i++) {
+      SSA_BBlock *target = read_block(r);
+      vector_push(&fn->targets, &target);
+    }
+  }
+}
+
+static void
+read_fn(Reader *r, SSA_Fn *fn) {
+  MemPool *pool = &r->prog->pool;
+  ssa_fn_init(fn, pool);
+  r->nregs = read_count(r);
+  vector_init_size(&fn->regs, sizeof(SSA_Reg), pool, r->nregs);
+  for (size_t i = 0; i < r->nregs; i++) {
+    uint8_t sz = read_byte(r);
+    if (sz > SZ_64) {
+      longjmp(r->fail, LOAD_MALFORMED);
+    }
+    ((SSA_Reg *)vector_idx(&fn->regs, i))->sz = sz;
+  }
+  size_t nparams = read_count(r);
+  vector_init_size(&fn->params, sizeof(RegId), pool, nparams);
+  for (size_t i = 0; i < nparams; i++) {
+    *(RegId *)vector_idx(&fn->params, i) = read_reg(r);
+  }
+
+  r->nargs = read_count(r);
+  r->args_used = 0;
+  vector_init_size(&fn->args, sizeof(RegId), pool, r->nargs);
+  for (size_t i = 0; i < r->nargs; i++) {
+    ((RegId *)fn->args.data)[i] = read_reg(r);
+  }
+
+  /* every function has at least its entry block */
+  size_t nblocks = read_count(r);
+  if (nblocks == 0) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  /* the blocks are allocated together up front, for branches to point to */
+  r->blocks = mempool_alloc(pool, nblocks * sizeof(SSA_BBlock));
+  r->nblocks = nblocks;
+  fn->entry = r->blocks;
+  for (size_t i = 0; i < nblocks; i++) {
+    SSA_BBlock *block = &r->blocks[i];
+    /* a block's instructions are allocated together too, and linked up in
+     * order */
+    size_t ninsts = read_count(r);
+    SSA_Inst *insts = mempool_alloc(pool, ninsts * sizeof(SSA_Inst));
+    for (size_t j = 0; j < ninsts; j++) {
+      read_inst(r, fn, &insts[j]);
+      insts[j].prev = j == 0 ? NULL : &insts[j - 1];
+      insts[j].next = j + 1 == ninsts ? NULL : &insts[j + 1];
+    }
+    block->first = ninsts == 0 ? NULL : insts;
+    block->last = ninsts == 0 ? NULL : &insts[ninsts - 1];
+    block->ninsts = ninsts;
+    block->next = i + 1 == nblocks ? NULL : &r->blocks[i + 1];
+  }
+  if (r->args_used != r->nargs) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+}
+
+static void
+read_prog(Reader *r) {
+  SSA_Prog *prog = r->prog;
+  if (r->end - r->iter < SSA_BIN_MAGIC_SZ ||
+      memcmp(r->iter, SSA_BIN_MAGIC, SSA_BIN_MAGIC_SZ) != 0) {
+    longjmp(r->fail, LOAD_MAGIC);
+  }
+  r->iter += SSA_BIN_MAGIC_SZ;
+  /* registers and the side tables are indexed with 32 bits, and a count is
+   * never more than the bytes that are left */
+  if (r->end - r->iter > UINT32_MAX) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+  if (read_byte(r) != SSA_BIN_VERSION) {
+    longjmp(r->fail, LOAD_VERSION);
+  }
+
+  size_t nfns = read_count(r);
+  vector_init_size(&prog->fns, sizeof(SSA_Fn), &prog->pool, nfns);
+  for (size_t i = 0; i < nfns; i++) {
+    SSA_Fn *fn = vector_idx(&prog->fns, i);
+    size_t name_sz = read_count(r);
+    fn->name = make_pos(r->iter, name_sz, 0);
+    r->iter += name_sz;
+  }
+  for (size_t i = 0; i < nfns; i++) {
+    read_fn(r, vector_idx(&prog->fns, i));
+  }
+  if (r->iter != r->end) {
+    longjmp(r->fail, LOAD_MALFORMED);
+  }
+}
+
+const char *
+ssa_bin_load(SSA_Prog *prog, const uint8_t *data, size_t sz) {
+  Reader r = {.iter = data, .end = data + sz, .prog = prog};
+  const char *error;
+  mempool_init(&prog->pool);
+  switch (setjmp(r.fail)) {
+    case LOAD_OK:
+      read_prog(&r);
+      return NULL;
+    case LOAD_MAGIC:
+      error = "not a binary SSA program";
+      break;
+    case LOAD_VERSION:
+      error = "binary SSA program of an unsupported version";
+      break;
+    case LOAD_TRUNCATED:
+      error = "binary SSA program is truncated";
+      break;
+    default:
+      error = "binary SSA program is malformed";
+      break;
+  }
+  mempool_deinit(&prog->pool);
+  return error;
+}
@@ -0,0 +1,378 @@
+#include "ssa_builder.h"
+
+#include <stdint.h>
+#include <string.h>
+
+struct SSABuildPhi {
+  RegId result;
+  size_t var;
+  SSA_BBlock *block;
+  Vector args;  /* SSA_PhiArg */
+  Vector users; /* SSABuildPhi *, the phis that have this one as an argument */
+  bool removed;
+};
+
+#define DEFS_INIT_BUCKETS 64
+
+static SSABuildBlock *
+block_info(SSABuilder *b, SSA_BBlock *block) {
+  return vector_idx(&b->blocks, block->id);
+}
+
+static SSA_BBlock *
+new_block(SSABuilder *b) {
+  SSA_BBlock *block = bblock_init(b->pool);
+  block->id = b->blocks.items;
+  SSABuildBlock *info = vector_alloc(&b->blocks);
+  vector_init_size(&info->preds, sizeof(SSA_BBlock *), b->scratch, 0);
+  vector_init_size(&info->incomplete, sizeof(SSABuildPhi *), b->scratch, 0);
+  vector_init_size(&info->phis, sizeof(SSABuildPhi *), b->scratch, 0);
+  info->sealed = false;
+  info->walk = 0;
+  if (b->last != NULL) {
+    b->last->next = block;
+  }
+  b->last = block;
+  return block;
+}
+
+void
+ssa_builder_init(SSABuilder *b, SSA_Fn *fn, MemPool *pool, MemPool *scratch) {
+  b->fn = fn;
+  b->pool = pool;
+  b->scratch = scratch;
+  b->mark = mempool_mark(scratch);
+  b->last = NULL;
+  b->walks = 0;
+  b->replaced = false;
+  memset(b->undefined, 0, sizeof(b->undefined));
+  ssa_fn_init(fn, pool);
+
+  vector_init(&b->blocks, sizeof(SSABuildBlock), scratch);
+  vector_init(&b->vars, sizeof(SizeKind), scratch);
+  b->nbuckets = DEFS_INIT_BUCKETS;
+  b->ndefs = 0;
+  b->defs = mempool_alloc(scratch, b->nbuckets * sizeof(SSABuildDef));
+  vector_init_size(&b->reg_phis, sizeof(SSABuildPhi *), scratch, 0);
+  vector_init_size(&b->forwards, sizeof(RegId), scratch, 0);
+  vector_init_size(&b->pending, sizeof(SSABuildPhi *), scratch, 0);
+  vector_init_size(&b->trivial, sizeof(SSABuildPhi *), scratch, 0);
+
+  fn->entry = new_block(b);
+  block_info(b, fn->entry)->sealed = true;
+}
+
+SSA_BBlock *
+ssa_builder_add_block(SSABuilder *b) {
+  return new_block(b);
+}
+
+size_t
+ssa_builder_new_var(SSABuilder *b, SizeKind sz) {
+  vector_push(&b->vars, &sz);
+  return b->vars.items - 1;
+}
+
+/* a register indexed table, grown to hold reg. New entries are 0 */
+static void *
+reg_entry(Vector *table, RegId reg) {
+  while (table->items <= reg) {
+    void *entry = vector_alloc(table);
+    memset(entry, 0, table->it_sz);
+  }
+  return vector_idx(table, reg);
+}
+
+/* the value a register stands for once the phis that were removed are taken
+ * into account, shortening the chain on the way */
+static RegId
+resolve(SSABuilder *b, RegId reg) {
+  RegId *forwards = (RegId *)b->forwards.data;
+  RegId value = reg;
+  while (value < b->forwards.items && forwards[value] != 0) {
+    value = forwards[value];
+  }
+  while (reg < b->forwards.items && forwards[reg] != 0) {
+    RegId next = forwards[reg];
+    forwards[reg] = value;
+    reg = next;
+  }
+  return value;
+}
+
+static size_t
+def_bucket(SSABuilder *b, size_t block, size_t var) {
+  uint64_t hash = ((uint64_t)block << 32 ^ var) * 0x9e3779b97f4a7c15u;
+  size_t idx = (size_t)(hash >> 32) & (b->nbuckets - 1);
+  while (b->defs[idx].block != 0 &&
+         (b->defs[idx].block != block || b->defs[idx].var != var)) {
+    idx = (idx + 1) & (b->nbuckets - 1);
+  }
+  return idx;
+}
+
+static RegId
+lookup_def(SSABuilder *b, size_t var, SSA_BBlock *block) {
+  SSABuildDef *def = &b->defs[def_bucket(b, block->id + 1, var)];
+  return def->block == 0 ? 0 : resolve(b, def->value);
+}
+
+void
+ssa_builder_write(SSABuilder *b, size_t var, SSA_BBlock *block,
+                  RegId value) {
+  /* kept at most half full */
+  if ((b->ndefs + 1) * 2 > b->nbuckets) {
+    SSABuildDef *old = b->defs;
+    size_t nold = b->nbuckets;
+    b->nbuckets *= 2;
+    b->defs = mempool_alloc(b->scratch, b->nbuckets * sizeof(SSABuildDef));
+    for (size_t i = 0; i < nold; i++) {
+      if (old[i].block != 0) {
+        b->defs[def_bucket(b, old[i].block, old[i].var)] = old[i];
+      }
+    }
+  }
+  SSABuildDef *def = &b->defs[def_bucket(b, block->id + 1, var)];
+  if (def->block == 0) {
+    def->block = block->id + 1;
+    def->var = var;
+    b->ndefs++;
+  }
+  def->value = value;
+}
+
+/* a 0 for variables read before being written. Any value would do, but every
+ * register read has to be set before, so it's set at the start of the entry,
+ * once for every size */
+static RegId
+undefined_value(SSABuilder *b, size_t var) {
+  SizeKind sz = *(SizeKind *)vector_idx(&b->vars, var);
+  if (b->undefined[sz] == 0) {
+    SSA_Inst inst = {.t = INST_IMM, .sz = sz, .result = ssa_new_reg(b->fn, sz)};
+    inst_set_imm(b->fn, &inst, 0);
+    bblock_insert_inst(b->fn, b->fn->entry, b->fn->entry->first, &inst);
+    b->undefined[sz] = inst.result;
+  }
+  return b->undefined[sz];
+}
+
+static SSABuildPhi *
+new_phi(SSABuilder *b, size_t var, SSA_BBlock *block) {
+  SSABuildPhi *phi = mempool_alloc(b->scratch, sizeof(SSABuildPhi));
+  phi->result = ssa_new_reg(b->fn, *(SizeKind *)vector_idx(&b->vars, var));
+  phi->var = var;
+  phi->block = block;
+  vector_init_size(&phi->args, sizeof(SSA_PhiArg), b->scratch, 0);
+  vector_init_size(&phi->users, sizeof(SSABuildPhi *), b->scratch, 0);
+  phi->removed = false;
+  *(SSABuildPhi **)reg_entry(&b->reg_phis, phi->result) = phi;
+  vector_push(&block_info(b, block)->phis, &phi);
+  return phi;
+}
+
+/* Finds the value of var coming into block when it isn't defined there.
+ * Sealed blocks with one predecessor are walked through without making phis,
+ * up to the closest block that has a definition or needs a phi. The value
+ * found is then written to every block on the way, so the next read stops
+ * early. Phis made here get their arguments from drain_pending */
+static RegId
+read_incoming(SSABuilder *b, size_t var, SSA_BBlock *block) {
+  size_t walk = ++b->walks;
+  SSA_BBlock *cur = block;
+  RegId value;
+  while (1) {
+    SSABuildBlock *info = block_info(b, cur);
+    if (cur != block && (value = lookup_def(b, var, cur)) != 0) {
+      break;
+    }
+    /* a cycle of blocks that each have one predecessor can't be reached */
+    if (info->walk == walk) {
+      value = undefined_value(b, var);
+      break;
+    }
+    info->walk = walk;
+    if (!info->sealed) {
+      SSABuildPhi *phi = new_phi(b, var, cur);
+      vector_push(&info->incomplete, &phi);
+      value = phi->result;
+      break;
+    }
+    if (info->preds.items == 0) {
+      value = undefined_value(b, var);
+      break;
+    }
+    if (info->preds.items > 1) {
+      SSABuildPhi *phi = new_phi(b, var, cur);
+      vector_push(&b->pending, &phi);
+      value = phi->result;
+      break;
+    }
+    cur = *(SSA_BBlock **)vector_idx(&info->preds, 0);
+  }
+
+  /* the phi's own block is included, which ends cycles through it */
+  SSA_BBlock *end = cur;
+  for (cur = block;; cur = *(SSA_BBlock **)block_info(b, cur)->preds.data) {
+    if (cur != end || lookup_def(b, var, cur) == 0) {
+      ssa_builder_write(b, var, cur, value);
+    }
+    if (cur == end) {
+      break;
+    }
+  }
+  return value;
+}
+
+/* removes the phis on the trivial worklist that only merge one value besides
+ * themselves, then the phis that used them, which may have become trivial */
+static void
+remove_trivial(SSABuilder *b) {
+  while (b->trivial.items != 0) {
+    SSABuildPhi *phi = ((SSABuildPhi **)b->trivial.data)[--b->trivial.items];
+    if (phi->removed) {
+      continue;
+    }
+    RegId same = 0;
+    bool trivial = true;
+    for (size_t i = 0; i < phi->args.items && trivial; i++) {
+      RegId arg = resolve(b, ((SSA_PhiArg *)vector_idx(&phi->args, i))->reg);
+      if (arg == same || arg == phi->result) {
+        continue;
+      }
+      trivial = same == 0;
+      same = arg;
+    }
+    if (!trivial) {
+      continue;
+    }
+    /* a phi without arguments is in a block that can't be reached */
+    if (same == 0) {
+      same = undefined_value(b, phi->var);
+    }
+    phi->removed = true;
+    *(RegId *)reg_entry(&b->forwards, phi->result) = same;
+    b->replaced = true;
+    /* the users now use same, so if it is a phi that becomes trivial later
+     * they are checked again then */
+    SSABuildPhi **same_phi = same < b->reg_phis.items
+                                 ? vector_idx(&b->reg_phis, same)
+                                 : NULL;
+    for (size_t i = 0; i < phi->users.items; i++) {
+      SSABuildPhi **user = vector_idx(&phi->users, i);
+      if (same_phi != NULL && *same_phi != NULL && *same_phi != *user) {
+        vector_push(&(*same_phi)->users, user);
+      }
+      vector_push(&b->trivial, user);
+    }
+  }
+}
+
+/* gives the pending phis their arguments, which can make more phis in the
+ * predecessors */
+static void
+drain_pending(SSABuilder *b) {
+  while (b->pending.items != 0) {
+    SSABuildPhi *phi = ((SSABuildPhi **)b->pending.data)[--b->pending.items];
+    Vector *preds = &block_info(b, phi->block)->preds;
+    vector_init_size(&phi->args, sizeof(SSA_PhiArg), b->scratch, preds->items);
+    for (size_t i = 0; i < preds->items; i++) {
+      SSA_PhiArg *arg = vector_idx(&phi->args, i);
+      arg->block = *(SSA_BBlock **)vector_idx(preds, i);
+      arg->reg = lookup_def(b, phi->var, arg->block);
+      if (arg->reg == 0) {
+        arg->reg = read_incoming(b, phi->var, arg->block);
+      }
+      SSABuildPhi **used = arg->reg < b->reg_phis.items
+                               ? vector_idx(&b->reg_phis, arg->reg)
+                               : NULL;
+      if (used != NULL && *used != NULL && *used != phi) {
+        vector_push(&(*used)->users, &phi);
+      }
+    }
+    vector_push(&b->trivial, &phi);
+    remove_trivial(b);
+  }
+}
+
+RegId
+ssa_builder_read(SSABuilder *b, size_t var, SSA_BBlock *block) {
+  RegId value = lookup_def(b, var, block);
+  if (value != 0) {
+    return value;
+  }
+  value = read_incoming(b, var, block);
+  drain_pending(b);
+  return resolve(b, value);
+}
+
+void
+ssa_builder_add_pred(SSABuilder *b, SSA_BBlock *block, SSA_BBlock *pred) {
+  SSABuildBlock *info = block_info(b, block);
+  if (info->sealed) {
+    log_internal_err("predecessor added to sealed block %zu", block->id);
+  }
+  vector_push(&info->preds, &pred);
+}
+
+void
+ssa_builder_seal(SSABuilder *b, SSA_BBlock *block) {
+  SSABuildBlock *info = block_info(b, block);
+  info->sealed = true;
+  for (size_t i = 0; i < info->incomplete.items; i++) {
+    vector_push(&b->pending, vector_idx(&info->incomplete, i));
+  }
+  info->incomplete.items = 0;
+  drain_pending(b);
+}
+
+static void
+resolve_operands(SSABuilder *b, SSA_Inst *inst) {
+  for (size_t i = 0; i < inst_operand_count(b->fn, inst); i++) {
+    RegId *reg = inst_operand(b->fn, inst, i);
+    *reg = resolve(b, *reg);
+  }
+}
+
+/* puts the phis of a block that are still around in front of its
+ * instructions */
+static void
+place_phis(SSABuilder *b, SSA_BBlock *block) {
+  Vector *phis = &block_info(b, block)->phis;
+  SSA_Inst *first = block->first;
+  for (size_t i = 0; i < phis->items; i++) {
+    SSABuildPhi *phi = *(SSABuildPhi **)vector_idx(phis, i);
+    if (phi->removed) {
+      continue;
+    }
+    SSA_Inst inst;
+    inst.t = INST_PHI;
+    inst.sz = *(SizeKind *)vector_idx(&b->vars, phi->var);
+    inst.result = phi->result;
+    inst_set_phi(b->fn, &inst, (SSA_PhiArg *)phi->args.data,
+                 phi->args.items);
+    bblock_insert_inst(b->fn, block, first, &inst);
+  }
+}
+
+void
+ssa_builder_finish(SSABuilder *b) {
+  for (SSA_BBlock *block = b->fn->entry; block != NULL; block = block->next) {
+    if (!block_info(b, block)->sealed) {
+      log_internal_err("block %zu was never sealed", block->id);
+    }
+    place_phis(b, block);
+  }
+  if (b->replaced) {
+    for (SSA_BBlock *block = b->fn->entry; block != NULL;
+         block = block->next) {
+      for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+        resolve_operands(b, inst);
+      }
+    }
+  }
+  mempool_release(b->scratch, b->mark);
+  /* the registers of the removed phis are left unused */
+  if (b->replaced) {
+    ssa_fn_compact_regs(b->fn, b->scratch);
+  }
+}
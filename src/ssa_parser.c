@@ -0,0 +1,557 @@
+#include "ssa_parser.h"
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "error.h"
+#include "symtable.h"
+
+typedef struct {
+  BoncContext *ctx;
+  const uint8_t *iter;
+  const uint8_t *end;
+  size_t line;
+  SSA_Prog *prog;
+  Scope *fns; /* VarInfo.fn is the SSA_Fn of the name */
+
+  /* of the function being parsed, by id. The blocks that have been jumped to
+   * but not labeled yet come after the labeled ones */
+  Vector blocks; /* SSA_BBlock * */
+  size_t nlabeled;
+  /* of the function being parsed, whether each register has been set by an
+   * instruction or is a parameter, by register - 1 */
+  Vector defined; /* uint8_t */
+} SSAParser;
+
+static SourcePosition
+here(SSAParser *p) {
+  return make_pos(p->iter, 0, p->line);
+}
+
+static void
+skip_spaces(SSAParser *p) {
+  while (p->iter != p->end &&
+         (*p->iter == ' ' || *p->iter == '\t' || *p->iter == '\r')) {
+    p->iter++;
+  }
+}
+
+static int
+at_eol(SSAParser *p) {
+  skip_spaces(p);
+  return p->iter == p->end || *p->iter == '\n';
+}
+
+static void
+end_line(SSAParser *p) {
+  if (!at_eol(p)) {
+    log_ir_expected_end(p->ctx, here(p));
+    errors_output(p->ctx);
+  }
+  if (p->iter != p->end) {
+    p->iter++;
+    p->line++;
+  }
+}
+
+static void
+skip_blank_lines(SSAParser *p) {
+  while (at_eol(p) && p->iter != p->end) {
+    end_line(p);
+  }
+}
+
+static void
+expect_char(SSAParser *p, uint8_t c) {
+  skip_spaces(p);
+  if (p->iter == p->end || *p->iter != c) {
+    log_ir_expected_char(p->ctx, here(p), c);
+    errors_output(p->ctx);
+  }
+  p->iter++;
+}
+
+static int
+is_name_char(uint8_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+/* can be empty */
+static SourcePosition
+read_name(SSAParser *p) {
+  skip_spaces(p);
+  const uint8_t *start = p->iter;
+  while (p->iter != p->end && is_name_char(*p->iter)) {
+    p->iter++;
+  }
+  return make_pos(start, p->iter - start, p->line);
+}
+
+static int
+name_is(SourcePosition name, const char *str) {
+  return name.sz == strlen(str) && memcmp(name.start, str, name.sz) == 0;
+}
+
+/* whether the line starts a function, at the 'fn' */
+static int
+at_fn(SSAParser *p) {
+  skip_spaces(p);
+  return p->end - p->iter >= 3 && memcmp(p->iter, "fn", 2) == 0 &&
+         (p->iter[2] == ' ' || p->iter[2] == '\t');
+}
+
+static uint64_t
+read_number(SSAParser *p) {
+  skip_spaces(p);
+  const uint8_t *start = p->iter;
+  uint64_t num = 0;
+  int overflow = 0;
+  while (p->iter != p->end && *p->iter >= '0' && *p->iter <= '9') {
+    uint64_t digit = *p->iter++ - '0';
+    if (num > (UINT64_MAX - digit) / 10) {
+      overflow = 1;
+    }
+    num = num * 10 + digit;
+  }
+  SourcePosition pos = make_pos(start, p->iter - start, p->line);
+  if (overflow) {
+    log_intlit_overflow(p->ctx, pos, pos);
+    errors_output(p->ctx);
+  }
+  return num;
+}
+
+/* a size is written as its number of bits, or nothing for SZ_NONE */
+static SizeKind
+parse_size(SSAParser *p, SourcePosition digits) {
+  for (SizeKind sz = SZ_NONE; sz <= SZ_64; sz++) {
+    if (name_is(digits, sz_name_tbl[sz])) {
+      return sz;
+    }
+  }
+  log_ir_expected_size(p->ctx, digits);
+  errors_output(p->ctx);
+  return SZ_NONE;
+}
+
+static SizeKind
+read_size(SSAParser *p) {
+  skip_spaces(p);
+  const uint8_t *start = p->iter;
+  while (p->iter != p->end && *p->iter >= '0' && *p->iter <= '9') {
+    p->iter++;
+  }
+  return parse_size(p, make_pos(start, p->iter - start, p->line));
+}
+
+static SSA_Reg *
+fn_reg(SSA_Fn *fn, RegId reg) {
+  while (fn->regs.items < reg) {
+    ((SSA_Reg *)vector_alloc(&fn->regs))->sz = SZ_NONE;
+  }
+  return vector_idx(&fn->regs, reg - 1);
+}
+
+/* register 0 stands for no value */
+static RegId
+read_reg_or_none(SSAParser *p, SSA_Fn *fn, SourcePosition *where) {
+  skip_spaces(p);
+  if (p->iter == p->end || *p->iter != '%') {
+    log_ir_expected_reg(p->ctx, here(p));
+    errors_output(p->ctx);
+  }
+  p->iter++;
+  const uint8_t *start = p->iter;
+  uint64_t reg = read_number(p);
+  SourcePosition pos = make_pos(start, p->iter - start, p->line);
+  if (pos.sz == 0) {
+    log_ir_expected_reg(p->ctx, pos);
+    errors_output(p->ctx);
+  }
+  /* registers are numbered densely from 1, so there can't be more of them
+   * than bytes of source, which keeps a typo from allocating a huge table */
+  if (reg > p->ctx->src_sz || reg > UINT32_MAX) {
+    log_ir_reg_too_big(p->ctx, pos, pos);
+    errors_output(p->ctx);
+  }
+  if (reg != 0) {
+    fn_reg(fn, (RegId)reg);
+  }
+  *where = pos;
+  return (RegId)reg;
+}
+
+static RegId
+read_reg(SSAParser *p, SSA_Fn *fn) {
+  SourcePosition pos;
+  RegId reg = read_reg_or_none(p, fn, &pos);
+  if (reg == 0) {
+    log_ir_zero_reg(p->ctx, pos);
+    errors_output(p->ctx);
+  }
+  return reg;
+}
+
+/* a register being set, by an instruction or as a parameter, which in SSA
+ * form can only happen once */
+static RegId
+read_def(SSAParser *p, SSA_Fn *fn) {
+  SourcePosition pos;
+  RegId reg = read_reg_or_none(p, fn, &pos);
+  if (reg == 0) {
+    log_ir_zero_reg(p->ctx, pos);
+    errors_output(p->ctx);
+  }
+  while (p->defined.items < reg) {
+    *(uint8_t *)vector_alloc(&p->defined) = 0;
+  }
+  uint8_t *defined = vector_idx(&p->defined, reg - 1);
+  if (*defined) {
+    log_ir_reg_redefinition(p->ctx, pos, pos);
+    errors_output(p->ctx);
+  }
+  *defined = 1;
+  return reg;
+}
+
+static SSA_BBlock *
+fn_block(SSAParser *p, size_t id) {
+  while (p->blocks.items <= id) {
+    SSA_BBlock *block = bblock_init(&p->prog->pool);
+    vector_push(&p->blocks, &block);
+  }
+  return *(SSA_BBlock **)vector_idx(&p->blocks, id);
+}
+
+/* a block's id after its '@', which has the same limit as registers */
+static size_t
+read_block_id(SSAParser *p) {
+  const uint8_t *start = p->iter;
+  size_t id = read_number(p);
+  SourcePosition pos = make_pos(start, p->iter - start, p->line);
+  if (pos.sz == 0 || id > p->ctx->src_sz) {
+    log_ir_expected_char(p->ctx, pos, '@');
+    errors_output(p->ctx);
+  }
+  return id;
+}
+
+static void
+parse_label(SSAParser *p, SSA_BBlock **block) {
+  SourcePosition pos = here(p);
+  p->iter++;
+  size_t id = read_block_id(p);
+  if (id != p->nlabeled) {
+    log_ir_bad_label(p->ctx, pos, (int)p->nlabeled);
+    errors_output(p->ctx);
+  }
+  expect_char(p, ':');
+  end_line(p);
+  SSA_BBlock *next = fn_block(p, id);
+  p->nlabeled++;
+  (*block)->next = next;
+  *block = next;
+}
+
+static void
+parse_callfn(SSAParser *p, SSA_Fn *fn, SSA_Inst *inst) {
+  SourcePosition name = read_name(p);
+  ScopeEntry *callee = scope_find(p->fns, name);
+  if (callee == NULL) {
+    log_ir_unknown_fn(p->ctx, name, name);
+    errors_output(p->ctx);
+  }
+  /* gathered in scratch until they're all known, which is given back with
+   * the rest of the function's */
+  Vector args;
+  vector_init_size(&args, sizeof(RegId), &p->ctx->scratch, 0);
+
+  expect_char(p, '(');
+  skip_spaces(p);
+  if (p->iter != p->end && *p->iter == ')') {
+    p->iter++;
+  } else {
+    while (1) {
+      RegId arg = read_reg(p, fn);
+      vector_push(&args, &arg);
+      skip_spaces(p);
+      if (p->iter == p->end || *p->iter != ',') {
+        break;
+      }
+      p->iter++;
+    }
+    expect_char(p, ')');
+  }
+  inst_set_call(fn, inst, callee->inf.fn, (RegId *)args.data, args.items);
+}
+
+/* the arguments of a phi, "(@1 %3, @2 %4)" */
+static void
+parse_phi(SSAParser *p, SSA_Fn *fn, SSA_Inst *inst) {
+  Vector args;
+  vector_init_size(&args, sizeof(SSA_PhiArg), &p->ctx->scratch, 0);
+
+  expect_char(p, '(');
+  skip_spaces(p);
+  if (p->iter != p->end && *p->iter == ')') {
+    p->iter++;
+  } else {
+    while (1) {
+      SSA_PhiArg arg;
+      expect_char(p, '@');
+      arg.block = fn_block(p, read_block_id(p));
+      arg.reg = read_reg(p, fn);
+      vector_push(&args, &arg);
+      skip_spaces(p);
+      if (p->iter == p->end || *p->iter != ',') {
+        break;
+      }
+      p->iter++;
+    }
+    expect_char(p, ')');
+  }
+  inst_set_phi(fn, inst, (SSA_PhiArg *)args.data, args.items);
+}
+
+static void
+parse_inst(SSAParser *p, SSA_Fn *fn, SSA_BBlock *block) {
+  RegId result = 0;
+  SizeKind sz = SZ_NONE;
+  skip_spaces(p);
+  if (*p->iter == '%') {
+    result = read_def(p, fn);
+    expect_char(p, '=');
+    sz = read_size(p);
+    skip_spaces(p);
+  }
+
+  SSA_Inst inst;
+  inst.result = result;
+  inst.sz = sz;
+  if (p->iter != p->end && *p->iter == '$') {
+    p->iter++;
+    inst.t = INST_IMM;
+    inst_set_imm(fn, &inst, read_number(p));
+  } else {
+    SourcePosition name = read_name(p);
+    if (name_is(name, inst_name_tbl[INST_CALLFN])) {
+      inst.t = INST_CALLFN;
+      parse_callfn(p, fn, &inst);
+    } else if (name_is(name, inst_name_tbl[INST_PHI])) {
+      inst.t = INST_PHI;
+      parse_phi(p, fn, &inst);
+    } else {
+      InstKind kind = 0;
+      while (kind < INST_COUNT &&
+             (kind == INST_IMM || kind == INST_CALLFN || kind == INST_PHI ||
+              !name_is(name, inst_name_tbl[kind]))) {
+        kind++;
+      }
+      if (kind == INST_COUNT) {
+        log_ir_unknown_inst(p->ctx, name, name);
+        errors_output(p->ctx);
+      }
+      inst.t = kind;
+      /* a ret without a value returns register 0 */
+      SourcePosition pos;
+      for (uint8_t i = 0; i < inst_arity_tbl[kind]; i++) {
+        inst.data.operands[i] = kind == INST_RET
+                                    ? read_reg_or_none(p, fn, &pos)
+                                    : read_reg(p, fn);
+      }
+      SSA_BBlock *targets[2];
+      for (uint8_t i = 0; i < inst_targets_tbl[kind]; i++) {
+        expect_char(p, '@');
+        targets[i] = fn_block(p, read_block_id(p));
+      }
+      if (inst_targets_tbl[kind] != 0) {
+        inst_set_targets(fn, &inst, targets);
+      }
+    }
+  }
+  end_line(p);
+  bblock_append(fn, block, &inst);
+
+  if (result != 0) {
+    fn_reg(fn, result)->sz = sz;
+  }
+}
+
+/* a table of every register in order, which has the final say on their
+ * sizes */
+static void
+parse_reg_table(SSAParser *p, SSA_Fn *fn) {
+  size_t nregs = 0;
+  SourcePosition start = here(p);
+  while (!at_eol(p) && *p->iter == '|') {
+    p->iter++;
+    if (read_number(p) != nregs + 1) {
+      log_ir_bad_reg_table(p->ctx, here(p));
+      errors_output(p->ctx);
+    }
+    expect_char(p, '|');
+    SourcePosition name = read_name(p);
+    if (name.sz < 3 || memcmp(name.start, "bit", 3) != 0) {
+      log_ir_expected_size(p->ctx, name);
+      errors_output(p->ctx);
+    }
+    name.start += 3;
+    name.sz -= 3;
+    fn_reg(fn, ++nregs)->sz = parse_size(p, name);
+    expect_char(p, '|');
+    end_line(p);
+  }
+  if (nregs < fn->regs.items) {
+    log_ir_bad_reg_table(p->ctx, start);
+    errors_output(p->ctx);
+  }
+}
+
+static void
+parse_fn(SSAParser *p, SSA_Fn *fn) {
+  MemPool *pool = &p->prog->pool;
+  if (!at_fn(p)) {
+    log_ir_expected_fn(p->ctx, here(p));
+    errors_output(p->ctx);
+  }
+  p->iter += 2;
+  read_name(p); /* already known from declare_fns */
+  ssa_fn_init(fn, pool);
+  MemPoolMark mark = mempool_mark(&p->ctx->scratch);
+  vector_init(&p->blocks, sizeof(SSA_BBlock *), &p->ctx->scratch);
+  vector_init(&p->defined, sizeof(uint8_t), &p->ctx->scratch);
+  fn->entry = fn_block(p, 0);
+  p->nlabeled = 1;
+
+  expect_char(p, '(');
+  skip_spaces(p);
+  if (p->iter != p->end && *p->iter == ')') {
+    p->iter++;
+  } else {
+    while (1) {
+      RegId param = read_def(p, fn);
+      expect_char(p, ':');
+      fn_reg(fn, param)->sz = read_size(p);
+      vector_push(&fn->params, &param);
+      skip_spaces(p);
+      if (p->iter == p->end || *p->iter != ',') {
+        break;
+      }
+      p->iter++;
+    }
+    expect_char(p, ')');
+  }
+  end_line(p);
+
+  /* the instructions go on up to a blank line, though hand written IR might
+   * go straight on to the next function or the register table */
+  SSA_BBlock *block = fn->entry;
+  while (!at_eol(p) && *p->iter != '|' && !at_fn(p)) {
+    if (*p->iter == '@') {
+      parse_label(p, &block);
+    } else {
+      parse_inst(p, fn, block);
+    }
+  }
+  /* blocks are only made up to the furthest one jumped to, so that is one
+   * that is missing */
+  if (p->blocks.items > p->nlabeled) {
+    log_ir_unknown_block(p->ctx, here(p), (int)(p->blocks.items - 1));
+    errors_output(p->ctx);
+  }
+  mempool_release(&p->ctx->scratch, mark);
+  skip_blank_lines(p);
+  if (!at_eol(p) && *p->iter == '|') {
+    parse_reg_table(p, fn);
+  }
+}
+
+/* finds every function up front, since calls can come before the function
+ * they call */
+static void
+declare_fns(SSAParser *p) {
+  MemPool *scratch = &p->ctx->scratch;
+  Vector names;
+  vector_init(&names, sizeof(SourcePosition), scratch);
+  const uint8_t *iter = p->iter;
+  size_t line = p->line;
+  while (p->iter != p->end) {
+    if (at_fn(p)) {
+      p->iter += 2;
+      SourcePosition name = read_name(p);
+      if (name.sz == 0) {
+        log_ir_expected_fn(p->ctx, name);
+        errors_output(p->ctx);
+      }
+      vector_push(&names, &name);
+    }
+    while (p->iter != p->end && *p->iter++ != '\n') {
+    }
+    p->line++;
+  }
+  p->iter = iter;
+  p->line = line;
+
+  SSA_Prog *prog = p->prog;
+  vector_init_size(&prog->fns, sizeof(SSA_Fn), &prog->pool, names.items);
+  p->fns = scope_init(scratch, NULL);
+  for (size_t i = 0; i < names.items; i++) {
+    SourcePosition *name = vector_idx(&names, i);
+    SSA_Fn *fn = vector_idx(&prog->fns, i);
+    VarInfo inf = {.fn = fn};
+    if (scope_insert(scratch, p->fns, *name, inf) == NULL) {
+      log_ir_fn_redefinition(p->ctx, *name, *name);
+      errors_output(p->ctx);
+    }
+    fn->name = *name;
+  }
+}
+
+static void
+parse_prog(SSAParser *p) {
+  skip_blank_lines(p);
+  SourcePosition header = read_name(p);
+  if (name_is(header, "IR_DUMP") && p->iter != p->end && *p->iter == ':') {
+    p->iter++;
+    end_line(p);
+  } else {
+    p->iter = header.start;
+  }
+
+  declare_fns(p);
+  for (size_t i = 0; i < p->prog->fns.items; i++) {
+    skip_blank_lines(p);
+    parse_fn(p, vector_idx(&p->prog->fns, i));
+  }
+  skip_blank_lines(p);
+  if (p->iter != p->end) {
+    log_ir_expected_fn(p->ctx, here(p));
+    errors_output(p->ctx);
+  }
+}
+
+void
+parse_ssa(BoncContext *ctx, SSA_Prog *prog) {
+  SSAParser p = {.ctx = ctx,
+                 .iter = ctx->src_base,
+                 .end = ctx->src_base + ctx->src_sz,
+                 .line = 1,
+                 .prog = prog};
+  bonc_context_pool_get(ctx, &prog->pool);
+
+  /* the names are only needed while parsing, so they're released on the way
+   * out to the caller's bailout too */
+  MemPoolMark mark = mempool_mark(&ctx->scratch);
+  jmp_buf *caller = ctx->bailout;
+  jmp_buf bailout;
+  if (setjmp(bailout)) {
+    mempool_release(&ctx->scratch, mark);
+    ctx->bailout = caller;
+    longjmp(*caller, 1);
+  }
+  ctx->bailout = &bailout;
+  parse_prog(&p);
+  mempool_release(&ctx->scratch, mark);
+  ctx->bailout = caller;
+}
@@ -0,0 +1,65 @@
+#define _GNU_SOURCE
+#include "stream.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+#define STREAM_MAX_SZ 4294967296
+/* the most read at once, which is also the most a pipe holds by default */
+#define STREAM_CHUNK_SZ 65536
+
+void
+input_stream_init(InputStream *stream, int fd) {
+  stream->fd = fd;
+  /* pages are only backed once input is read into them */
+  stream->base = mmap(NULL, STREAM_MAX_SZ, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (stream->base == MAP_FAILED) {
+    log_internal_err("unable to reserve memory for input", NULL);
+  }
+  stream->sz = 0;
+  stream->done = false;
+  stream->error = NULL;
+}
+
+bool
+input_stream_fill(InputStream *stream) {
+  while (!stream->done) {
+    size_t room = STREAM_MAX_SZ - stream->sz;
+    if (room == 0) {
+      stream->error = "'%s' is too big";
+      stream->done = true;
+      break;
+    }
+    ssize_t got = read(stream->fd, stream->base + stream->sz,
+                       room < STREAM_CHUNK_SZ ? room : STREAM_CHUNK_SZ);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      stream->error = "unable to get contents of '%s'";
+    }
+    if (got <= 0) {
+      stream->done = true;
+      break;
+    }
+    stream->sz += got;
+    return true;
+  }
+  return false;
+}
+
+void
+input_stream_read_all(InputStream *stream) {
+  while (input_stream_fill(stream)) {
+  }
+}
+
+void
+input_stream_deinit(InputStream *stream) {
+  munmap(stream->base, STREAM_MAX_SZ);
+  stream->base = NULL;
+}
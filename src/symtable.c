@@ -4,8 +4,6 @@
 
 #define INIT_BUCKETS 32
 
-#define MIN(a, b) (a > b ? b : a)
-
 VarInfo
 make_var_info(int mut, struct Type *type) {
   VarInfo inf = {.mut = mut, .type = type, .id = 0};
@@ -16,46 +14,80 @@ Scope *
 scope_init(MemPool *pool, Scope *up) {
   Scope *scope = mempool_alloc(pool, sizeof(Scope));
   scope->nbuckets = INIT_BUCKETS;
+  scope->nentries = 0;
   scope->up = up;
   scope->buckets = mempool_alloc(pool, sizeof(ScopeEntry *) * scope->nbuckets);
   memset(scope->buckets, 0, sizeof(ScopeEntry *) * scope->nbuckets);
   return scope;
 }
 
+/* FNV-1a */
 static inline size_t
 hash_str(SourcePosition pos) {
-  size_t total = 0;
+  uint64_t hash = 0xcbf29ce484222325;
   for (size_t i = 0; i < pos.sz; i++) {
-    total += pos.start[i];
+    hash = (hash ^ pos.start[i]) * 0x100000001b3;
+  }
+  return hash;
+}
+
+static inline int
+entry_matches(ScopeEntry *entry, SourcePosition pos, size_t hash) {
+  return entry->hash == hash && entry->pos.sz == pos.sz &&
+         memcmp(pos.start, entry->pos.start, pos.sz) == 0;
+}
+
+/* the old buckets are left in the pool */
+static void
+scope_grow(MemPool *pool, Scope *scope) {
+  size_t nbuckets = scope->nbuckets * 2;
+  ScopeEntry **buckets = mempool_alloc(pool, sizeof(ScopeEntry *) * nbuckets);
+  memset(buckets, 0, sizeof(ScopeEntry *) * nbuckets);
+  for (size_t i = 0; i < scope->nbuckets; i++) {
+    ScopeEntry *iter = scope->buckets[i];
+    while (iter != NULL) {
+      ScopeEntry *next = iter->next;
+      size_t idx = iter->hash & (nbuckets - 1);
+      iter->next = buckets[idx];
+      buckets[idx] = iter;
+      iter = next;
+    }
   }
-  return total;
+  scope->buckets = buckets;
+  scope->nbuckets = nbuckets;
 }
 
 ScopeEntry *
 scope_insert(MemPool *pool, Scope *scope, SourcePosition pos, VarInfo inf) {
-  size_t idx = hash_str(pos) % scope->nbuckets;
-  for (ScopeEntry *iter = scope->buckets[idx]; iter != NULL;
-       iter = iter->next) {
-    if (memcmp(pos.start, iter->pos.start, MIN(pos.sz, iter->pos.sz)) == 0) {
+  size_t hash = hash_str(pos);
+  for (ScopeEntry *iter = scope->buckets[hash & (scope->nbuckets - 1)];
+       iter != NULL; iter = iter->next) {
+    if (entry_matches(iter, pos, hash)) {
       return NULL;
     }
   }
 
+  if (scope->nentries >= scope->nbuckets) {
+    scope_grow(pool, scope);
+  }
+  size_t idx = hash & (scope->nbuckets - 1);
   ScopeEntry *new_entry = mempool_alloc(pool, sizeof(ScopeEntry));
   new_entry->next = scope->buckets[idx];
   new_entry->pos = pos;
+  new_entry->hash = hash;
   new_entry->inf = inf;
   scope->buckets[idx] = new_entry;
+  scope->nentries++;
   return new_entry;
 }
 
 ScopeEntry *
 scope_find(Scope *scope, SourcePosition pos) {
-  size_t idx = hash_str(pos) % scope->nbuckets;
+  size_t hash = hash_str(pos);
   while (scope != NULL) {
-    for (ScopeEntry *iter = scope->buckets[idx]; iter != NULL;
-         iter = iter->next) {
-      if (memcmp(pos.start, iter->pos.start, MIN(pos.sz, iter->pos.sz)) == 0) {
+    for (ScopeEntry *iter = scope->buckets[hash & (scope->nbuckets - 1)];
+         iter != NULL; iter = iter->next) {
+      if (entry_matches(iter, pos, hash)) {
         return iter;
       }
     }
@@ -0,0 +1,57 @@
+#define _GNU_SOURCE
+#include "threadpool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "helper.h"
+
+typedef struct {
+  ThreadpoolJob fn;
+  void *data;
+  size_t njobs;
+  size_t next; /* next job to hand out, only touched atomically */
+} Threadpool;
+
+size_t
+threadpool_default_workers() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return cores < 1 ? 1 : (size_t)cores;
+}
+
+static void *
+worker(void *arg) {
+  Threadpool *pool = arg;
+  size_t job;
+  while ((job = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) <
+         pool->njobs) {
+    pool->fn(pool->data, job);
+  }
+  return NULL;
+}
+
+void
+threadpool_run(size_t njobs, size_t nworkers, ThreadpoolJob fn, void *data) {
+  Threadpool pool = {.fn = fn, .data = data, .njobs = njobs, .next = 0};
+  if (nworkers > njobs) {
+    nworkers = njobs;
+  }
+  if (nworkers <= 1) {
+    worker(&pool);
+    return;
+  }
+
+  /* the calling thread is one of the workers */
+  pthread_t *threads = malloc(sizeof(pthread_t) * (nworkers - 1));
+  for (size_t i = 0; i < nworkers - 1; i++) {
+    if (pthread_create(&threads[i], NULL, worker, &pool) != 0) {
+      log_internal_err("unable to start worker thread", NULL);
+    }
+  }
+  worker(&pool);
+  for (size_t i = 0; i < nworkers - 1; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
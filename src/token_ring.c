@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include "token_ring.h"
+
+#include <sched.h>
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include "helper.h"
+
+#define RING_MASK (TOKEN_RING_SZ - 1)
+/* times to check the other side before giving up the core */
+#define RING_SPINS 64
+
+static void
+save_state(LexState *state, Lexer *lex) {
+  state->start = lex->start;
+  state->end = lex->end;
+  state->line = lex->line;
+  state->sz = lex->sz;
+  state->prev = lex->prev;
+}
+
+/* waits for room in the ring. Returns false if the parser gave up on it */
+static bool
+wait_for_room(TokenRing *ring, size_t head) {
+  for (size_t spins = 0;; spins++) {
+    ring->seen_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - ring->seen_tail < TOKEN_RING_SZ) {
+      return true;
+    }
+    if (__atomic_load_n(&ring->cancel, __ATOMIC_RELAXED)) {
+      return false;
+    }
+    if (spins >= RING_SPINS) {
+      sched_yield();
+    }
+  }
+}
+
+static void
+produce(TokenRing *ring) {
+  Lexer *lex = &ring->lex;
+  size_t head = 0;
+  Token tok;
+  do {
+    save_state(&ring->resume, lex);
+    tok = lexer_next(lex);
+    if (head - ring->seen_tail >= TOKEN_RING_SZ && !wait_for_room(ring, head)) {
+      return;
+    }
+    ring->toks[head & RING_MASK] = tok;
+    __atomic_store_n(&ring->head, ++head, __ATOMIC_RELEASE);
+  } while (tok.t != TOK_EOF);
+  /* the parser's lexer carries on from the end, handing out more EOFs */
+  save_state(&ring->resume, lex);
+}
+
+static void *
+lex_thread(void *arg) {
+  TokenRing *ring = arg;
+  jmp_buf bailout;
+
+  if (setjmp(bailout)) {
+    /* the parser's lexer picks up from the token that failed and reports it,
+     * all that's published is a token to stop at */
+    ring->failed = true;
+    Token stop = {.t = TOK_EOF};
+    if (wait_for_room(ring, ring->head)) {
+      ring->toks[ring->head & RING_MASK] = stop;
+      __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+  }
+  ring->lex_ctx.bailout = &bailout;
+  produce(ring);
+  return NULL;
+}
+
+TokenRing *
+token_ring_start(BoncContext *ctx) {
+  TokenRing *ring = malloc(sizeof(TokenRing));
+  ring->head = 0;
+  ring->failed = false;
+  ring->cancel = false;
+  ring->tail = 0;
+  ring->seen_head = 0;
+  ring->seen_tail = 0;
+
+  /* diagnostics on the lexer thread are only collected, never written */
+  bonc_context_init(&ring->lex_ctx, ctx->src_base, ctx->src_sz,
+                    ctx->filename, NULL);
+  ring->lex = ctx->lex;
+  ring->lex.ctx = &ring->lex_ctx;
+  ring->consumer = &ctx->lex;
+  ctx->lex.ring = ring;
+
+  if (pthread_create(&ring->thread, NULL, lex_thread, ring) != 0) {
+    log_internal_err("unable to start lexer thread", NULL);
+  }
+  return ring;
+}
+
+bool
+token_ring_next(TokenRing *ring, Token *tok) {
+  size_t tail = ring->tail;
+  for (size_t spins = 0; ring->seen_head == tail; spins++) {
+    ring->seen_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (spins >= RING_SPINS) {
+      sched_yield();
+    }
+  }
+  *tok = ring->toks[tail & RING_MASK];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  if (tok->t != TOK_EOF) {
+    return true;
+  }
+
+  /* the lexer thread is done, so its state can be taken over */
+  pthread_join(ring->thread, NULL);
+  Lexer *lex = ring->consumer;
+  lex->start = ring->resume.start;
+  lex->end = ring->resume.end;
+  lex->line = ring->resume.line;
+  lex->sz = ring->resume.sz;
+  lex->prev = ring->resume.prev;
+  lex->ring = NULL;
+  return !ring->failed;
+}
+
+void
+token_ring_stop(TokenRing *ring) {
+  if (ring->consumer->ring == ring) {
+    __atomic_store_n(&ring->cancel, true, __ATOMIC_RELAXED);
+    pthread_join(ring->thread, NULL);
+    ring->consumer->ring = NULL;
+  }
+  bonc_context_deinit(&ring->lex_ctx);
+  free(ring);
+}
@@ -0,0 +1,338 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "passes.h"
+
+/* each of the checks returns what is wrong, or NULL if nothing is */
+
+/* where a register is set. The parameters are set before the first
+ * instruction of the entry */
+typedef struct {
+  bool set;
+  SSA_BBlock *block;
+  size_t pos; /* of the instruction in the walk over the blocks, from 1 */
+} RegDef;
+
+static SizeKind
+reg_sz(SSA_Fn *fn, RegId reg) {
+  return ((SSA_Reg *)vector_idx(&fn->regs, reg - 1))->sz;
+}
+
+/* register 0 stands for no value, which only a ret can have */
+static const char *
+check_reg(SSA_Fn *fn, SSA_Inst *inst, RegId reg) {
+  if (reg > fn->regs.items) {
+    return "register out of range";
+  }
+  if (reg == 0 && (inst == NULL || inst->t != INST_RET)) {
+    return "register 0 read by an instruction other than ret";
+  }
+  return NULL;
+}
+
+/* whether block is one of fn's, given them all by id */
+static const char *
+check_block(SSA_BBlock **blocks, size_t nblocks, SSA_BBlock *block) {
+  if (block == NULL || block->id >= nblocks || blocks[block->id] != block) {
+    return "jump to a block of another function";
+  }
+  return NULL;
+}
+
+static const char *
+check_inst(SSA_Fn *fn, SSA_BBlock **blocks, size_t nblocks, SSA_Inst *inst) {
+  const char *error = NULL;
+  if (inst->t >= INST_COUNT || inst->sz > SZ_64) {
+    return "bad instruction kind or size";
+  }
+  if (inst->t == INST_IMM && inst->data.imm >= fn->imms.items) {
+    return "immediate out of range";
+  }
+  if (inst->t == INST_CALLFN) {
+    if (inst->data.call >= fn->calls.items) {
+      return "call out of range";
+    }
+    SSA_Call *call = inst_call(fn, inst);
+    if ((size_t)call->args + call->nargs > fn->args.items) {
+      return "call arguments out of range";
+    }
+  }
+  if (inst->t == INST_PHI) {
+    if ((size_t)inst->data.phi.args + inst->data.phi.nargs >
+        fn->phi_args.items) {
+      return "phi arguments out of range";
+    }
+    for (size_t i = 0; i < inst->data.phi.nargs && error == NULL; i++) {
+      error = check_block(blocks, nblocks, inst_phi_args(fn, inst)[i].block);
+    }
+  }
+  if (inst_targets_tbl[inst->t] != 0) {
+    if ((size_t)inst->data.br.targets + inst_targets_tbl[inst->t] >
+        fn->targets.items) {
+      return "targets out of range";
+    }
+    for (int i = 0; i < inst_targets_tbl[inst->t] && error == NULL; i++) {
+      error = check_block(blocks, nblocks, inst_targets(fn, inst)[i]);
+    }
+  }
+  for (size_t i = 0; i < inst_operand_count(fn, inst) && error == NULL; i++) {
+    error = check_reg(fn, inst, *inst_operand(fn, inst, i));
+  }
+  return error;
+}
+
+/* the size of an instruction is that of its result. Arithmetic, copies and
+ * phis work on values of that size, the others take operands of any size.
+ * Without a result the size isn't written in the IR, so there is nothing to
+ * check. Needs the registers to be in range */
+static const char *
+check_sizes(SSA_Fn *fn, SSA_Inst *inst) {
+  if (inst->result == 0) {
+    return NULL;
+  }
+  if (reg_sz(fn, inst->result) != inst->sz) {
+    return "result of another size than its instruction";
+  }
+  if (inst->t == INST_CALLFN) {
+    return NULL;
+  }
+  for (size_t i = 0; i < inst_operand_count(fn, inst); i++) {
+    if (reg_sz(fn, *inst_operand(fn, inst, i)) != inst->sz) {
+      return "operand of another size than its instruction";
+    }
+  }
+  return NULL;
+}
+
+/* reads in blocks that can't be reached are never run, so they don't need
+ * anything */
+static const char *
+check_read(RegDef *defs, SSA_BBlock *block, size_t pos, RegId reg) {
+  if (reg == 0 || block->rpo == SIZE_MAX) {
+    return NULL;
+  }
+  RegDef *def = &defs[reg];
+  if (!def->set) {
+    return "read of a register nothing sets";
+  }
+  if (!cfg_dominates(def->block, block) ||
+      (def->block == block && def->pos >= pos)) {
+    return "read of a register that isn't always set before it";
+  }
+  return NULL;
+}
+
+/* a phi has an argument for every predecessor of its block and no others,
+ * each read at the end of its predecessor. stamps holds for every block the
+ * last phi it was a predecessor (odd) or an argument (even) of, and id is new
+ * for every phi */
+static const char *
+check_phi(SSA_Fn *fn, SSA_BBlock *block, SSA_Inst *inst, RegDef *defs,
+          size_t *stamps, size_t id) {
+  for (size_t i = 0; i < block->npreds; i++) {
+    stamps[block->preds[i]->id] = 2 * id + 1;
+  }
+  SSA_PhiArg *args = inst_phi_args(fn, inst);
+  for (size_t i = 0; i < inst->data.phi.nargs; i++) {
+    size_t *stamp = &stamps[args[i].block->id];
+    if (*stamp == 2 * id + 2) {
+      return "phi with two arguments for one predecessor";
+    }
+    if (*stamp != 2 * id + 1) {
+      return "phi argument for a block that isn't a predecessor";
+    }
+    *stamp = 2 * id + 2;
+    if (block->rpo != SIZE_MAX) {
+      const char *error =
+          check_read(defs, args[i].block, SIZE_MAX, args[i].reg);
+      if (error != NULL) {
+        return error;
+      }
+    }
+  }
+  if (inst->data.phi.nargs != block->npreds) {
+    return "phi without an argument for every predecessor";
+  }
+  return NULL;
+}
+
+/* every register read has to be set on every path to the read, which is the
+ * case if its definition dominates it */
+static const char *
+check_reads(SSA_Fn *fn, RegDef *defs, size_t nblocks, MemPool *scratch) {
+  cfg_build(fn, scratch, scratch);
+  cfg_dominators(fn, scratch, scratch);
+  size_t *stamps = mempool_alloc(scratch, nblocks * sizeof(size_t));
+  memset(stamps, 0, nblocks * sizeof(size_t));
+  size_t pos = 0;
+  size_t nphis = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      const char *error = NULL;
+      pos++;
+      if (inst->t == INST_PHI) {
+        error = check_phi(fn, block, inst, defs, stamps, nphis++);
+      }
+      for (size_t i = 0;
+           inst->t != INST_PHI && i < inst_operand_count(fn, inst) &&
+           error == NULL;
+           i++) {
+        error = check_read(defs, block, pos, *inst_operand(fn, inst, i));
+      }
+      if (error != NULL) {
+        return error;
+      }
+    }
+  }
+  return NULL;
+}
+
+const char *
+ssa_fn_verify(SSA_Fn *fn, MemPool *scratch) {
+  size_t nblocks = ssa_number_blocks(fn);
+  SSA_BBlock **blocks = mempool_alloc(scratch, nblocks * sizeof(*blocks));
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    blocks[block->id] = block;
+  }
+  /* every register is set at most once */
+  RegDef *defs = mempool_alloc(scratch, (fn->regs.items + 1) * sizeof(RegDef));
+  memset(defs, 0, (fn->regs.items + 1) * sizeof(RegDef));
+  for (size_t i = 0; i < fn->params.items; i++) {
+    RegId param = *(RegId *)vector_idx(&fn->params, i);
+    const char *error = check_reg(fn, NULL, param);
+    if (error != NULL) {
+      return error;
+    }
+    if (defs[param].set) {
+      return "register set twice";
+    }
+    defs[param] = (RegDef){true, fn->entry, 0};
+  }
+
+  /* what comes after a return or branch that isn't the last instruction of its
+   * block is dead, but allowed, as translating code after a return leaves it
+   * there */
+  size_t pos = 0;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    SSA_Inst *prev = NULL;
+    size_t ninsts = 0;
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->prev != prev) {
+        return "broken instruction list";
+      }
+      const char *error = check_inst(fn, blocks, nblocks, inst);
+      if (error != NULL) {
+        return error;
+      }
+      pos++;
+      if (inst->t == INST_PHI && prev != NULL && prev->t != INST_PHI) {
+        return "phi after the start of its block";
+      }
+      if (inst->result != 0) {
+        if (!inst_returns_tbl[inst->t]) {
+          return "result of an instruction that doesn't return";
+        }
+        if (inst->result > fn->regs.items) {
+          return "register out of range";
+        }
+        if (defs[inst->result].set) {
+          return "register set twice";
+        }
+        defs[inst->result] = (RegDef){true, block, pos};
+      }
+      if ((error = check_sizes(fn, inst)) != NULL) {
+        return error;
+      }
+      prev = inst;
+      ninsts++;
+    }
+    if (block->last != prev || block->ninsts != ninsts) {
+      return "broken instruction list";
+    }
+  }
+  return check_reads(fn, defs, nblocks, scratch);
+}
+
+/* the calls of fn go to functions of prog, with an argument of the right size
+ * for each parameter. The callees have to have been verified */
+static const char *
+check_calls(SSA_Prog *prog, SSA_Fn *fn) {
+  SSA_Fn *fns = (SSA_Fn *)prog->fns.data;
+  for (SSA_BBlock *block = fn->entry; block != NULL; block = block->next) {
+    for (SSA_Inst *inst = block->first; inst != NULL; inst = inst->next) {
+      if (inst->t != INST_CALLFN) {
+        continue;
+      }
+      SSA_Fn *callee = inst_call(fn, inst)->fn;
+      if (callee < fns || callee >= fns + prog->fns.items) {
+        return "call to a function of another program";
+      }
+      if (inst_call(fn, inst)->nargs != callee->params.items) {
+        return "call with another number of arguments than parameters";
+      }
+      RegId *args = inst_call_args(fn, inst);
+      for (size_t i = 0; i < callee->params.items; i++) {
+        RegId param = *(RegId *)vector_idx(&callee->params, i);
+        if (reg_sz(fn, args[i]) != reg_sz(callee, param)) {
+          return "call argument of another size than its parameter";
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+/* checks every function, then the calls between them, and gives what is
+ * wrong along with the function it is in */
+static const char *
+verify_prog(SSA_Prog *prog, MemPool *scratch, SSA_Fn **where) {
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    *where = vector_idx(&prog->fns, i);
+    MemPoolMark mark = mempool_mark(scratch);
+    const char *error = ssa_fn_verify(*where, scratch);
+    mempool_release(scratch, mark);
+    if (error != NULL) {
+      return error;
+    }
+  }
+  for (size_t i = 0; i < prog->fns.items; i++) {
+    *where = vector_idx(&prog->fns, i);
+    const char *error = check_calls(prog, *where);
+    if (error != NULL) {
+      return error;
+    }
+  }
+  return NULL;
+}
+
+void
+pass_verify(SSA_Prog *prog, PassContext *pc) {
+  SSA_Fn *fn;
+  const char *error = verify_prog(prog, pc->scratch, &fn);
+  if (error != NULL) {
+    log_internal_err("verify: %s in '%.*s'", error, (int)fn->name.sz,
+                     (const char *)fn->name.start);
+  }
+}
+
+void
+pass_verify_fn(SSA_Fn *fn, PassContext *pc) {
+  const char *error = ssa_fn_verify(fn, pc->scratch);
+  if (error != NULL) {
+    log_internal_err("verify: %s in '%.*s'", error, (int)fn->name.sz,
+                     (const char *)fn->name.start);
+  }
+}
+
+bool
+ssa_prog_verify(SSA_Prog *prog, MemPool *scratch, const char *filename) {
+  SSA_Fn *fn;
+  const char *error = verify_prog(prog, scratch, &fn);
+  if (error != NULL) {
+    log_err("'%s': %s in '%.*s'", filename, error, (int)fn->name.sz,
+            (const char *)fn->name.start);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include "watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "document.h"
+#include "helper.h"
+#include "threadpool.h"
+
+/* writes closer together than this are compiled in one round, since editors
+ * and build tools often save a file in several steps */
+#define WATCH_DEBOUNCE_MS 30
+/* a document is parsed again from scratch once the memory left behind by its
+ * edits and analyses makes its AST this many times bigger than a fresh one */
+#define WATCH_REBUILD_FACTOR 4
+
+typedef struct {
+  const char *filename;
+  const char *name; /* in its directory */
+  int wd;           /* of the watch on its directory */
+  bool dirty;
+
+  BoncContext ctx;
+  Document doc;
+  bool have_doc;
+  size_t fresh_pool_sz; /* of the document's AST right after it was parsed */
+
+  /* the contents the document is up to date with, and a buffer to read the
+   * new ones into, the two are swapped after every change */
+  uint8_t *text;
+  size_t sz;
+  size_t text_alloc;
+  uint8_t *next;
+  size_t next_alloc;
+
+  /* results of the last round */
+  bool changed; /* nothing else is set if the contents were the same */
+  bool failed;
+  const char *io_error; /* printf format taking the filename, NULL if none */
+  char *output;
+  size_t output_sz;
+  TimeReport times;
+} WatchedFile;
+
+typedef struct {
+  WatchedFile **files;
+  CompileOptions *opts;
+} WatchRound;
+
+/* reads the whole file into file->next, which is reused between rounds rather
+ * than mapping the file again every time */
+static bool
+read_file(WatchedFile *file, size_t *sz) {
+  int fd = open(file->filename, O_RDONLY);
+  if (fd == -1) {
+    file->io_error = "unable to open '%s'";
+    return false;
+  }
+  size_t total = 0;
+  while (1) {
+    if (total == file->next_alloc) {
+      file->next_alloc = file->next_alloc == 0 ? 4096 : file->next_alloc * 2;
+      file->next = realloc(file->next, file->next_alloc);
+    }
+    ssize_t got = read(fd, file->next + total, file->next_alloc - total);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    if (got == -1) {
+      file->io_error = "unable to get contents of '%s'";
+      close(fd);
+      return false;
+    }
+    if (got == 0) {
+      break;
+    }
+    total += got;
+  }
+  close(fd);
+  *sz = total;
+  return true;
+}
+
+/* brings the document up to date with the contents in file->next */
+static bool
+update_document(WatchedFile *file, size_t sz) {
+  bool ok;
+  if (!file->have_doc) {
+    ok = document_init(&file->doc, &file->ctx, file->next, sz);
+    file->have_doc = true;
+    file->fresh_pool_sz = file->doc.ast.pool.size;
+  } else {
+    /* a single edit, of everything between the longest common prefix and
+     * suffix of the old and new contents */
+    size_t shortest = sz < file->sz ? sz : file->sz;
+    size_t prefix = 0;
+    while (prefix < shortest && file->next[prefix] == file->text[prefix]) {
+      prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < shortest - prefix &&
+           file->next[sz - suffix - 1] == file->text[file->sz - suffix - 1]) {
+      suffix++;
+    }
+    ok = document_edit(&file->doc, prefix, file->sz - prefix - suffix,
+                       file->next + prefix, sz - prefix - suffix);
+  }
+
+  uint8_t *text = file->text;
+  size_t text_alloc = file->text_alloc;
+  file->text = file->next;
+  file->text_alloc = file->next_alloc;
+  file->sz = sz;
+  file->next = text;
+  file->next_alloc = text_alloc;
+  return ok;
+}
+
+static void
+watch_compile(void *data, size_t idx) {
+  WatchRound *round = data;
+  WatchedFile *file = round->files[idx];
+  TimeReport *times = &file->times;
+  uint64_t start = time_now_ns();
+
+  /* a file that couldn't be read last time is compiled even if it's the same
+   * as before, since its errors are the last thing that was printed */
+  bool was_unreadable = file->io_error != NULL;
+  memset(times, 0, sizeof(TimeReport));
+  file->changed = true;
+  file->failed = true;
+  file->io_error = NULL;
+  file->output = NULL;
+  file->output_sz = 0;
+
+  size_t sz;
+  if (!read_file(file, &sz)) {
+    return;
+  }
+  time_report_phase(times, PHASE_READ, &start);
+  if (file->have_doc && !was_unreadable && sz == file->sz &&
+      memcmp(file->next, file->text, sz) == 0) {
+    file->changed = false;
+    return;
+  }
+
+  FILE *out = open_memstream(&file->output, &file->output_sz);
+  if (out == NULL) {
+    log_internal_err("unable to open output stream", NULL);
+  }
+  file->ctx.err_file = out;
+  bool parsed = update_document(file, sz);
+  time_report_phase(times, PHASE_PARSE, &start);
+  file->failed =
+      !parsed || !compile_document(&file->doc, round->opts, out, times);
+  fclose(out);
+
+  if (file->doc.ast.pool.size > WATCH_REBUILD_FACTOR * file->fresh_pool_sz) {
+    document_deinit(&file->doc);
+    file->have_doc = false;
+  }
+}
+
+static void
+run_round(WatchedFile **files, size_t nfiles, CompileOptions *opts,
+          size_t nworkers, bool time_report) {
+  WatchRound round = {.files = files, .opts = opts};
+  uint64_t start = time_now_ns();
+  threadpool_run(nfiles, nworkers, watch_compile, &round);
+  uint64_t wall = time_now_ns() - start;
+
+  TimeReport total = {0};
+  size_t ncompiled = 0;
+  for (size_t i = 0; i < nfiles; i++) {
+    WatchedFile *file = files[i];
+    if (!file->changed) {
+      continue;
+    }
+    ncompiled++;
+    if (file->io_error != NULL) {
+      fflush(stdout);
+      log_err(file->io_error, file->filename);
+    } else {
+      fwrite(file->output, 1, file->output_sz, stdout);
+      free(file->output);
+    }
+    time_report_add(&total, &file->times);
+  }
+  fflush(stdout);
+  if (time_report && ncompiled != 0) {
+    time_report_print(stderr, &total, wall, false);
+  }
+}
+
+/* marks the files that the pending events are about as dirty */
+static void
+read_events(int fd, WatchedFile *files, size_t nfiles) {
+  uint64_t buf[4096 / sizeof(uint64_t)]; /* aligned for inotify_event */
+  ssize_t got = read(fd, buf, sizeof(buf));
+  if (got == -1) {
+    if (errno == EINTR || errno == EAGAIN) {
+      return;
+    }
+    log_err_final("unable to read file events: %s", strerror(errno));
+  }
+
+  uint8_t *iter = (uint8_t *)buf;
+  uint8_t *end = iter + got;
+  while (iter < end) {
+    struct inotify_event *event = (struct inotify_event *)iter;
+    iter += sizeof(struct inotify_event) + event->len;
+    if (event->mask & IN_Q_OVERFLOW) {
+      /* events were lost, so any of the files could have changed */
+      for (size_t i = 0; i < nfiles; i++) {
+        files[i].dirty = true;
+      }
+      continue;
+    }
+    if (event->len == 0) {
+      continue;
+    }
+    for (size_t i = 0; i < nfiles; i++) {
+      if (files[i].wd == event->wd && strcmp(files[i].name, event->name) == 0) {
+        files[i].dirty = true;
+      }
+    }
+  }
+}
+
+void
+watch_run(char **filenames, size_t nfiles, CompileOptions *opts,
+          size_t nworkers, bool time_report) {
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd == -1) {
+    log_err_final("unable to watch files: %s", strerror(errno));
+  }
+
+  WatchedFile *files = calloc(nfiles, sizeof(WatchedFile));
+  WatchedFile **dirty = malloc(sizeof(WatchedFile *) * nfiles);
+  for (size_t i = 0; i < nfiles; i++) {
+    WatchedFile *file = &files[i];
+    file->filename = filenames[i];
+    const char *slash = strrchr(file->filename, '/');
+    char *dir;
+    if (slash == NULL) {
+      dir = strdup(".");
+      file->name = file->filename;
+    } else {
+      dir = strndup(file->filename, slash - file->filename + 1);
+      file->name = slash + 1;
+    }
+    /* the directory is watched rather than the file, so that saves which
+     * replace the file with a new one are seen too */
+    file->wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (file->wd == -1) {
+      log_err_final("unable to watch '%s': %s", dir, strerror(errno));
+    }
+    free(dir);
+    bonc_context_init(&file->ctx, NULL, 0, file->filename, NULL);
+    file->dirty = true;
+  }
+
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  while (1) {
+    size_t ndirty = 0;
+    for (size_t i = 0; i < nfiles; i++) {
+      if (files[i].dirty) {
+        files[i].dirty = false;
+        dirty[ndirty++] = &files[i];
+      }
+    }
+    if (ndirty != 0) {
+      run_round(dirty, ndirty, opts, nworkers, time_report);
+    }
+
+    if (poll(&pfd, 1, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      log_err_final("unable to wait for file events: %s", strerror(errno));
+    }
+    read_events(fd, files, nfiles);
+    /* wait for the writes to settle before compiling */
+    while (poll(&pfd, 1, WATCH_DEBOUNCE_MS) > 0) {
+      read_events(fd, files, nfiles);
+    }
+  }
+}